@@ -201,6 +201,36 @@ public:
         return *this;
     }
 
+    /* Pads every axis of this `AABB` that is thin relative to the size of the `AABB` and the
+    magnitude of its coordinates, so that its length is at least `relative_thickness` times the
+    larger of those two quantities (and at least one ULP on either side).
+
+    This is the robust replacement for padding flat `AABB`s (such as those of axis-aligned
+    `Parallelogram`s) with `ensure_min_axis_length()` and an absolute constant: a constant such
+    as 1e-4 is huge compared to a scene whose coordinates are around 1e-3, and smaller than the
+    spacing between adjacent `double`s once coordinates exceed around 1e12, at which point the
+    padding silently does nothing. */
+    auto& pad_thin_axes(double relative_thickness = 1e-9) {
+        auto scale = 0.;
+        for (size_t axis = 0; axis < 3; ++axis) {
+            const auto &interval = (*this)[axis];
+            scale = std::fmax(scale, std::fmax(interval.size(),
+                                               std::fmax(std::fabs(interval.min),
+                                                         std::fabs(interval.max))));
+        }
+        auto min_axis_length = relative_thickness * scale;
+        for (size_t axis = 0; axis < 3; ++axis) {
+            auto &interval = (*this)[axis];
+            if (interval.size() < min_axis_length) {
+                interval.pad_with((min_axis_length - interval.size()) / 2);
+                /* Round outwards, so that the padded interval strictly contains the original */
+                interval.min = std::nextafter(interval.min, -Interval::DOUBLE_INF);
+                interval.max = std::nextafter(interval.max, Interval::DOUBLE_INF);
+            }
+        }
+        return *this;
+    }
+
     /* Overload `operator<<` to allow printing `AABB`s to output streams */
     friend std::ostream& operator<< (std::ostream &os, const AABB &aabb);
 
@@ -241,6 +271,17 @@ public:
         return ret;
     }
 
+    /* Returns the `AABB` whose slabs are linearly interpolated between those of `a` (when `d` is
+    0) and those of `b` (when `d` is 1). If `a` and `b` bound a moving object at two times, and
+    every point of the object moves linearly between those times, then this bounds the object at
+    the corresponding time in between (each point stays within the interpolated slabs). */
+    static AABB lerp(const AABB &a, const AABB &b, double d) {
+        auto lerp_interval = [d](const Interval &i, const Interval &j) {
+            return Interval(i.min + d * (j.min - i.min), i.max + d * (j.max - i.max));
+        };
+        return AABB(lerp_interval(a.x, b.x), lerp_interval(a.y, b.y), lerp_interval(a.z, b.z));
+    }
+
     /* Returns the minimum-volume `AABB` that contains both of the `AABB`s `a` and `b`.
     That is, this returns the `AABB` that would result if `a` and `b` were combined into a single
     `AABB`. */
@@ -2,11 +2,19 @@
 #define BVH_H
 
 #include <array>
+#include <limits>
 #include <algorithm>  /* For `std::partition` */
 #include <span>
-#include <type_traits>  /* For `std::is_base_of_v` (to guarantee static dispatch when possible) */
+#include <mutex>    /* For `std::once_flag` and `std::call_once` */
+#include <memory>
+#include <thread>
+#include <optional>
+#include <type_traits>  /* For `std::is_base_of_v` and `std::is_same_v` */
 #include "util/time_util.h"
+#include "util/huge_pages.h"
+#include "util/numa.h"
 #include "base/scene.h"
+#include "shapes/parallelogram.h"
 
 /* `BVH` is an abstraction over a Bounding Volume Hierarchy, which is a data structure that allows
 for sublinear ray-scene intersection tests. Implementation inspired by
@@ -96,6 +104,10 @@ class BVH : public Hittable {
         }
     };
 
+    /* `NO_PACKET` is the value of `LinearBVHNode::first_packet_index` for nodes which are not
+    tested with `parallelogram_packets`. */
+    static constexpr size_t NO_PACKET = std::numeric_limits<size_t>::max();
+
     /* Each `LinearBVHNode` represents a node in the flattened (linear) representation
     of the BVH tree. To accomplish that representation, `LinearBVHNode`s store all the
     information we need to traverse the BVH tree: in addition to the AABB for its set
@@ -151,6 +163,12 @@ class BVH : public Hittable {
         two children. Specifically, if `split_axis` equals 0, 1, or 2, then this interior
         node's primitives were partitioned along the x-, y-, and z-axis, respectively. */
         uint8_t split_axis;
+        /* For leaf nodes containing only `Parallelogram`s, `first_packet_index` equals the index
+        of the first of those `Parallelogram`s in `parallelogram_packets` (the rest follow it
+        contiguously, in the same order as in `primitives`). For all other nodes, it equals
+        `NO_PACKET`. This field fits in the padding that `alignas(32)` already adds, so it does
+        not increase the size of a `LinearBVHNode`. */
+        size_t first_packet_index = NO_PACKET;
 
         /* `LinearBVHNode::is_leaf_node()` returns true iff this `LinearBVHNode` is a leaf node. */
         bool is_leaf_node() const {
@@ -162,6 +180,10 @@ class BVH : public Hittable {
 
     /* `primitives` = The PRIMITIVE COMPONENTS of the `Scene` which this `BVH` was built over. */
     std::vector<std::shared_ptr<Hittable>> primitives;
+    /* `arena` = The arena of the `Scene` which this `BVH` was built over, if it was built over a
+    `Scene`, so that `report_memory()` counts the primitives in it with its blocks, even after the
+    `Scene` is gone (see `SceneArena::report_memory()`) */
+    std::optional<SceneArena> arena;
     /* `MAX_PRIMITIVES_IN_NODE` = the maximum number of primitives we allow to be held in a
     single `BVHTreeNode`.
     `NUM_BUCKETS` = the number of buckets to test (the number of splits to test along each
@@ -173,8 +195,85 @@ class BVH : public Hittable {
     /* `linear_bvh_nodes` contains the flattened representation of the BVH Tree. Using this
     rather than a tree structure "improves cache, memory, and thus overall system performance".
     Specifically, `linear_bvh_nodes` holds the nodes of the BVH tree (all converted to
-    `LinearBVHNode`s) in preorder. */
-    std::vector<LinearBVHNode> linear_bvh_nodes;
+    `LinearBVHNode`s) in preorder. It is allocated from huge pages when those are enabled (see
+    `HugePages`), since traversals read it all over in random order. */
+    std::vector<LinearBVHNode, HugePageAllocator<LinearBVHNode>> linear_bvh_nodes;
+    /* `any_primitive_moving` = Whether any primitive in this `BVH` moves (see `Ray3D::time`). */
+    bool any_primitive_moving = false;
+    /* If any primitive moves, then the node bounds describe the primitives over the interval of
+    scene times `motion_times` only: the `aabb` of each `LinearBVHNode` bounds its primitives at
+    scene time `motion_times.min`, and `node_aabbs_at_end[i]` bounds the primitives of
+    `linear_bvh_nodes[i]` at scene time `motion_times.max`. A ray at time `t` is then tested against
+    the bounds linearly interpolated between the two (see `AABB::lerp()` and
+    `Hittable::get_aabb_at_time()`), which stay tight for fast-moving objects, unlike bounds over
+    their whole motion. `motion_times` is [0, 1] after construction, and can be narrowed with
+    `refit()`. If nothing moves, or if `motion_times` is a single instant, `node_aabbs_at_end` is
+    empty, and the `aabb` of each node is used as is. */
+    Interval motion_times{0, 1};
+    std::vector<AABB, HugePageAllocator<AABB>> node_aabbs_at_end;
+
+    /* Returns the fraction of the way through `motion_times` that the scene time `time` is, which
+    is the parameter with which node bounds are interpolated. */
+    double motion_fraction(double time) const {
+        return (time - motion_times.min) / motion_times.size();
+    }
+
+    /* `parallelogram_packets` holds the `Parallelogram`s from every leaf node that contains only
+    `Parallelogram`s, in structure-of-arrays layout, so that those leaf nodes can be tested with
+    a single vectorized loop instead of one virtual `hit_by()` call per primitive. */
+    ParallelogramBatch parallelogram_packets;
+
+    /* `NumaReplicaCache` = The copies of a `BVH` on every NUMA node (see `numa_replicas()`), made
+    once, the first time they are asked for. Copies of a `BVH` share its cache, as they have the
+    same nodes; `refit()` gives the refitted `BVH` a new one. */
+    struct NumaReplicaCache {
+        std::once_flag made;
+        std::vector<std::unique_ptr<BVH>> copies;
+    };
+    std::shared_ptr<NumaReplicaCache> numa_replica_cache = std::make_shared<NumaReplicaCache>();
+
+    /* Numbers the materials of `world` (see `Hittable::append_materials()`) 0, 1, 2, ... in the
+    order they are first found, which depends only on the order of the objects of `world`, and
+    not on the order in which they (or their materials) were constructed; see `Material::id`. */
+    static void number_materials(const Hittable &world) {
+        constexpr auto UNNUMBERED = std::numeric_limits<size_t>::max();
+        std::vector<Material*> materials;
+        world.append_materials(materials);
+        for (auto material : materials) {
+            material->id = UNNUMBERED;
+        }
+        size_t next_id = 0;
+        for (auto material : materials) {
+            if (material->id == UNNUMBERED) {
+                material->id = next_id++;
+            }
+        }
+    }
+
+    /* Fills `parallelogram_packets` with the `Parallelogram`s of every leaf node in
+    `linear_bvh_nodes` that contains only `Parallelogram`s (and more than one primitive; a single
+    primitive is tested just as fast on its own), and sets their `first_packet_index`es. */
+    void build_parallelogram_packets() {
+        for (auto &node : linear_bvh_nodes) {
+            if (node.num_primitives < 2) {
+                continue;
+            }
+            auto leaf_primitives = std::span(primitives).subspan(node.first_primitive_index,
+                                                                 node.num_primitives);
+            auto all_parallelograms = std::all_of(leaf_primitives.begin(), leaf_primitives.end(),
+                [](const std::shared_ptr<Hittable> &primitive) {
+                    return dynamic_cast<const Parallelogram*>(primitive.get()) != nullptr;
+                }
+            );
+            if (!all_parallelograms) {
+                continue;
+            }
+            node.first_packet_index = parallelogram_packets.size();
+            for (const auto &primitive : leaf_primitives) {
+                parallelogram_packets.add(static_cast<const Parallelogram&>(*primitive));
+            }
+        }
+    }
 
     /* Build a BVH tree over the `Hittable` primitives specified by `curr_primitives`.
     Specifically, this returns the `root` of a binary tree representing the BVH built
@@ -218,10 +317,11 @@ class BVH : public Hittable {
         into two sets if we end up deciding to split `curr_primitives` even further after this.  */
         auto min_split_cost = std::numeric_limits<double>::infinity();
         uint8_t optimal_split_axis = 0;
-        size_t optimal_split_bucket;
-        /* ^^ Note: we initialize `optimal_split_axis` to silence a `-Wmaybe-uninitialized` warning
-        in GCC. The compiler mistakenly thinks that in `BVHTreeNode::interior_node`, we will pass
-        and subsequently use `optimal_split_axis` while it is uninitialized. This is impossible,
+        size_t optimal_split_bucket = 0;
+        /* ^^ Note: we initialize `optimal_split_axis` and `optimal_split_bucket` to silence
+        `-Wmaybe-uninitialized` warnings in GCC. The compiler mistakenly thinks that in
+        `BVHTreeNode::interior_node`, we will pass and subsequently use `optimal_split_axis` (or
+        use `optimal_split_bucket` in the partition) while it is uninitialized. This is impossible,
         because the only way `optimal_split_axis` would have been left uninitialized is when all
         iterations of the main loop are skipped (see the first comment in the main loop for when
         this would happen). But in that case, we would immediately return due to the check of
@@ -578,8 +678,85 @@ class BVH : public Hittable {
         }
     }
 
+    /* Builds this `BVH` over `primitives`, once they have been collected from `num_objects`
+    objects, starting from the time `start`, and prints how long it took. */
+    void build_over_primitives(size_t num_objects, std::chrono::steady_clock::time_point start) {
+        std::cout << "Building BVH over " << num_objects << " objects ("
+                  << primitives.size() << " primitives, collected in "
+                  << ms_diff(start, std::chrono::steady_clock::now()) << "ms)..." << std::endl;
+
+        /* Build the BVH tree, then flatten it into an array (which consumes the
+        BVH tree in the process, so only the array representation is left at the end). */
+        flatten_bvh_tree(build_bvh_tree(primitives));
+        any_primitive_moving = std::any_of(primitives.begin(), primitives.end(),
+                                           [](const auto &primitive) {return primitive->is_moving();});
+        refit(Interval(0, 1));
+        build_parallelogram_packets();
+
+        std::cout << "Constructed BVH in "
+                  << ms_diff(start, std::chrono::steady_clock::now())
+                  << "ms (created " << total_bvhnodes << " BVHNodes total)\n" << std::endl;
+    }
+
 public:
 
+    /* @brief Recomputes the bounds of every node of this `BVH` (without changing its structure)
+    so that they bound its primitives only over the scene times `times` (a subset of [0, 1]).
+    Afterwards, this `BVH` may only be intersected with rays whose times are in `times`.
+
+    Rendering a sequence of frames, each with a short shutter interval, over moving objects would
+    otherwise test every ray against bounds over the motion during ALL frames. Refitting to each
+    frame's shutter interval keeps the bounds as tight as if the `BVH` had been built for that
+    frame, at a cost linear in the number of nodes and primitives, which is far cheaper than
+    rebuilding the `BVH`. The tree itself is not rebuilt, so it may become less efficient if the
+    primitives move far from where they were at construction.
+
+    Does nothing if no primitive moves. */
+    void refit(const Interval &times) {
+        if (!any_primitive_moving) {
+            return;
+        }
+        if (!(0 <= times.min && times.min <= times.max && times.max <= 1)) {
+            std::cout << "Error: `BVH::refit()` was given the scene times " << times
+                      << ", which are not a subset of [0, 1]" << std::endl;
+            std::exit(-1);
+        }
+        motion_times = times;
+        auto single_instant = !(times.size() > 0);
+        /* Copies made before this have the old bounds */
+        numa_replica_cache = std::make_shared<NumaReplicaCache>();
+
+        /* The nodes are in preorder, so every node's children come after it; going backwards,
+        both children of a node have been computed by the time we reach it. */
+        std::vector<AABB, HugePageAllocator<AABB>> aabbs_at_end(linear_bvh_nodes.size(),
+                                                                AABB::empty());
+        for (size_t i = linear_bvh_nodes.size(); i-- > 0;) {
+            auto &node = linear_bvh_nodes[i];
+            auto aabb_at_start = AABB::empty(), aabb_at_end = AABB::empty();
+            if (node.is_leaf_node()) {
+                for (size_t j = node.first_primitive_index;
+                     j < node.first_primitive_index + node.num_primitives; ++j)
+                {
+                    aabb_at_start.merge_with(primitives[j]->get_aabb_at_time(times.min));
+                    aabb_at_end.merge_with(primitives[j]->get_aabb_at_time(times.max));
+                }
+            } else {
+                aabb_at_start = AABB::merge(linear_bvh_nodes[i + 1].aabb,
+                                            linear_bvh_nodes[node.second_child_index].aabb);
+                aabb_at_end = AABB::merge(aabbs_at_end[i + 1],
+                                          aabbs_at_end[node.second_child_index]);
+            }
+            node.aabb = aabb_at_start;
+            aabbs_at_end[i] = aabb_at_end;
+        }
+
+        /* At a single instant, the bounds at the start and end are the same */
+        if (single_instant) {
+            aabbs_at_end.clear();
+        }
+        node_aabbs_at_end = std::move(aabbs_at_end);
+    }
+
     /* Returns a `hit_info` with information about the earliest intersection of the ray `ray` with
     any primitive in this `BVH`, in the time interval `ray_times`, if any. */
     std::optional<hit_info> hit_by(const Ray3D &ray, const Interval &ray_times_) const override {
@@ -612,10 +789,22 @@ public:
         /* `ray_times` is a modifiable copy of `ray_times_`. We need this because we will
         update `ray_times.max` as we find earlier and earlier intersections. */
         auto ray_times = ray_times_;
+        /* `interpolated_aabb` holds the bounds of the current node at the time of the ray, if
+        anything in this `BVH` moves (see `node_aabbs_at_end`), and `ray_motion_fraction` is the
+        parameter with which they are interpolated. */
+        AABB interpolated_aabb;
+        auto ray_motion_fraction = (node_aabbs_at_end.empty() ? 0 : motion_fraction(ray.time));
 
         /* (Iteratively) DFS starting from the root of the BVH. */
         while (true) {
             const auto &curr_node = linear_bvh_nodes[curr_node_index];
+            /* `curr_node_aabb` = The bounds of the current node at the time of the ray */
+            const auto *curr_node_aabb = &curr_node.aabb;
+            if (!node_aabbs_at_end.empty()) {
+                interpolated_aabb = AABB::lerp(curr_node.aabb, node_aabbs_at_end[curr_node_index],
+                                               ray_motion_fraction);
+                curr_node_aabb = &interpolated_aabb;
+            }
 
             /* At each node, the first step is to check if the ray hits the node's AABB in
             the time interval `ray_times`. If it does not, then we immediately know that
@@ -623,12 +812,28 @@ public:
             "return" from this call to the DFS (pop the DFS call stack and continue with
             the previous node). This is the key idea behind using BVHs to achieve
             sublinear-time intersection tests. */
-            if (curr_node.aabb.is_hit_by_optimized(ray, ray_times, inv_ray_dir, dir_is_negative)) {
+            if (curr_node_aabb->is_hit_by_optimized(ray, ray_times, inv_ray_dir, dir_is_negative)) {
                 if (curr_node.is_leaf_node()) {
                     /* If the current `LinearBVHNode` is a leaf node, and its bounding box is
                     intersected by the given ray, then we will just need to test the ray against
                     every primitive contained in this leaf node. */
 
+                    /* If this leaf node contains only `Parallelogram`s, test all of them at once
+                    with `parallelogram_packets` instead. */
+                    if (curr_node.first_packet_index != NO_PACKET) {
+                        if (auto curr = parallelogram_packets.hit_by(
+                                curr_node.first_packet_index, curr_node.num_primitives,
+                                ray, ray_times
+                            ); curr)
+                        {
+                            result = curr;
+                            ray_times.max = curr->hit_time;
+                        }
+                        if (stack_next_index == 0) {break;}
+                        curr_node_index = dfs_callstack[--stack_next_index];
+                        continue;
+                    }
+
                     /* Enumerate all primitives contained by this leaf node. Remember, that
                     is the contiguous range in the `primitives` array starting at index
                     `curr_node.first_primitive_index` and with size `curr_node.num_primitives`. */
@@ -714,14 +919,140 @@ public:
         return result;
     }
 
+    /* Returns the fraction of light that gets through every primitive in this `BVH` along `ray`
+    in the time range `ray_times` (see `Hittable::transmittance()`). Unlike `hit_by()`, this visits
+    every node the ray passes through (in no particular order), since participating media only
+    attenuate the light; it stops as soon as some primitive blocks all of it. */
+    double transmittance(const Ray3D &ray, const Interval &ray_times) const override {
+        /* See `hit_by()` for the traversal; here the nodes are just visited in preorder */
+        std::array<size_t, 128> dfs_callstack;
+        size_t stack_next_index = 0, curr_node_index = 0;
+        auto inv_ray_dir = Vec3D{1 / ray.dir.x, 1 / ray.dir.y, 1 / ray.dir.z};
+        std::array<bool, 3> dir_is_negative{ray.dir.x < 0, ray.dir.y < 0, ray.dir.z < 0};
+        AABB interpolated_aabb;
+        auto ray_motion_fraction = (node_aabbs_at_end.empty() ? 0 : motion_fraction(ray.time));
+
+        double ret = 1;
+        while (true) {
+            const auto &curr_node = linear_bvh_nodes[curr_node_index];
+            const auto *curr_node_aabb = &curr_node.aabb;
+            if (!node_aabbs_at_end.empty()) {
+                interpolated_aabb = AABB::lerp(curr_node.aabb, node_aabbs_at_end[curr_node_index],
+                                               ray_motion_fraction);
+                curr_node_aabb = &interpolated_aabb;
+            }
+
+            if (curr_node_aabb->is_hit_by_optimized(ray, ray_times, inv_ray_dir, dir_is_negative)) {
+                if (!curr_node.is_leaf_node()) {
+                    dfs_callstack[stack_next_index++] = curr_node.second_child_index;
+                    curr_node_index = curr_node_index + 1;
+                    continue;
+                }
+                if (curr_node.first_packet_index != NO_PACKET) {
+                    /* `Parallelogram`s are solid */
+                    if (parallelogram_packets.hit_by(curr_node.first_packet_index,
+                                                     curr_node.num_primitives, ray, ray_times)) {
+                        return 0;
+                    }
+                } else {
+                    for (
+                        size_t i = curr_node.first_primitive_index;
+                        i < curr_node.first_primitive_index + curr_node.num_primitives;
+                        ++i
+                    ) {
+                        ret *= primitives[i]->transmittance(ray, ray_times);
+                        if (ret <= 0) {return 0;}
+                    }
+                }
+            }
+
+            if (stack_next_index == 0) {break;}
+            curr_node_index = dfs_callstack[--stack_next_index];
+        }
+        return ret;
+    }
+
     /* Returns the AABB for this `BVH`. */
     AABB get_aabb() const override {
         /* A `BVH`'s AABB is equivalent to the BVH's root's AABB. Because our construction methods
         guarantee that the first node in `linear_bvh_nodes` is the root, it suffices to return the
-        AABB for `linear_bvh_nodes.front()`. */
+        AABB for `linear_bvh_nodes.front()` (over both ends of `motion_times`, if anything moves). */
+        if (!node_aabbs_at_end.empty()) {
+            return AABB::merge(linear_bvh_nodes.front().aabb, node_aabbs_at_end.front());
+        }
+        return linear_bvh_nodes.front().aabb;
+    }
+
+    /* Returns `true` if the bounds of this `BVH` change over its `motion_times`. */
+    bool is_moving() const override {
+        return !node_aabbs_at_end.empty();
+    }
+
+    /* Returns the AABB for this `BVH` at the scene time `time`, which must be in the scene times
+    it was last refit to (see `refit()`). */
+    AABB get_aabb_at_time(double time) const override {
+        if (!node_aabbs_at_end.empty()) {
+            return AABB::lerp(linear_bvh_nodes.front().aabb, node_aabbs_at_end.front(),
+                              motion_fraction(time));
+        }
         return linear_bvh_nodes.front().aabb;
     }
 
+    /* Counts the memory used by this `BVH` (its nodes, its copy of the list of primitives, and its
+    `Parallelogram` packets) and by all of its primitives in `report`. The primitives of a `BVH`
+    built over a `Scene` are the objects of that `Scene`, so they are only counted once when both
+    are reported. */
+    void report_memory(MemoryReport &report) const override {
+        if (!report.first_visit(this)) {return;}
+        report.add(MemoryCategory::BVH_NODES, sizeof(*this) + parallelogram_packets.memory_bytes());
+        report.add_vector(MemoryCategory::BVH_NODES, linear_bvh_nodes);
+        report.add_vector(MemoryCategory::OBJECT_LISTS, primitives);
+        if (arena) {
+            arena->report_memory(report);
+        }
+        for (const auto &primitive : primitives) {
+            primitive->report_memory(report);
+        }
+        /* The copies share the primitives, which were just counted */
+        for (const auto &copy : numa_replica_cache->copies) {
+            copy->report_memory(report);
+        }
+    }
+
+    /* Appends the materials of the primitives of this `BVH` to `out`, in the order of its
+    primitives (see `Hittable::append_materials()`). */
+    void append_materials(std::vector<Material*> &out) const override {
+        for (const auto &primitive : primitives) {
+            primitive->append_materials(out);
+        }
+    }
+
+    /* Returns a copy of this `BVH` on every NUMA node of this machine (the `i`th made by a thread
+    pinned to the `i`th node, so that its memory is placed there; see `NumaTopology`). The copies
+    share the primitives of this `BVH`. They are made the first time this is called, and every
+    later call (on this `BVH` or on a copy of it, until it is refitted) returns the same copies, so
+    rendering the same `BVH` many times copies it only once. This is thread-safe. */
+    const std::vector<std::unique_ptr<BVH>>& numa_replicas() const {
+        std::call_once(numa_replica_cache->made, [&] {
+            const auto &topology = NumaTopology::get();
+            auto &copies = numa_replica_cache->copies;
+            copies.resize(topology.num_nodes());
+            std::vector<std::thread> copiers;
+            for (size_t node = 0; node < topology.num_nodes(); ++node) {
+                copiers.emplace_back([&, node] {
+                    NumaTopology::pin_current_thread(topology.cpus_of(node));
+                    copies[node] = std::make_unique<BVH>(*this);
+                    /* A copy that shared this cache would keep itself alive */
+                    copies[node]->numa_replica_cache = std::make_shared<NumaReplicaCache>();
+                });
+            }
+            for (auto &copier : copiers) {
+                copier.join();
+            }
+        });
+        return numa_replica_cache->copies;
+    }
+
     /* Prints this `BVH` to the `std::ostream` specified by `os`. */
     void print_to(std::ostream &os) const override {
         print_as_tree(os);
@@ -754,25 +1085,41 @@ public:
     template<typename T>
     requires std::is_base_of_v<Hittable, T>
     BVH(const T &world, size_t num_buckets = 32, size_t max_primitives_in_node = 12)
-        : primitives{std::move(world.get_primitive_components())},
-          /* ^^ Build the Bounding Volume Hierarchy over the primitive components of the `Hittable`
-          objects in the scene, rather than just the objects themselves. The reason why we do this
-           is thoroughly explained in the comments for `Hittable::get_primitive_components()`. */
-          MAX_PRIMITIVES_IN_NODE{max_primitives_in_node},
+        : MAX_PRIMITIVES_IN_NODE{max_primitives_in_node},
           NUM_BUCKETS{num_buckets}
     {
-        std::cout << "Building BVH over " << world.size() << " objects ("
-                  << primitives.size() << " primitives)..." << std::endl;
-
         auto start = std::chrono::steady_clock::now();
+        number_materials(world);
+
+        /* Build the Bounding Volume Hierarchy over the primitive components of the `Hittable`
+        objects in the scene, rather than just the objects themselves. The reason why we do this
+        is thoroughly explained in the comments for `Hittable::num_primitive_components()`. The
+        primitives are appended directly into `primitives`, which is allocated exactly once. */
+        primitives.reserve(world.num_primitive_components());
+        HugePages::advise(primitives.data(), primitives.capacity() * sizeof(primitives[0]));
+        world.append_primitive_components(primitives);
+        if constexpr (std::is_same_v<T, Scene>) {
+            arena = world.get_arena();
+        }
 
-        /* Build the BVH tree, then flatten it into an array (which consumes the
-        BVH tree in the process, so only the array representation is left at the end). */
-        flatten_bvh_tree(build_bvh_tree(primitives));
+        build_over_primitives(world.size(), start);
+    }
 
-        std::cout << "Constructed BVH in "
-                  << ms_diff(start, std::chrono::steady_clock::now())
-                  << "ms (created " << total_bvhnodes << " BVHNodes total)\n" << std::endl;
+    /* Builds a `BVH` over the primitive components of the `Scene` `world`, like the constructor
+    above, but takes them out of `world` (see `Scene::take_primitive_components()`), which is left
+    empty. Use this when `world` is not needed after the `BVH` is built: otherwise, the list of
+    objects of `world` and the list of primitives of the `BVH` (for scenes of millions of
+    objects, tens of megabytes each) both stay alive for as long as the `BVH` does. */
+    BVH(Scene &&world, size_t num_buckets = 32, size_t max_primitives_in_node = 12)
+        : MAX_PRIMITIVES_IN_NODE{max_primitives_in_node},
+          NUM_BUCKETS{num_buckets}
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto num_objects = world.size();
+        number_materials(world);
+        arena = world.get_arena();
+        primitives = std::move(world).take_primitive_components();
+        build_over_primitives(num_objects, start);
     }
 };
 
@@ -1,10 +1,39 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <tuple>
 #include <numbers>
+#include <optional>
+#include <utility>  /* For `std::pair` */
+#include <type_traits>  /* For `std::is_same_v` */
+#include "util/numa.h"
 #include "util/image.h"
+#include "util/aov_buffers.h"
 #include "math/ray3d.h"
+#include "base/material.h"
 #include "acceleration/bvh.h"
+#include "lights/environment_light.h"
+
+/* `Projection` = How a `Camera` maps the directions around it onto its image. */
+enum class Projection {
+    /* `PERSPECTIVE` = Onto a flat viewport in front of the camera, like a pinhole (or thin lens)
+    camera; this is the only projection with a field of view and defocus blur. */
+    PERSPECTIVE,
+    /* `EQUIRECTANGULAR` = Every direction, in latitude-longitude layout: the columns span a full
+    turn about the camera's up direction, and the rows go from straight up to straight down. The
+    layout is the one `EnvironmentLight` reads (for a camera looking towards -z with +y up), so
+    such a render of a scene can be loaded back as the environment of another scene. The image
+    should be twice as wide as it is high (per eye), so that the pixels are square. */
+    EQUIRECTANGULAR,
+    /* `CUBEMAP` = Every direction, projected onto the six faces of a cube around the camera,
+    which are placed side by side in the order +x, -x, +y, -y, +z, -z (of the camera's right, up,
+    and backward directions), each in the orientation used by OpenGL cube map textures. The image
+    must be exactly six times as wide as it is high (per eye). */
+    CUBEMAP
+};
 
 /* The class `Camera` encapsulates the notion of a camera viewing a 3D scene from
 a designated camera/eye point, located a certain length (called the focal length)
@@ -20,6 +49,10 @@ class Camera {
     double viewport_w, viewport_h;
     /* The horizontal and vertical delta vectors from pixel to pixel in the viewport. */
     Vec3D pixel_delta_x, pixel_delta_y;
+    /* `pixel_spread` = The angle (in radians) that one pixel subtends, as seen from the camera
+    center; it becomes the `spread` of every camera ray (see `Ray3D::spread`). Calculated in
+    `init()`. */
+    double pixel_spread = 0;
     /* `camera` stores the camera ray; the coordinates of the camera/eye point,
     and the direction in which the camera looks. By default, the camera center is
     at the origin, and the camera looks toward the direction of negative z-axis
@@ -62,6 +95,37 @@ class Camera {
     of the defocus disk. Both are determined by `focal_length`, `defocus_angle`,  and
     `cam_basis_x/y`. */
     Vec3D defocus_disk_x, defocus_disk_y;
+    /* `aperture_blades` = The number of straight blades of the camera's aperture, which shape the
+    defocus blur (the "bokeh") of out-of-focus highlights into a regular polygon with that many
+    sides, inscribed in the defocus disk; or 0 for a perfectly circular aperture, the default.
+    `aperture_rotation` = The angle (in radians) of the first vertex of that polygon,
+    counterclockwise from `cam_basis_x`. Both may be set through `set_aperture_blades()`. */
+    size_t aperture_blades = 0;
+    double aperture_rotation = 0;
+    /* `aperture_vertices[k]` = The coordinates (along `defocus_disk_x` and `defocus_disk_y`) of
+    the `k`th vertex of the aperture polygon, with the first vertex repeated at the end; empty for
+    a circular aperture. Calculated in `init()`. */
+    std::vector<std::pair<double, double>> aperture_vertices;
+    /* `shutter` = The interval of scene times (see `Ray3D::time`) during which the camera's
+    shutter is open; each ray is shot at an uniformly random time in `shutter`, which renders
+    moving objects with motion blur. Always a subset of [0, 1]. By default, the shutter opens and
+    closes at time 0, so there is no motion blur. */
+    Interval shutter{0, 0};
+    /* `CropWindow` = A rectangle of pixels in the image: the pixels in the rows [`row`, `row` +
+    `height`) and the columns [`col`, `col` + `width`). */
+    struct CropWindow {
+        size_t col, row, width, height;
+    };
+    /* `crop_window`, if specified, is the rectangle of pixels of the image that `render()` actually
+    renders; `render()` then returns an image of just that rectangle, each of whose pixels is
+    rendered exactly like the corresponding pixel of the full image (up to the randomness of the
+    samples). If not specified, the full image is rendered. */
+    std::optional<CropWindow> crop_window;
+    /* `sample_seed`, if specified, makes rendering deterministic: before each sample, the random
+    number generator of the thread rendering it is reseeded with `sample_seed` and the index of
+    that sample among all samples of the image (see `seed_rand_double()`). Otherwise, the random
+    numbers of each sample depend on which thread renders it, and in what order. */
+    std::optional<uint64_t> sample_seed;
     /* Coordinates of the top-left image pixel (calculated in `init()`) */
     Point3D pixel00_loc;
     /* Number of rays sampled per pixel, 1 by default */
@@ -80,6 +144,26 @@ class Camera {
     whenever a ray hits no object in the scene, this color is returned as the color of that ray.
     `RGB::from_mag(0.5)` (gray; halfway between white and black) by default. */
     RGB background{RGB::from_mag(0.5)};
+    /* `environment`, if present, replaces the `background`: rays that hit no object get the
+    radiance it gives for their direction. `sample_environment` = Whether `environment` is also
+    sampled directly at every bounce; see `set_environment()`. */
+    std::shared_ptr<const EnvironmentLight> environment;
+    bool sample_environment = true;
+    /* `projection` = How the directions around the camera are mapped onto the image (see
+    `Projection`). `Projection::PERSPECTIVE` by default. */
+    Projection projection = Projection::PERSPECTIVE;
+    /* `eye_separation` = The distance between the two eyes of a stereo camera, or 0 for an
+    ordinary (mono) camera, the default. A stereo camera renders the view of the left eye into the
+    top half of the image, and that of the right eye into the bottom half ("over-under" layout),
+    as VR players expect. See `set_stereo()`. */
+    double eye_separation = 0;
+    /* `num_threads`, if specified, is the number of threads that render; otherwise, OpenMP decides
+    (see `OMP_NUM_THREADS`). `thread_placement` = How those threads are pinned to CPUs, and
+    `replicate_bvh` = Whether a `BVH` being rendered is first copied onto every NUMA node; see
+    `set_thread_placement()`. */
+    std::optional<size_t> num_threads;
+    ThreadPlacement thread_placement = ThreadPlacement::UNPINNED;
+    bool replicate_bvh = false;
 
     /* Set the values of `viewport_w`, `viewport_h`, `pixel_delta_x`, `pixel_delta_y`,
     `upper_left_corner`, and `pixel00_loc` based on `image_w` and `image_h`. This function
@@ -89,7 +173,18 @@ class Camera {
         /* Calculate the true aspect ratio of the image. Note that this may be different
         from the aspect ratio passed in calls to `set_image_by_xxxxx_and_aspect_ratio`,
         because `image_w` and `image_h` both must be integers. */
-        auto aspect_ratio = static_cast<double>(image_w) / static_cast<double>(image_h);
+        auto aspect_ratio = static_cast<double>(image_w) / static_cast<double>(eye_height());
+
+        if (eye_separation > 0 && (image_h < 2 || image_h % 2 != 0)) {
+            std::cout << "Error: A stereo camera needs an even image height, to split it between "
+                      << "its two eyes, but the image height is " << image_h << std::endl;
+            std::exit(-1);
+        }
+        if (projection == Projection::CUBEMAP && image_w != 6 * eye_height()) {
+            std::cout << "Error: A cube map needs an image width of 6 times its height (per eye), "
+                      << "but the image is " << image_w << " x " << image_h << std::endl;
+            std::exit(-1);
+        }
 
         /* If the user has explicitly provided a lookat point for the camera, then update
         the camera's direction to be towards that lookat point from the current camera
@@ -133,7 +228,14 @@ class Camera {
         vector going down across the viewport has a negative y-component. */
         Vec3D x_vec = viewport_w * cam_basis_x, y_vec = -viewport_h * cam_basis_y;
         pixel_delta_x = x_vec / static_cast<double>(image_w);  /* Divide by pixels per row */
-        pixel_delta_y = y_vec / static_cast<double>(image_h);  /* Divide by pixels per column */
+        pixel_delta_y = y_vec / static_cast<double>(eye_height());  /* Pixels per column */
+        pixel_spread = pixel_delta_x.mag() / focal_length;
+        /* Panoramic pixels subtend a full turn per row, or a quarter turn per face */
+        if (projection == Projection::EQUIRECTANGULAR) {
+            pixel_spread = 2 * std::numbers::pi / static_cast<double>(image_w);
+        } else if (projection == Projection::CUBEMAP) {
+            pixel_spread = std::numbers::pi / 2 / static_cast<double>(eye_height());
+        }
 
         /* Find `upper_left_corner`, the coordinates of the upper left corner of the viewport.
         The upper left point of the viewport is found by starting at the camera, moving
@@ -154,23 +256,126 @@ class Camera {
         auto defocus_disk_radius = focal_length * std::tan(defocus_angle / 2);
         defocus_disk_x = defocus_disk_radius * cam_basis_x;
         defocus_disk_y = defocus_disk_radius * cam_basis_y;
+
+        /* The vertices of the aperture polygon, if any, lie on the unit circle */
+        aperture_vertices.clear();
+        for (size_t k = 0; aperture_blades > 0 && k <= aperture_blades; ++k) {
+            auto angle = aperture_rotation + 2 * std::numbers::pi * static_cast<double>(k)
+                                             / static_cast<double>(aperture_blades);
+            aperture_vertices.emplace_back(std::cos(angle), std::sin(angle));
+        }
     }
 
-    /* Returns a random point in the camera's defocus disk. */
+    /* Returns a random point in the camera's defocus disk (or, with a polygonal aperture, in the
+    polygon inscribed in it; see `aperture_blades`), chosen uniformly by area. */
     auto random_point_in_defocus_disk() const {
 
-        /* First, generate a random vector in the unit disk */
-        auto vec = Vec3D::random_vector_in_unit_disk();
+        /* First, generate a random vector in the unit disk (or the unit polygon) */
+        Vec3D vec;
+        if (aperture_vertices.empty()) {
+            vec = Vec3D::random_vector_in_unit_disk();
+        } else {
+            /* The polygon is made of `aperture_blades` congruent triangles, each with a vertex at
+            the center; choose one of them uniformly, and then a point in it uniformly (the square
+            root makes the distance from the center follow the triangle's linear growth). */
+            auto blades = static_cast<double>(aperture_blades);
+            auto k = std::min(static_cast<size_t>(rand_double(0, blades)), aperture_blades - 1);
+            auto s = std::sqrt(rand_double()), t = rand_double();
+            const auto &[x0, y0] = aperture_vertices[k];
+            const auto &[x1, y1] = aperture_vertices[k + 1];
+            vec = Vec3D{s * ((1 - t) * x0 + t * x1), s * ((1 - t) * y0 + t * y1), 0};
+        }
 
         /* Then, use the defocus disk basis vectors to turn `vec` into
         a random vector in the camera's defocus disk. */
         return camera.origin + vec.x * defocus_disk_x + vec.y * defocus_disk_y;
     }
 
-    /*
-    Returns a ray originating from the defocus disk centered at `camera.origin`, and through
-    a random point in the square region centered at the pixel in row `row` and column `col`.
-    
+    /* Returns the center of the first pixel in the row `row`. The centers of the other pixels in
+    the row are found by adding multiples of `pixel_delta_x` to it, so when generating the rays of
+    many pixels in a row, this only needs to be computed once. */
+    Point3D row_start(size_t row) const {
+        if (eye_separation > 0) {
+            return pixel00_loc + static_cast<double>(eye_row(row)) * pixel_delta_y
+                 + eye_offset(row) * cam_basis_x;
+        }
+        return pixel00_loc + static_cast<double>(row) * pixel_delta_y;
+    }
+
+    /* Returns the height of the view of each eye: half the image height for a stereo camera, and
+    the whole image height otherwise. */
+    size_t eye_height() const {
+        return (eye_separation > 0 ? image_h / 2 : image_h);
+    }
+
+    /* Returns the row within the view of its eye of the image row `row`. */
+    size_t eye_row(size_t row) const {
+        return (row >= eye_height() ? row - eye_height() : row);
+    }
+
+    /* Returns how far the eye that the image row `row` belongs to is to the right of the camera
+    center: -`eye_separation` / 2 for the left eye (the top half of the image), `eye_separation`
+    / 2 for the right eye (the bottom half), and 0 for a mono camera. */
+    double eye_offset(size_t row) const {
+        if (eye_separation <= 0) {return 0;}
+        return (row < eye_height() ? -eye_separation : eye_separation) / 2;
+    }
+
+    /* Returns the direction (in the camera's basis `cam_basis_x/y/z`, not necessarily a unit
+    vector) of the point at (`u`, `v`) in [0, 1] x [0, 1] of the panoramic image of one eye, with
+    `u` going right and `v` going down. */
+    Vec3D panoramic_direction(double u, double v) const {
+        if (projection == Projection::EQUIRECTANGULAR) {
+            /* The inverse of the mapping in `EnvironmentLight::direction_to_uv()` */
+            auto phi = 2 * std::numbers::pi * (u - 0.5), theta = std::numbers::pi * v;
+            auto sin_theta = std::sin(theta);
+            return Vec3D{sin_theta * std::cos(phi), std::cos(theta), -sin_theta * std::sin(phi)};
+        }
+
+        /* Find the face, and the coordinates (`sc`, `tc`) in [-1, 1] x [-1, 1] on it */
+        auto face_u = 6 * u;
+        auto face = std::min(static_cast<size_t>(face_u), size_t{5});
+        auto sc = 2 * (face_u - static_cast<double>(face)) - 1, tc = 2 * v - 1;
+        switch (face) {
+            case 0: return Vec3D{1, -tc, -sc};
+            case 1: return Vec3D{-1, -tc, sc};
+            case 2: return Vec3D{sc, 1, tc};
+            case 3: return Vec3D{sc, -1, -tc};
+            case 4: return Vec3D{sc, -tc, 1};
+            default: return Vec3D{-sc, -tc, -1};
+        }
+    }
+
+    /* Returns the origin, direction, and time of a random ray through the pixel in the row `row`
+    and the column `col` of a panoramic (`EQUIRECTANGULAR` or `CUBEMAP`) image.
+
+    The eyes of a stereo panorama cannot simply be two panoramas from two points, since the eyes
+    would then line up with (and hide behind) each other when looking to the sides. Instead, this
+    is omni-directional stereo (ODS): the eyes are moved sideways to the ray, as if the head
+    turned to look along every ray. The offset is scaled by how horizontal the ray is, so that the
+    eyes merge towards the poles, where there is no consistent "sideways". */
+    std::tuple<Point3D, Vec3D, double> panoramic_ray_parts(size_t row, size_t col) const {
+        auto u = (static_cast<double>(col) + rand_double()) / static_cast<double>(image_w);
+        auto v = (static_cast<double>(eye_row(row)) + rand_double())
+                 / static_cast<double>(eye_height());
+        auto local_dir = panoramic_direction(u, v);
+        auto ray_dir = local_dir.x * cam_basis_x + local_dir.y * cam_basis_y
+                     + local_dir.z * cam_basis_z;
+
+        auto ray_origin = camera.origin;
+        if (eye_separation > 0) {
+            ray_origin += eye_offset(row) * cross(ray_dir.unit_vector(), cam_basis_y);
+        }
+
+        auto ray_time = (shutter.size() > 0 ? rand_double(shutter.min, shutter.max) : shutter.min);
+        return std::tuple{ray_origin, ray_dir, ray_time};
+    }
+
+    /* Returns the origin, direction, and time of a random ray through the pixel in the row `row`
+    and the column `col`, whose row's first pixel has center `row_start_` (see `row_start()`). For
+    a perspective camera, the ray originates from the defocus disk centered at `camera.origin`,
+    and passes through a random point in the square region centered at the pixel.
+
     Note that the region is square because it is a rectangle with width |`pixel_delta_x`| and
     height |`pixel_delta_y`|, and we have `pixel_delta_x` = `x_vec` / `image_w` =
     `viewport_w` / `image_w`, and `pixel_delta_y` = `y_vec` / `image_h` = `viewport_h` / `image_h`.
@@ -181,14 +386,22 @@ class Camera {
     Then why do we need both `pixel_delta_x` and `pixel_delta_y`? I think it's for clarity, or,
     perhaps, due to possible floating-point errors that cause slight differences in `pixel_delta_x`
     and `pixel_delta_y`. */
-    auto random_ray_through_pixel(size_t row, size_t col) const {
+    std::tuple<Point3D, Vec3D, double> random_ray_parts(size_t row, const Point3D &row_start_,
+                                                        size_t col) const {
+        if (projection != Projection::PERSPECTIVE) {
+            return panoramic_ray_parts(row, col);
+        }
 
-        /* The ray originates from a random point in the camera's defocus disk */
+        /* The ray originates from a random point in the camera's defocus disk (around the eye,
+        for a stereo camera). For a pinhole camera (no defocus blur), no random numbers are drawn
+        for it at all. */
         auto ray_origin = (defocus_angle <= 0 ? camera.origin : random_point_in_defocus_disk());
+        if (eye_separation > 0) {
+            ray_origin += eye_offset(row) * cam_basis_x;
+        }
 
         /* Find the center of the pixel */
-        auto pixel_center = pixel00_loc + static_cast<double>(row) * pixel_delta_y
-                          + static_cast<double>(col) * pixel_delta_x;
+        auto pixel_center = row_start_ + static_cast<double>(col) * pixel_delta_x;
         
         /* Find a random point in the square region centered at `pixel_center`. The region
         has width `pixel_delta_x` and height `pixel_delta_y`, so a random point in this
@@ -196,15 +409,58 @@ class Camera {
         a random real number in the range [-0.5, 0.5]. */
         auto pixel_sample = pixel_center + rand_double(-0.5, 0.5) * pixel_delta_x
                           + rand_double(-0.5, 0.5) * pixel_delta_y;
-        return Ray3D(ray_origin, pixel_sample - ray_origin);
+
+        /* The ray is shot at a random time while the shutter is open. When the shutter does not
+        stay open at all (the default), we skip drawing a random number entirely. */
+        auto ray_time = (shutter.size() > 0 ? rand_double(shutter.min, shutter.max) : shutter.min);
+        return std::tuple{ray_origin, pixel_sample - ray_origin, ray_time};
+    }
+
+    /* Returns the power heuristic weight, for multiple importance sampling, of a sample drawn
+    with probability density `pdf` that could also have been drawn with probability density
+    `other_pdf` (by another sampling technique). See "Optimally Combining Sampling Techniques for
+    Monte Carlo Rendering" (Veach and Guibas, 1995). */
+    static double power_heuristic(double pdf, double other_pdf) {
+        return pdf * pdf / (pdf * pdf + other_pdf * other_pdf);
+    }
+
+    /* Returns the light from the `environment` scattered towards the camera ray at the hit
+    described by `info` (whose material has a `scatter_pdf()`), estimated by sampling one
+    direction from the `environment` and tracing a shadow ray towards it through `world`, at the
+    scene time `time`. It is weighted against the rays scattered by the material in the same
+    direction, which `ray_color()` weights correspondingly. */
+    template<typename T>
+    requires std::is_base_of_v<Hittable, T>
+    RGB environment_light_at(const hit_info &info, double time, const T &world) const {
+        auto light = environment->sample(rand_double(), rand_double());
+        if (light.pdf <= 0) {
+            return RGB::zero();
+        }
+        auto material_pdf = info.material->scatter_pdf(info, light.direction);
+        if (material_pdf <= 0) {
+            return RGB::zero();
+        }
+        /* Solid objects block the light, and participating media let some of it through */
+        auto visibility = world.transmittance(Ray3D(info.hit_point, light.direction, time),
+                                              Interval::with_min(0.00001));
+        if (visibility <= 0) {
+            return RGB::zero();
+        }
+        return (visibility * power_heuristic(light.pdf, material_pdf) * material_pdf / light.pdf)
+             * info.material->albedo(info) * light.radiance;
     }
 
     /* Computes and returns the color of the light ray `ray` shot into the `Hittable`
     specified by `world`. If `ray` has bounced more than `depth_left` times, returns
-    `RGB::zero()`. */
+    `RGB::zero()`. If `aov` is given, it is filled in with what `ray` hits first (see
+    `AOVSample`); this is only requested for camera rays, not for the scattered rays.
+    `scattered_pdf` = The `scatter_pdf()` with which `ray` was scattered by the previous material
+    when the `environment` was also sampled directly there (see `environment_light_at()`), and
+    0 otherwise (including for camera rays). */
     template<typename T>
     requires std::is_base_of_v<Hittable, T>
-    auto ray_color(const Ray3D &ray, size_t depth_left, const T &world) {
+    RGB ray_color(const Ray3D &ray, size_t depth_left, const T &world, AOVSample *aov = nullptr,
+                  double scattered_pdf = 0) {
 
         /* If the ray has bounced the maximum number of times, then no light is collected
         from it. Thus, we return the RGB color (r: 0, g: 0, b: 0). */
@@ -215,6 +471,12 @@ class Camera {
         /* Interval::with_min(0.00001) is the book's fix for shadow acne; ignore
         ray collisions that happen at very small times. */
         if (auto info = world.hit_by(ray, Interval::with_min(0.00001)); info) {
+            if (aov) {
+                *aov = AOVSample{.hit = true, .albedo = info->material->albedo(*info),
+                                 .normal = info->unit_surface_normal,
+                                 .distance = info->hit_time * ray.dir.mag(),
+                                 .material_id = info->material->id};
+            }
 
             /* `emitted_color` = the color of light rays emitted from the current hit
             object's material. If the current object does not emit any light, then
@@ -227,11 +489,23 @@ class Camera {
             (which, again, is the color contributed from the current hit material's light
             emission), and return their sum. */
             if (auto scattered = info->material->scatter(ray, *info); scattered) {
+                /* If the `environment` is sampled directly, add the light it sends straight
+                towards this hit point; the scattered ray then only counts the `environment` in
+                proportion to how much better its sampling is (see `environment_light_at()`). */
+                double pdf = 0;
+                if (environment && sample_environment && depth_left > 1) {
+                    pdf = info->material->scatter_pdf(*info, scattered->ray.dir);
+                    if (pdf > 0) {
+                        emitted_color += environment_light_at(*info, ray.time, world);
+                    }
+                }
+
                 /* Return the sum of the color contributed from the current object's material's
                 light emission, and the color contributed from the scattered ray's bounces off
                 objects in the scene. */
                 return emitted_color
-                     + scattered->attenuation * ray_color(scattered->ray, depth_left - 1, world);
+                     + scattered->attenuation * ray_color(scattered->ray, depth_left - 1, world,
+                                                          nullptr, pdf);
             } else {
                 /* If the material intersected did not produce a new ray from light scattering
                 (if it absorbed the ray, or if the ray was determined to have originated from that
@@ -245,6 +519,18 @@ class Camera {
             we always return `RGB::zero()` when a ray flies into the background). As a result,
             all light in the resulting render comes from an actual light source, and not just
             from the background. */
+            if (environment) {
+                auto radiance = environment->radiance(ray.dir);
+                if (aov) {
+                    *aov = AOVSample{.hit = false, .albedo = radiance};
+                }
+                return (scattered_pdf > 0
+                        ? power_heuristic(scattered_pdf, environment->pdf(ray.dir)) * radiance
+                        : radiance);
+            }
+            if (aov) {
+                *aov = AOVSample{.hit = false, .albedo = background};
+            }
             return background;
             return RGB::zero();
 
@@ -257,42 +543,182 @@ class Camera {
         }
     }
 
+    /* Returns the crop window (by default, the whole image); only the pixels in it are rendered.
+    Exits with an error if it does not fit in the image. */
+    CropWindow checked_window() const {
+        auto window = crop_window.value_or(CropWindow{0, 0, image_w, image_h});
+        if (window.width == 0 || window.height == 0 || window.col + window.width > image_w
+            || window.row + window.height > image_h)
+        {
+            std::cout << "Error: The crop window with top-left pixel (row " << window.row
+                      << ", column " << window.col << ") and dimensions " << window.width << " x "
+                      << window.height << " is empty or does not fit in the " << image_w << " x "
+                      << image_h << " image" << std::endl;
+            std::exit(-1);
+        }
+        return window;
+    }
+
+    /* Adds the colors of the samples with indices in [`first_sample`, `first_sample +
+    num_samples`) of every pixel in the row `row` of the crop window `window` to the same row of
+    `img` (and their AOVs to `aovs`, if given). `init()` must have been called. */
+    template<typename T>
+    requires std::is_base_of_v<Hittable, T>
+    void render_row(const T &world, const CropWindow &window, size_t row, size_t first_sample,
+                    size_t num_samples, Image &img, AOVBuffers *aovs) {
+        auto image_row = window.row + row;
+        /* The center of the first pixel of the row is computed just once for all of its rays */
+        auto start = row_start(image_row);
+
+        for (size_t col = 0; col < window.width; ++col) {
+            auto image_col = window.col + col;
+
+            /* Shoot the random rays of the given samples through the current pixel, summing
+            their colors in the order of the samples. */
+            for (size_t sample = first_sample; sample < first_sample + num_samples; ++sample) {
+                /* With a sample seed, each sample draws from its own random stream */
+                if (sample_seed) {
+                    seed_rand_double(*sample_seed, (image_row * image_w + image_col)
+                                                   * samples_per_pixel + sample);
+                }
+                auto [ray_origin, ray_dir, ray_time] = random_ray_parts(image_row, start,
+                                                                        image_col);
+                Ray3D ray(ray_origin, ray_dir, ray_time, pixel_spread);
+                if (aovs) {
+                    AOVSample aov;
+                    auto sample_color = ray_color(ray, max_depth, world, &aov);
+                    aov.luminance = sample_color.luminance();
+                    img[row][col] += sample_color;
+                    aovs->add_sample(row, col, aov);
+                } else {
+                    img[row][col] += ray_color(ray, max_depth, world);
+                }
+            }
+        }
+    }
+
+    /* Returns the copies of `world` on every NUMA node of this machine (see
+    `BVH::numa_replicas()`), if `world` is a `BVH`, copies are asked for (see
+    `set_thread_placement()`), and there are several nodes. Otherwise, returns `nullptr`, and
+    `world` itself is rendered from every node. */
+    template <typename T>
+    const std::vector<std::unique_ptr<T>>* replicas_of(const T &world) const {
+        if constexpr (std::is_same_v<T, BVH>) {
+            if (replicate_bvh && thread_placement != ThreadPlacement::UNPINNED
+                && NumaTopology::get().num_nodes() > 1) {
+                return &world.numa_replicas();
+            }
+        }
+        return nullptr;
+    }
+
 public:
 
-    /* Renders the `Hittable` specified by `world` to an `Image` and returns that image.
-    Will render in parallel (using OpenMP for now) if available. */
+    /* @brief Renders the `Hittable` specified by `world`, but returns, for each pixel (of the crop
+    window, if any), the SUM of the colors of its samples with indices in [`first_sample`,
+    `first_sample + num_samples`), rather than their average. Will render in parallel (using OpenMP
+    for now) if available.
+
+    Pasting together separately-rendered crop windows, or summing separately-rendered sample
+    ranges, and then dividing by `samples_per_pixel` gives the same image as `render()`. With a
+    sample seed (see `set_sample_seed()`), every sample is a pure function of its pixel and its
+    index, so the crop windows give exactly the same image, and the sample ranges give the same
+    image up to the rounding of the sums (which depends only on how the samples were split). This
+    is how renders are split across multiple processes.
+
+    If `aovs` is given, it is resized to the crop window, and the AOVs of the samples are added to
+    it (but not averaged; see `AOVBuffers::average()`). */
     template<typename T>  /* Guarantee static dispatch when possible using C++20 concepts */
     requires std::is_base_of_v<Hittable, T>
-    auto render(const T &world) {
+    auto render_sample_sums(const T &world, size_t first_sample, size_t num_samples,
+                            AOVBuffers *aovs = nullptr) {
         init();
+        auto window = checked_window();
 
-        /* Calculate and store the color of each pixel */
-        auto img = Image::with_dimensions(image_w, image_h);
+        /* Calculate and store the color of each pixel. When the threads are pinned, each row of
+        the image is allocated by the thread that renders it, and so lives on that thread's node */
+        auto pinned = (thread_placement != ThreadPlacement::UNPINNED);
+        auto img = (pinned ? Image::with_unallocated_rows(window.width, window.height)
+                           : Image::with_dimensions(window.width, window.height));
+        if (aovs) {
+            aovs->reset(window.width, window.height);
+        }
         ProgressBar pb(
-            image_h,
-            "Rendering " + std::to_string(image_w) + " x " + std::to_string(image_h) + " image"
+            window.height,
+            "Rendering " + std::to_string(window.width) + " x " + std::to_string(window.height)
+            + (crop_window ? " region of " + std::to_string(image_w) + " x "
+                             + std::to_string(image_h) + " image" : " image")
         );
 
         /* Now use dynamic thread scheduling instead of static thread scheduling, with a block size
-        of the maximum of `image_h` / 1024 and 1. */
-        const size_t thread_chunk_size = std::max(image_h >> 10, size_t{1});
-        #pragma omp parallel for schedule(dynamic, thread_chunk_size)
-        for (size_t row = 0; row < image_h; ++row) {
-            for (size_t col = 0; col < image_w; ++col) {
-                
-                /* Shoot `samples_per_pixel` random rays through the current pixel.
-                The average of the resulting colors will be the color for this pixel. */
-                auto pixel_color = RGB::zero();
-                for (size_t sample = 0; sample < samples_per_pixel; ++sample) {
-                    auto ray = random_ray_through_pixel(row, col);
-                    pixel_color += ray_color(ray, max_depth, world);
+        of the maximum of `window.height` / 1024 and 1. */
+        const size_t thread_chunk_size = std::max(window.height >> 10, size_t{1});
+        const auto threads = num_threads.value_or(NumaTopology::max_threads());
+        const auto &topology = NumaTopology::get();
+        const auto *replicas = replicas_of(world);
+        /* Each thread pins itself before rendering its first row; `thread_nodes[i]` = The NUMA
+        node that the `i`th thread has been pinned to, if it has been, and `thread_cpus[i]` = The
+        CPUs it could run on before that, which it goes back to at the end, so that no thread
+        (the calling thread, or a worker thread that OpenMP keeps for later parallel regions)
+        stays pinned after the render */
+        std::vector<std::optional<size_t>> thread_nodes(threads);
+        std::vector<std::vector<int>> thread_cpus(threads);
+        #pragma omp parallel num_threads(threads)
+        {
+            #pragma omp for schedule(dynamic, thread_chunk_size)
+            for (size_t row = 0; row < window.height; ++row) {
+                const T *local_world = &world;
+                if (pinned) {
+                    auto thread = NumaTopology::thread_num();
+                    if (!thread_nodes[thread]) {
+                        auto [cpu, node] = topology.cpu_of_thread(thread, thread_placement);
+                        thread_cpus[thread] = NumaTopology::current_thread_cpus();
+                        NumaTopology::pin_current_thread({cpu});
+                        thread_nodes[thread] = node;
+                    }
+                    if (replicas) {
+                        local_world = (*replicas)[*thread_nodes[thread]].get();
+                    }
+                    img.allocate_row(row);
                 }
-                pixel_color /= static_cast<double>(samples_per_pixel);
+                render_row(*local_world, window, row, first_sample, num_samples, img, aovs);
+                pb.complete_iteration();
+            }
+            if (auto thread = NumaTopology::thread_num(); thread_nodes[thread]) {
+                NumaTopology::pin_current_thread(thread_cpus[thread]);
+            }
+        }
+        return img;
+    }
+
+    /* Renders the `Hittable` specified by `world` to an `Image` and returns that image.
+    Will render in parallel (using OpenMP for now) if available. */
+    template<typename T>  /* Guarantee static dispatch when possible using C++20 concepts */
+    requires std::is_base_of_v<Hittable, T>
+    auto render(const T &world) {
+        /* The color of each pixel is the average of the colors of its `samples_per_pixel` samples */
+        auto img = render_sample_sums(world, 0, samples_per_pixel);
+        for (size_t row = 0; row < img.height(); ++row) {
+            for (auto &pixel : img[row]) {
+                pixel /= static_cast<double>(samples_per_pixel);
+            }
+        }
+        return img;
+    }
 
-                img[row][col] = pixel_color;
+    /* Renders the `Hittable` specified by `world` to an `Image` and returns that image, like
+    `render(world)`, and in the same pass fills `aovs` with the AOVs (albedo, normal, depth,
+    material id, sample count, and variance) of every pixel of that image (see `AOVBuffers`). */
+    template<typename T>
+    requires std::is_base_of_v<Hittable, T>
+    auto render(const T &world, AOVBuffers &aovs) {
+        auto img = render_sample_sums(world, 0, samples_per_pixel, &aovs);
+        for (size_t row = 0; row < img.height(); ++row) {
+            for (auto &pixel : img[row]) {
+                pixel /= static_cast<double>(samples_per_pixel);
             }
-            pb.complete_iteration();
         }
+        aovs.average();
         return img;
     }
 
@@ -301,6 +727,77 @@ public:
     auto render(const Scene &world) {
         return render(BVH(world));
     }
+    auto render(const Scene &world, AOVBuffers &aovs) {
+        return render(BVH(world), aovs);
+    }
+
+    /* When rendering a `Scene` that is not needed afterwards (such as a temporary, or
+    `std::move(world)`), the `BVH` takes the objects out of it (see `BVH(Scene&&)`), so the
+    `Scene`'s list of objects is not kept alive alongside the `BVH` for the whole render. */
+    auto render(Scene &&world) {
+        return render(BVH(std::move(world)));
+    }
+    auto render(Scene &&world, AOVBuffers &aovs) {
+        return render(BVH(std::move(world)), aovs);
+    }
+
+    /* Renders the `Hittable` specified by `world` through each of the `cameras` (for instance,
+    several viewpoints of the same product), and returns their images, in the same order; each
+    is the image that `camera.render(world)` would return. Rather than rendering the views one
+    after another, the rows of all views are scheduled on the same OpenMP threads at once, so
+    threads that finish the rows of one view go on to those of the others, instead of idling at
+    the end of every view. */
+    template<typename T>
+    requires std::is_base_of_v<Hittable, T>
+    static std::vector<Image> render_views(std::vector<Camera> &cameras, const T &world) {
+        std::vector<CropWindow> windows;
+        std::vector<Image> images;
+        /* `rows[i]` = The view, and the row within that view's crop window, of the `i`th row */
+        std::vector<std::pair<size_t, size_t>> rows;
+        for (size_t view = 0; view < cameras.size(); ++view) {
+            cameras[view].init();
+            windows.push_back(cameras[view].checked_window());
+            images.push_back(Image::with_dimensions(windows[view].width, windows[view].height));
+            for (size_t row = 0; row < windows[view].height; ++row) {
+                rows.emplace_back(view, row);
+            }
+        }
+
+        ProgressBar pb(rows.size(), "Rendering " + std::to_string(cameras.size()) + " views");
+        const size_t thread_chunk_size = std::max(rows.size() >> 10, size_t{1});
+        #pragma omp parallel for schedule(dynamic, thread_chunk_size)
+        for (size_t i = 0; i < rows.size(); ++i) {
+            auto [view, row] = rows[i];
+            auto &camera = cameras[view];
+            camera.render_row(world, windows[view], row, 0, camera.samples_per_pixel,
+                              images[view], nullptr);
+            pb.complete_iteration();
+        }
+
+        for (size_t view = 0; view < cameras.size(); ++view) {
+            for (size_t row = 0; row < images[view].height(); ++row) {
+                for (auto &pixel : images[view][row]) {
+                    pixel /= static_cast<double>(cameras[view].samples_per_pixel);
+                }
+            }
+        }
+        return images;
+    }
+
+    /* When rendering a `Scene` through several `Camera`s, the `BVH` is built just once, and shared
+    by all of them. */
+    static auto render_views(std::vector<Camera> &cameras, const Scene &world) {
+        return render_views(cameras, BVH(world));
+    }
+    static auto render_views(std::vector<Camera> &cameras, Scene &&world) {
+        return render_views(cameras, BVH(std::move(world)));
+    }
+
+    /* Returns the width and height (in pixels) of the full image rendered by this `Camera`. */
+    auto image_width() const {return image_w;}
+    auto image_height() const {return image_h;}
+    /* Returns the number of samples rendered per pixel. */
+    auto get_samples_per_pixel() const {return samples_per_pixel;}
 
     /* Setters. Each returns a mutable reference to this object to create a functional interface */
     
@@ -346,6 +843,45 @@ public:
         defocus_angle = defocus_angle_degrees * std::numbers::pi / 180;  /* convert to radians */
         return *this;
     }
+    /* Gives the camera's aperture `blades` straight blades (so that out-of-focus highlights blur
+    into regular polygons with `blades` sides, like with a real lens), with the first vertex of
+    the polygon at `rotation_degrees` DEGREES counterclockwise from the right. `blades` = 0 makes
+    the aperture circular again; otherwise, it must be at least 3. Only matters with defocus blur
+    (see `set_defocus_angle()`). */
+    auto& set_aperture_blades(size_t blades, double rotation_degrees = 0) {
+        if (blades == 1 || blades == 2) {
+            std::cout << "Error: A camera aperture cannot have " << blades << " blades (use 0 for "
+                      << "a circular aperture, or at least 3)" << std::endl;
+            std::exit(-1);
+        }
+        aperture_blades = blades;
+        aperture_rotation = rotation_degrees * std::numbers::pi / 180;
+        return *this;
+    }
+    /* Sets how the directions around the camera are mapped onto the image (see `Projection`).
+    The panoramic projections see every direction, so they ignore the field of view and the
+    defocus blur; the camera's direction and up direction only turn the panorama. */
+    auto& set_projection(Projection projection_) {projection = projection_; return *this;}
+    /* Makes this a stereo camera, whose eyes are `eye_separation_` apart (about 0.064 for a human
+    at the scale of meters), rendering the left eye's view over the right eye's in the image (so
+    each eye gets half of the image height). An `eye_separation_` of 0 makes it a mono camera
+    again. With the `PERSPECTIVE` projection, the eyes look in parallel; with the panoramic ones,
+    the image is an omni-directional stereo panorama, for VR. */
+    auto& set_stereo(double eye_separation_) {eye_separation = eye_separation_; return *this;}
+    /* Sets the interval of scene times (see `Ray3D::time`) during which the camera's shutter
+    is open to [`open_time`, `close_time`]. Objects that move during this interval are rendered
+    with motion blur. Both times must be in [0, 1], because moving objects only describe their
+    motion over that range; an error is raised otherwise. */
+    auto& set_shutter_interval(double open_time, double close_time) {
+        if (!(0 <= open_time && open_time <= close_time && close_time <= 1)) {
+            std::cout << "Error: In `Camera::set_shutter_interval(" << open_time << ", "
+                      << close_time << ")`, the shutter interval is not a subset of [0, 1]"
+                      << std::endl;
+            std::exit(-1);
+        }
+        shutter = Interval(open_time, close_time);
+        return *this;
+    }
     /* Causes this Camera to render the whole scene in perfect focus, with no defocus blur. */
     auto& turn_blur_off() {defocus_angle = 0; return *this;}
     /* Sets the "camera up" direction to the vector `dir`. The true camera up direction will be
@@ -376,6 +912,45 @@ public:
         return set_image_dimensions(std::max(size_t{1}, width), height);
     }
 
+    /* Restricts rendering to the `width` by `height` rectangle of pixels whose top-left pixel is
+    in row `row` and column `col` of the image; `render()` will then return an image of just that
+    rectangle. The rectangle must fit within the image when rendering. */
+    auto& set_crop_window(size_t col, size_t row, size_t width, size_t height) {
+        crop_window = CropWindow{col, row, width, height};
+        return *this;
+    }
+    /* Removes the crop window, so that the whole image is rendered again. */
+    auto& reset_crop_window() {crop_window.reset(); return *this;}
+
+    /* Renders with `num_threads_` threads, rather than as many as OpenMP uses by default. */
+    auto& set_num_threads(size_t num_threads_) {
+        if (num_threads_ == 0) {
+            std::cout << "Error: A Camera cannot render with 0 threads" << std::endl;
+            std::exit(-1);
+        }
+        num_threads = num_threads_;
+        return *this;
+    }
+
+    /* Pins the render threads to CPUs as `placement` says (see `ThreadPlacement`), for machines
+    with several NUMA nodes, and has every thread allocate the rows of the image that it renders,
+    so that they are placed on its own node. If `replicate_bvh_` is true, a `BVH` being rendered
+    is also copied onto every node, and every thread traverses the copy on its own node; this
+    costs one more copy of the nodes of the `BVH` (and of its list of primitives) per node, kept
+    for as long as the `BVH` (see `BVH::numa_replicas()`), but the primitives themselves stay
+    shared. The threads are only pinned during the render, and then go back to the CPUs they could
+    run on before. `ThreadPlacement::UNPINNED` (the default) turns all of this off. */
+    auto& set_thread_placement(ThreadPlacement placement, bool replicate_bvh_ = false) {
+        thread_placement = placement;
+        replicate_bvh = replicate_bvh_;
+        return *this;
+    }
+
+    /* Makes rendering deterministic, with the random numbers of every sample depending only on
+    `seed` and which sample of which pixel it is (see `sample_seed`). Reseeding costs a little time
+    per sample, so this is off by default. */
+    auto& set_sample_seed(uint64_t seed) {sample_seed = seed; return *this;}
+
     /* Sets the number of rays sampled for each pixel to `samples`. */
     auto& set_samples_per_pixel(size_t samples) {samples_per_pixel = samples; return *this;}
     /* Sets the maximum recursive depth for the camera (the maximum number of bounces for
@@ -404,6 +979,19 @@ public:
         background = background_color;
         return *this;
     }
+    /* Lights the scene with the environment light `environment_`, which replaces the background
+    (or removes it, if `environment_` is `nullptr`). If `importance_sample` is true (the default),
+    then the environment is also sampled directly at every diffuse bounce (at materials with a
+    `Material::scatter_pdf()`), with directions chosen in proportion to their radiance; which makes
+    small, bright parts of the environment (like the sun) far less noisy than if they only lit the
+    scene through the rays that happen to hit them. The two ways of collecting light from the
+    environment are combined by multiple importance sampling, so neither is counted twice. */
+    auto& set_environment(std::shared_ptr<const EnvironmentLight> environment_,
+                          bool importance_sample = true) {
+        environment = std::move(environment_);
+        sample_environment = importance_sample;
+        return *this;
+    }
 
     /* Prints this `Camera` to the `std::ostream` specified by `os`. */
     void print_to(std::ostream &os) {
@@ -427,7 +1015,24 @@ public:
            << "\n\t\tx: " << defocus_disk_x
            << "\n\t\ty: "<< defocus_disk_y << "\n\t}\n"
            << "\tTop-left pixel's center on viewport: " << pixel00_loc << '\n'
+           << "\tShutter interval: " << shutter << '\n'
+           << "\tProjection: " << (projection == Projection::PERSPECTIVE ? "perspective"
+                                  : projection == Projection::EQUIRECTANGULAR ? "equirectangular"
+                                  : "cube map") << '\n'
+           << "\tEye separation (0 means mono): " << eye_separation << '\n'
+           << "\tCrop window (columns x rows): " << (crop_window ? "[" + std::to_string(
+                  crop_window->col) + ", " + std::to_string(crop_window->col + crop_window->width)
+                  + ") x [" + std::to_string(crop_window->row) + ", " + std::to_string(
+                  crop_window->row + crop_window->height) + ")" : "whole image") << '\n'
+           << "\tSample seed (-1 means not given): "
+           << (sample_seed ? std::to_string(*sample_seed) : "-1") << '\n'
            << "\tSamples per pixel: " << samples_per_pixel << '\n'
+           << "\tRender threads (-1 means OpenMP's default): "
+           << (num_threads ? static_cast<long long>(*num_threads) : -1) << '\n'
+           << "\tThread placement: " << (thread_placement == ThreadPlacement::UNPINNED ? "unpinned"
+                                        : thread_placement == ThreadPlacement::COMPACT ? "compact"
+                                        : "spread")
+           << (replicate_bvh ? ", BVH replicated per NUMA node" : "") << '\n'
            << "\tMaximum bounces per ray: " << max_depth << '\n'
            << "\tVertical FOV (-1 means not given): " << vertical_fov.value_or(-1) << " rad, "
            << (vertical_fov ? *vertical_fov * 180 / std::numbers::pi : -1) << " degrees\n"
@@ -0,0 +1,103 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <vector>
+#include <utility>
+#include <numbers>
+#include <algorithm>  /* For `std::min` and `std::clamp` */
+#include "math/vec3d.h"
+
+/* `CameraPath` is a smooth path for a camera to follow over the course of an animation, given by
+a sequence of keyframes, each of which specifies where the camera is and what it looks at. Both
+are interpolated with a uniform Catmull-Rom spline, which passes through every keyframe and has a
+continuous tangent, so the camera neither stops nor changes direction abruptly at keyframes (as it
+would with plain linear interpolation). */
+class CameraPath {
+    /* `Keyframe` = Where the camera is (`center`) and the point it looks towards (`lookat`) at one
+    of the keyframes. */
+    struct Keyframe {
+        Point3D center, lookat;
+    };
+
+    /* `keyframes` = The keyframes of this path, which are spaced evenly over the path's
+    parameter range [0, 1]. */
+    std::vector<Keyframe> keyframes;
+
+    /* Returns the point at parameter `d` (in [0, 1]) on the uniform Catmull-Rom segment from `p1`
+    to `p2`, where `p0` and `p3` are the points before and after them. */
+    static Point3D catmull_rom(const Point3D &p0, const Point3D &p1, const Point3D &p2,
+                               const Point3D &p3, double d) {
+        auto d2 = d * d, d3 = d2 * d;
+        return 0.5 * ((2 * p1) + (p2 - p0) * d + (2 * p0 - 5 * p1 + 4 * p2 - p3) * d2
+                      + (3 * p1 - p0 - 3 * p2 + p3) * d3);
+    }
+
+public:
+
+    /* Returns the number of keyframes of this path. */
+    auto size() const {return keyframes.size();}
+
+    /* Adds a keyframe at the end of this path, where the camera is at `center` and looks towards
+    `lookat`. */
+    auto& add_keyframe(const Point3D &center, const Point3D &lookat) {
+        keyframes.push_back(Keyframe{center, lookat});
+        return *this;
+    }
+
+    /* Returns the camera center and the lookat point (in that order, as a `std::pair`) at the
+    parameter `d` along this path: 0 is the first keyframe, 1 is the last, and the keyframes in
+    between are evenly spaced. `d` is clamped to [0, 1]. Requires at least one keyframe. */
+    auto at(double d) const {
+        if (keyframes.empty()) {
+            std::cout << "Error: `CameraPath::at()` was called on a path with no keyframes"
+                      << std::endl;
+            std::exit(-1);
+        }
+        if (keyframes.size() == 1) {
+            return std::pair{keyframes[0].center, keyframes[0].lookat};
+        }
+
+        /* Find the segment (between keyframes `i` and `i + 1`) that `d` falls in, and how far
+        along that segment it is. The first and last keyframes are repeated to give the end
+        segments their outer control points. */
+        auto num_segments = keyframes.size() - 1;
+        auto position = std::clamp(d, 0., 1.) * static_cast<double>(num_segments);
+        auto i = std::min(static_cast<size_t>(position), num_segments - 1);
+        auto segment_d = position - static_cast<double>(i);
+        const auto &k0 = keyframes[i == 0 ? 0 : i - 1], &k1 = keyframes[i];
+        const auto &k2 = keyframes[i + 1], &k3 = keyframes[std::min(i + 2, num_segments)];
+
+        return std::pair{
+            catmull_rom(k0.center, k1.center, k2.center, k3.center, segment_d),
+            catmull_rom(k0.lookat, k1.lookat, k2.lookat, k3.lookat, segment_d)
+        };
+    }
+
+    /* --- NAMED CONSTRUCTORS --- */
+
+    /* Returns a `CameraPath` along a circular arc around the vertical line through `lookat`, at a
+    horizontal distance of `radius` and a height of `height` above `lookat`, always looking towards
+    `lookat`. The arc starts at the angle `start_degrees` DEGREES (measured counterclockwise from
+    the positive x-axis, looking down from above), sweeps through `sweep_degrees` degrees, and is
+    given by `num_keyframes` (at least 2) evenly spaced keyframes. */
+    static auto orbit(const Point3D &lookat, double radius, double height, double start_degrees,
+                      double sweep_degrees, size_t num_keyframes = 8) {
+        /* The keyframes are spaced `sweep_degrees` / (`num_keyframes` - 1) degrees apart */
+        if (num_keyframes < 2) {
+            std::cout << "Error: `CameraPath::orbit()` needs at least 2 keyframes, but was given "
+                      << num_keyframes << std::endl;
+            std::exit(-1);
+        }
+        CameraPath ret;
+        for (size_t i = 0; i < num_keyframes; ++i) {
+            auto degrees = start_degrees + sweep_degrees * static_cast<double>(i)
+                                         / static_cast<double>(num_keyframes - 1);
+            auto radians = degrees * std::numbers::pi / 180;
+            ret.add_keyframe(lookat + Vec3D{radius * std::cos(radians), height,
+                                            -radius * std::sin(radians)}, lookat);
+        }
+        return ret;
+    }
+};
+
+#endif
@@ -6,9 +6,11 @@
 #include <cmath>
 #include <memory>
 #include <optional>
+#include <vector>
 #include "math/ray3d.h"
 #include "math/interval.h"
 #include "acceleration/aabb.h"
+#include "util/memory_report.h"
 
 /* Forward-declare the class `Material` to avoid circular dependencies of
 "base/material.h" and "base/hittable.h" on each other */
@@ -34,19 +36,35 @@ struct hit_info {
     bool hit_from_outside = false;  /* Named `front_face` in the tutorial */
     /* `material` points to the `Material` of the object which the ray intersected. */
     const Material* material;
+    /* `u` and `v` = The texture coordinates of the hit point on the surface, each usually in
+    [0, 1]; each kind of `Hittable` decides how its surface is mapped to them (see their
+    `hit_by()`). 0 for surfaces without texture coordinates. */
+    double u = 0, v = 0;
+    /* `uv_footprint` = About how large (in units of texture coordinates) the region of the surface
+    seen by the ray is, based on `Ray3D::spread`; textures use it to pick how blurry a version of an
+    image to sample, so that distant textures do not alias. 0 if unknown (see the constructor). */
+    double uv_footprint = 0;
 
     /* --- CONSTRUCTORS ---*/
 
     /* Constructs a `hit_info` given `hit_time_` (the hit time), `hit_point_` (the point at
     which the ray intersects the surface), `outward_unit_surface_normal` (an UNIT VECTOR equalling
     the normal to the surface at the ray's hit point), the ray `ray` itself, and finally, 
-    `material_` (the material of the surface that `ray` hit).
+    `material_` (the material of the surface that `ray` hit). Surfaces with texture coordinates
+    also give the texture coordinates `u_` and `v_` of the hit point, and `uv_scale`, the distance
+    on the surface (around the hit point) that one unit of texture coordinates spans; 0 if unknown.
     
     Again, `outward_unit_surface_normal` is assumed to be an unit vector. */
     hit_info(double hit_time_, const Point3D &hit_point_, const Vec3D &outward_unit_surface_normal,
-             const Ray3D &ray, const std::shared_ptr<Material> &material_)
-        : hit_time{hit_time_}, hit_point{hit_point_}, material{material_.get()}
+             const Ray3D &ray, const std::shared_ptr<Material> &material_, double u_ = 0,
+             double v_ = 0, double uv_scale = 0)
+        : hit_time{hit_time_}, hit_point{hit_point_}, material{material_.get()}, u{u_}, v{v_}
     {
+        /* The ray's footprint at the hit point is about `spread` times the distance travelled */
+        if (uv_scale > 0 && ray.spread > 0) {
+            uv_footprint = hit_time * ray.dir.mag() * ray.spread / uv_scale;
+        }
+
         /* Determine, based on the directions of the ray and the outward surface normal at
         the ray's point of intersection, whether the ray was shot from inside the surface
         or from outside the surface. Set `unit_surface_normal` correspondingly: if the ray
@@ -75,7 +93,7 @@ struct hit_info {
 std::ostream& operator<< (std::ostream &os, const hit_info &info) {
     os << "hit_info {\n\thit_time: " << info.hit_time << "\n\thit_point: " << info.hit_point
        << "\n\tsurface_normal: " << info.unit_surface_normal << "\n\thit_from_outside: "
-       << info.hit_from_outside << "\n}\n";
+       << info.hit_from_outside << "\n\tuv: (" << info.u << ", " << info.v << ")\n}\n";
     return os;
 }
 
@@ -90,6 +108,15 @@ struct Hittable {
     interface). */
     virtual std::optional<hit_info> hit_by(const Ray3D &ray, const Interval &ray_times) const = 0;
 
+    /* Returns (an unbiased estimate of) the fraction of light that gets through this `Hittable`
+    along the ray `ray` in the time range `ray_times`, such as for a shadow ray. Solid `Hittable`s
+    block the light entirely if `ray` hits them at all, but participating media (such as
+    `GridMedium`) may let some of it through, and can estimate how much with far less noise than
+    whether a single ray scatters. */
+    virtual double transmittance(const Ray3D &ray, const Interval &ray_times) const {
+        return hit_by(ray, ray_times) ? 0 : 1;
+    }
+
     /* Returns the AABB (Axis-Aligned Bounding Box) for this `Hittable` object.
     
     Note that any AABB can be returned. Obviously, though, smaller AABB's are better; they reduce
@@ -97,6 +124,22 @@ struct Hittable {
     the BVH. */
     virtual AABB get_aabb() const = 0;
 
+    /* Returns `true` if this `Hittable` moves during scene time [0, 1] (see `Ray3D::time`). */
+    virtual bool is_moving() const {
+        /* Most `Hittable`s are stationary */
+        return false;
+    }
+
+    /* Returns an AABB for this `Hittable` at the scene time `time` in [0, 1]. For moving
+    `Hittable`s, `get_aabb()` must bound the object over all of [0, 1], while this only needs to
+    bound it at time `time`. Moreover, the `AABB` returned for any time in between 0 and 1 must
+    be contained in the one linearly interpolated between the `AABB`s returned for times 0 and 1
+    (see `AABB::lerp()`); this is what allows `BVH`s to store bounds for only those two times. */
+    virtual AABB get_aabb_at_time(double) const {
+        /* Stationary `Hittable`s have the same `AABB` at every time */
+        return get_aabb();
+    }
+
     /* When a BVH (Bounding Volume Hierarchy) is built over a list of `Hittable`s, each `Hittable`
     in the list will be treated as a single indivisible unit. That is, when the BVH reaches a
     `Hittable`, it will not try to split it any further, because it sees the `Hittable` as an
@@ -111,18 +154,62 @@ struct Hittable {
     brute-force whenever a ray-intersection test reaches the complex `Hittable`, which is clearly
     undesirable.
 
-    To fix this problem, we allow `Hittable`s to return a `std::vector<std::shared_ptr<Hittable>>`
-    representing its constituent `Hittable` components. Then, when building a BVH over a `Scene`
-    containing a `Hittable`, the `BVH` will build over the primitive components of all objects
-    in the `Scene`, rather than just being built over the objects themselves. NOTE THAT IF A
-    `Hittable` TYPE IS ALREADY AN INDIVISIBLE PRIMITIVE (such as `Sphere`), THEN IT SHOULD
-    RETURN THE EMPTY `std::vector`; this is the default, and it tells the `BVH` to treat the
-    current `Hittable` as an indivisible unit when it is being built over a `Scene`. */
-    virtual std::vector<std::shared_ptr<Hittable>> get_primitive_components() const {
-
-        /* Again, objects that are already indivisible primitives (that have no primitive
-        components) should return `{}` from this function, which is the default. */
-        return {};
+    To fix this problem, we allow `Hittable`s to report their constituent `Hittable` components.
+    Then, when building a BVH over a `Scene` containing a `Hittable`, the `BVH` will build over the
+    primitive components of all objects in the `Scene`, rather than just being built over the
+    objects themselves.
+
+    This is done visitor-style, through the two functions below, so that the primitives of an
+    arbitrarily-nested compound `Hittable` are written straight into a single preallocated output
+    `std::vector` (the one the `BVH` is built over). Building and concatenating a temporary
+    `std::vector` at every level of nesting instead would copy every `std::shared_ptr` (an atomic
+    reference count increment and decrement) once per level, which is significant on scenes with
+    millions of primitives.
+
+    `num_primitive_components()` returns the number of primitives that this `Hittable` flattens
+    to, so that the output can be allocated exactly once. `append_primitive_components(out)`
+    appends those primitives to `out`, and returns `true`. NOTE THAT IF A `Hittable` TYPE IS ALREADY
+    AN INDIVISIBLE PRIMITIVE (such as `Sphere`), THEN IT SHOULD APPEND NOTHING AND RETURN `false`;
+    this is the default, and it tells the caller (which owns the `std::shared_ptr` to this
+    `Hittable`) to append this `Hittable` itself as an indivisible unit. */
+    virtual size_t num_primitive_components() const {
+        /* Indivisible primitives flatten to exactly one primitive: themselves. */
+        return 1;
+    }
+
+    /* Appends the primitive components of this `Hittable` to `out`, and returns `true`; or, if
+    this `Hittable` is an indivisible primitive, appends nothing and returns `false`. See the
+    comments for `num_primitive_components()` above for a more detailed explanation. */
+    virtual bool append_primitive_components(std::vector<std::shared_ptr<Hittable>> &) const {
+        /* Again, objects that are already indivisible primitives should append nothing and
+        return `false` from this function, which is the default. */
+        return false;
+    }
+
+    /* Returns the list of primitive components of this `Hittable`, or the empty `std::vector` if
+    this `Hittable` is itself an indivisible primitive. Prefer `append_primitive_components()` when
+    collecting the primitives of many `Hittable`s. */
+    std::vector<std::shared_ptr<Hittable>> get_primitive_components() const {
+        std::vector<std::shared_ptr<Hittable>> ret;
+        ret.reserve(num_primitive_components());
+        if (!append_primitive_components(ret)) {
+            ret.clear();
+        }
+        return ret;
+    }
+
+    /* Appends the materials that hits on this `Hittable` can report (see `hit_info::material`) to
+    `out`, in a fixed order: objects that hold other objects append the materials of those objects
+    in order. A material may be appended more than once. `BVH` numbers the materials of its scene
+    with this (see `Material::id`). This default appends nothing. */
+    virtual void append_materials(std::vector<Material*> &) const {}
+
+    /* Counts the memory used by this `Hittable`, and by everything it owns or points to (its
+    material, its components, and so on), in `report` (see `MemoryReport`). Every `Hittable` type
+    overrides this, since only it knows its own size and what it points to; this default counts
+    just the base class. */
+    virtual void report_memory(MemoryReport &report) const {
+        report.add_shared_object(MemoryCategory::PRIMITIVES, this, sizeof(*this));
     }
 
     /* Prints this `Hittable` object to the `std::ostream` specified by `os`. */
@@ -1,10 +1,13 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 
+#include <atomic>
+#include <numbers>
 #include <iostream>
 #include "util/rgb.h"
 #include "math/ray3d.h"
 #include "util/rand_util.h"
+#include "textures/texture.h"
 
 /* `scatter_info` stores information about scattered rays; specifically, it stores the
 origin and direction of the scattered ray, as well as the color attenuation resulting from
@@ -39,10 +42,58 @@ struct Material {
         return RGB::zero();
     }
 
+    /* `scatter_pdf()` returns the probability density (per unit solid angle) with which
+    `scatter()` scatters a ray hitting this `Material` (at the hit described by `info`) in the
+    direction `direction`; or 0 if `scatter()` does not choose from a continuous distribution of
+    directions (for mirror-like reflection and refraction, for instance).
+
+    Materials that return a nonzero density here must also scatter light arriving from any
+    direction towards the camera ray in proportion to this density: their `attenuation` times this
+    density must be their BSDF times the cosine of the angle to the normal (for surfaces), or their
+    phase function (for media), and their attenuation must be their `albedo()`. This is what allows
+    the `Camera` to sample lights directly at such materials, instead of waiting for scattered rays
+    to happen to hit them (see `Camera::set_environment()`). By default, 0. */
+    virtual double scatter_pdf(const hit_info &, const Vec3D &) const {
+        return 0;
+    }
+
+    /* `albedo()` returns the color of this `Material` itself at the hit described by `info`,
+    independent of lighting: the fraction of light of each color it reflects or transmits (or, for
+    emitters, the color of the light it emits). This is what the albedo AOV (see `AOVBuffers`)
+    records, which denoisers use to tell texture detail apart from noise. By default, white. */
+    virtual RGB albedo(const hit_info &) const {
+        return RGB::from_mag(1);
+    }
+
+    /* Counts the memory used by this `Material` (and its textures, if any) in `report` (see
+    `MemoryReport`). Every `Material` type overrides this; this default counts just the base
+    class. */
+    virtual void report_memory(MemoryReport &report) const {
+        report.add_shared_object(MemoryCategory::MATERIALS, this, sizeof(*this));
+    }
+
     /* Prints this `Material` object to the `std::ostream` specified by `os`. */
     virtual void print_to(std::ostream &os) const = 0;
 
+    /* `id` = A number identifying this `Material`, which the material ID AOV (see `AOVBuffers`)
+    records. Every `Material` gets a distinct id when constructed, from a process-wide counter;
+    those ids depend on the order in which threads happen to construct materials (such as in
+    `Scene::add_generated()`), and keep growing in a long-running process. So building a `BVH`
+    renumbers the materials of its scene 0, 1, 2, ... in the order of its objects (see
+    `BVH::number_materials()`), which is the same every run, for any number of threads, and stays
+    small enough to be stored exactly in a float AOV (below 2^24 materials). A material shared by
+    several `BVH`s keeps the id that the last of them to be built gave it. */
+    size_t id = next_id();
+
     virtual ~Material() = default;
+
+private:
+
+    /* Returns the id of the next `Material` to be constructed. */
+    static size_t next_id() {
+        static std::atomic<size_t> count{0};
+        return count.fetch_add(1, std::memory_order_relaxed);
+    }
 };
 
 /* Overload `operator<<` to for `Material` to allow printing it to output streams */
@@ -56,8 +107,17 @@ diffuse reflectors or matte surfaces). The defining property of Lambertian refle
 are that they obey the Lambertian Cosine Law, and so have the same luminance when
 viewed from any angle. */
 class Lambertian : public Material {
-    /* `intrinsic_color` = The color intrinsic to this Lambertian reflector */
+    /* `intrinsic_color` = The color intrinsic to this Lambertian reflector, unless it has a
+    `texture`, which then gives the intrinsic color at every point instead. A plain color is kept
+    separately (rather than as a `ConstantTexture`) so that the vast majority of `Lambertian`s
+    need neither an extra allocation nor a virtual call per scattered ray. */
     RGB intrinsic_color;
+    std::shared_ptr<Texture> texture;
+
+    /* Returns the intrinsic color of this Lambertian reflector at the hit described by `info` */
+    RGB color_at(const hit_info &info) const {
+        return (texture ? texture->value(info) : intrinsic_color);
+    }
 
 public:
 
@@ -81,17 +141,51 @@ public:
 
         /* The scattered ray goes from the original ray's hit point to the randomly-chosen point
         on the unit sphere centered at the unit surface normal's endpoint, and the attenuation
-        is the same as the intrinsic color. */
-        return scatter_info(Ray3D(info.hit_point, scattered_direction), intrinsic_color);
+        is the same as the intrinsic color. The scattered ray exists at the same scene time as
+        `ray`, so that every bounce of a path sees moving objects at the same positions (this
+        holds for the other materials as well). */
+        return scatter_info(Ray3D(info.hit_point, scattered_direction, ray.time), color_at(info));
+    }
+
+    /* `scatter()` picks directions with probability proportional to the cosine of their angle
+    with the surface normal (which faces the incoming ray), over the hemisphere above the
+    surface. */
+    double scatter_pdf(const hit_info &info, const Vec3D &direction) const override {
+        auto cos_theta = dot(info.unit_surface_normal, direction.unit_vector());
+        return (cos_theta > 0 ? cos_theta / std::numbers::pi : 0);
+    }
+
+    /* The albedo of a Lambertian reflector is its intrinsic color. */
+    RGB albedo(const hit_info &info) const override {
+        return color_at(info);
+    }
+
+    /* Counts the memory used by this `Lambertian` material and its texture, if any, in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        if (report.add_shared_object(MemoryCategory::MATERIALS, this, sizeof(*this))) {
+            if (texture) {
+                texture->report_memory(report);
+            }
+        }
     }
 
     /* Prints this `Lambertian` material to the `std::ostream` specified by `os`. */
     void print_to(std::ostream &os) const override {
-        os << "Lambertian {color: " << intrinsic_color.as_string(", ", "()") << "} " << std::flush;
+        if (texture) {
+            os << "Lambertian {texture: " << *texture << "} " << std::flush;
+        } else {
+            os << "Lambertian {color: " << intrinsic_color.as_string(", ", "()") << "} "
+               << std::flush;
+        }
     }
 
     /* Constructs a Lambertian (diffuse) reflector with intrinsic color `intrinsic_color_`. */
     Lambertian(const RGB &intrinsic_color_) : intrinsic_color{intrinsic_color_} {}
+
+    /* Constructs a Lambertian (diffuse) reflector whose intrinsic color at every point is given by
+    the texture `texture_`. */
+    Lambertian(std::shared_ptr<Texture> texture_)
+        : intrinsic_color{RGB::zero()}, texture{std::move(texture_)} {}
 };
 
 /* The `Metal` type encapsulates the notion of a metallic material; a material that displays
@@ -135,7 +229,17 @@ public:
         /* The scattered ray goes from the original ray's hit point to the randomly-chosen point
         on the unit sphere centered at the unit surface normal's endpoint, and the attenuation
         is the same as the intrinsic color. */
-        return scatter_info(Ray3D(info.hit_point, scattered_dir), intrinsic_color);
+        return scatter_info(Ray3D(info.hit_point, scattered_dir, ray.time), intrinsic_color);
+    }
+
+    /* The albedo of a metal is its intrinsic color. */
+    RGB albedo(const hit_info &) const override {
+        return intrinsic_color;
+    }
+
+    /* Counts the memory used by this `Metal` material in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        report.add_shared_object(MemoryCategory::MATERIALS, this, sizeof(*this));
     }
 
     /* Prints this `Metal` material to the `std::ostream` specified by `os`. */
@@ -214,9 +318,14 @@ public:
         because "glass surface[s] absorb nothing". Makes sense, but does this hold for ALL
         dielectric surfaces? Maybe for tinted glass it doesn't, but our current implementation
         of Dielectric doesn't have a field for intrinsic color or tint. */
-        return scatter_info(Ray3D(info.hit_point, *dir), RGB::from_mag(1, 1, 1));
+        return scatter_info(Ray3D(info.hit_point, *dir, ray.time), RGB::from_mag(1, 1, 1));
     }
     
+    /* Counts the memory used by this `Dielectric` material in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        report.add_shared_object(MemoryCategory::MATERIALS, this, sizeof(*this));
+    }
+
     /* Prints this `Dielectric` material to the `std::ostream` specified by `os`. */
     void print_to(std::ostream &os) const override {
         os << "Dielectric {refractive index: " << refr_index << "} " << std::flush;
@@ -262,6 +371,16 @@ public:
         return intensity * intrinsic_color;
     }
 
+    /* The albedo of a diffuse light is the color of the light it emits. */
+    RGB albedo(const hit_info &) const override {
+        return intrinsic_color;
+    }
+
+    /* Counts the memory used by this `DiffuseLight` material in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        report.add_shared_object(MemoryCategory::MATERIALS, this, sizeof(*this));
+    }
+
     /* Prints this `DiffuseLight` material to the `std::ostream` specified by `os`. */
     void print_to(std::ostream &os) const override {
         os << "DiffuseLight {color: " << intrinsic_color.as_string(", ", "()") << ", intensity: "
@@ -274,4 +393,62 @@ public:
         : intrinsic_color{intrinsic_color_}, intensity{intensity_} {}
 };
 
+/* `Isotropic` is the material of participating media (see `ConstantMedium` and `GridMedium`): it
+scatters light in a uniformly random direction, regardless of the direction it came from. */
+class Isotropic : public Material {
+    /* `intrinsic_color` = The fraction of light of each color that survives each scattering (the
+    single-scattering albedo), unless there is a `texture`, which gives it at every point instead
+    (exactly as for `Lambertian`) */
+    RGB intrinsic_color;
+    std::shared_ptr<Texture> texture;
+
+    RGB color_at(const hit_info &info) const {
+        return (texture ? texture->value(info) : intrinsic_color);
+    }
+
+public:
+
+    std::optional<scatter_info> scatter(const Ray3D &ray, const hit_info &info) const override {
+        return scatter_info(Ray3D(info.hit_point, Vec3D::random_unit_vector(), ray.time),
+                            color_at(info));
+    }
+
+    /* `scatter()` picks every direction with the same probability. */
+    double scatter_pdf(const hit_info &, const Vec3D &) const override {
+        return 1 / (4 * std::numbers::pi);
+    }
+
+    /* The albedo of an isotropic medium is its intrinsic color. */
+    RGB albedo(const hit_info &info) const override {
+        return color_at(info);
+    }
+
+    /* Counts the memory used by this `Isotropic` material and its texture, if any, in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        if (report.add_shared_object(MemoryCategory::MATERIALS, this, sizeof(*this))) {
+            if (texture) {
+                texture->report_memory(report);
+            }
+        }
+    }
+
+    /* Prints this `Isotropic` material to the `std::ostream` specified by `os`. */
+    void print_to(std::ostream &os) const override {
+        if (texture) {
+            os << "Isotropic {texture: " << *texture << "} " << std::flush;
+        } else {
+            os << "Isotropic {color: " << intrinsic_color.as_string(", ", "()") << "} "
+               << std::flush;
+        }
+    }
+
+    /* Constructs an isotropic scatterer with intrinsic color `intrinsic_color_`. */
+    Isotropic(const RGB &intrinsic_color_) : intrinsic_color{intrinsic_color_} {}
+
+    /* Constructs an isotropic scatterer whose intrinsic color at every point is given by the
+    texture `texture_`. */
+    Isotropic(std::shared_ptr<Texture> texture_)
+        : intrinsic_color{RGB::zero()}, texture{std::move(texture_)} {}
+};
+
 #endif
\ No newline at end of file
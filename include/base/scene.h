@@ -5,6 +5,11 @@
 #include <iterator>
 #include <memory>
 #include <span>
+#include <utility>  /* For `std::pair` and `std::move` */
+#include <algorithm>  /* For `std::remove`, `std::any_of`, `std::move`, and `std::max` */
+#include "util/rand_util.h"
+#include "util/huge_pages.h"
+#include "util/scene_arena.h"
 #include "base/hittable.h"
 
 /* `Scene` is an abstraction over a list of `Hittable` objects in 3D space.
@@ -12,6 +17,9 @@ As its name suggests, it is designed to be used to represent `Scene`s of objects
 class Scene : public Hittable {
     std::vector<std::shared_ptr<Hittable>> objects;
     AABB aabb;
+    /* `arena` = The pools that `make()` and `emplace()` allocate objects from (see `SceneArena`).
+    Copies of this `Scene` share it. */
+    SceneArena arena;
 
 public:
 
@@ -44,6 +52,93 @@ public:
         objects.push_back(std::move(object));
     }
 
+    /* Makes an object of type `T` (a primitive, a material, or a texture) from `args`, like
+    `std::make_shared<T>(args...)`, but allocates it from the arena of this `Scene`, so that the
+    objects of each type are contiguous in memory, in the order they were made, and are freed
+    all at once (see `SceneArena`). This is safe to call from several threads at once, such as
+    from the `generate` function of `add_generated()`. */
+    template <typename T, typename... Args>
+    std::shared_ptr<T> make(Args&&... args) const {
+        return arena.make<T>(std::forward<Args>(args)...);
+    }
+
+    /* Makes an object of type `T` from `args` in the arena of this `Scene` (see `make()`), adds it
+    to this `Scene`, and returns it. */
+    template <typename T, typename... Args>
+    std::shared_ptr<T> emplace(Args&&... args) {
+        auto object = make<T>(std::forward<Args>(args)...);
+        add(object);
+        return object;
+    }
+
+    /* Returns the total size of the blocks that the arena of this `Scene` has allocated, in
+    bytes. */
+    size_t arena_bytes() const {return arena.reserved_bytes();}
+
+    /* Returns the arena of this `Scene` (copies of which share its pools). */
+    const SceneArena& get_arena() const {return arena;}
+
+    /* Reserves space for at least `capacity` objects in this `Scene`, so that adding that many
+    objects does not cause repeated reallocations of the underlying `std::vector`. */
+    void reserve(size_t capacity) {
+        objects.reserve(capacity);
+        /* A list of millions of objects is read all over while building a `BVH` over them */
+        HugePages::advise(objects.data(), objects.capacity() * sizeof(objects[0]));
+    }
+
+    /* @brief Adds `count` procedurally-generated objects to this `Scene`, generating them in
+    parallel (using OpenMP for now, if available).
+
+    @param `count`: The number of objects to generate. The object with index `i` is generated by
+    the call `generate(i, rng)`, for every `i` in [0, `count`).
+    @param `seed`: The seed for the random numbers used during generation.
+    @param `generate`: A callable taking a `size_t` index and a `CounterRNG&`, and returning a
+    `std::shared_ptr` to the generated object (or `nullptr` if no object should be added for that
+    index). `generate` is called concurrently from multiple threads, so it should only draw random
+    numbers from the `CounterRNG` it is given, and not from `rand_double()` and the like.
+
+    @note Every index `i` is given its own `CounterRNG(seed, i)`, and generated objects are added
+    in increasing order of their indices, so the resulting `Scene` is identical regardless of the
+    number of threads used. */
+    template <typename F>
+    void add_generated(size_t count, uint64_t seed, F &&generate) {
+        auto first_new = objects.size();
+
+        /* Make room for the new objects, then fill their slots in parallel; the filling is the
+        expensive part (most of the time is spent in the allocations and the random number
+        generation inside `generate`). The capacity grows at least geometrically, since reserving
+        exactly `first_new + count` would reallocate on every call, making repeated calls take
+        quadratic time. */
+        if (first_new + count > objects.capacity()) {
+            reserve(std::max(first_new + count, 2 * objects.capacity()));
+        }
+        objects.resize(first_new + count);
+        #pragma omp parallel for schedule(dynamic, 4096)
+        for (size_t i = 0; i < count; ++i) {
+            CounterRNG rng(seed, i);
+            objects[first_new + i] = generate(i, rng);
+        }
+
+        /* Remove the slots for which `generate` chose not to produce an object, preserving the
+        relative order of all other objects. */
+        objects.erase(std::remove(objects.begin() + static_cast<std::ptrdiff_t>(first_new),
+                                  objects.end(), nullptr), objects.end());
+
+        /* Merge the AABBs of the new objects into `aabb`. Each thread merges its share into its
+        own local `AABB` first; the result is exact regardless of the order of the merges. */
+        auto num_added = objects.size() - first_new;
+        #pragma omp parallel
+        {
+            auto thread_aabb = AABB::empty();
+            #pragma omp for schedule(static) nowait
+            for (size_t i = first_new; i < first_new + num_added; ++i) {
+                thread_aabb.merge_with(objects[i]->get_aabb());
+            }
+            #pragma omp critical
+            aabb.merge_with(thread_aabb);
+        }
+    }
+
     /* Adds all objects in the Scene `scene` to this `Scene`. */
     void add(const Scene &scene) {
         /* The reason we don't just add a single `std::shared_ptr` to `Scene` to
@@ -74,36 +169,128 @@ public:
         return result;
     }
 
+    /* Returns the fraction of light that gets through every object of this `Scene` along `ray`
+    (see `Hittable::transmittance()`). */
+    double transmittance(const Ray3D &ray, const Interval &ray_times) const override {
+        double ret = 1;
+        for (const auto &object : objects) {
+            ret *= object->transmittance(ray, ray_times);
+            if (ret <= 0) {break;}
+        }
+        return ret;
+    }
+
     /* Returns the AABB (Axis-Aligned Bounding Box) for this `Scene`. */
     AABB get_aabb() const override {
         return aabb;
     }
     
-    /* Returns the list of primitive components of all `Hittable` objects in this `Scene`,
-    which contributes to more efficient and complete `BVH`s. See the comments for this
-    function in `Hittable` for a more detailed explanation. */
-    std::vector<std::shared_ptr<Hittable>> get_primitive_components() const override {
-
-        /* Simply collect all the primitive components for each object in turn into `ret`,
-        using the `get_primitive_components()` function that all `Hittable`s must have. */
-        std::vector<std::shared_ptr<Hittable>> ret;
+    /* Returns `true` if any object in this `Scene` moves. */
+    bool is_moving() const override {
+        return std::any_of(objects.begin(), objects.end(), [](const auto &obj) {
+            return obj->is_moving();
+        });
+    }
+
+    /* Returns the AABB for this `Scene` at the scene time `time`. */
+    AABB get_aabb_at_time(double time) const override {
+        auto ret = AABB::empty();
         for (const auto &obj : objects) {
-            if (auto obj_components = obj->get_primitive_components(); !obj_components.empty()) {
-                /* If `get_primitive_components()` returns a list of `Hittable` components for
-                `obj`, then add those components into `ret`. */
-                ret.insert(ret.end(), std::make_move_iterator(obj_components.begin()),
-                                      std::make_move_iterator(obj_components.end()));
-            } else {
-                /* If `get_primitive_components()` returns an empty list, that means the current
-                object `obj` is already an indivisible unit; it itself is a primitive, so we will
-                just add itself to `ret`. */
-                ret.push_back(obj);
-            }
+            ret.merge_with(obj->get_aabb_at_time(time));
         }
+        return ret;
+    }
 
+    /* Returns the total number of primitive components of all `Hittable` objects in this `Scene`.
+    See the comments for this function in `Hittable` for a more detailed explanation. */
+    size_t num_primitive_components() const override {
+        size_t ret = 0;
+        for (const auto &obj : objects) {
+            ret += obj->num_primitive_components();
+        }
         return ret;
     }
 
+    /* Appends the primitive components of all `Hittable` objects in this `Scene` to `out`, which
+    contributes to more efficient and complete `BVH`s. See the comments for this function in
+    `Hittable` for a more detailed explanation. */
+    bool append_primitive_components(std::vector<std::shared_ptr<Hittable>> &out) const override {
+        for (const auto &obj : objects) {
+            /* If `obj` is a compound `Hittable`, it appends its own primitive components to `out`.
+            Otherwise, `obj` is already an indivisible unit; it itself is a primitive, so we will
+            just add (a copy of the `std::shared_ptr` to) itself to `out`. */
+            if (!obj->append_primitive_components(out)) {
+                out.push_back(obj);
+            }
+        }
+        return true;
+    }
+
+    /* Moves the primitive components of all `Hittable` objects in this `Scene` out of it (in the
+    same order as `append_primitive_components()` would append them), and leaves this `Scene`
+    empty. This is for building a `BVH` over a `Scene` that is not needed afterwards (see
+    `BVH(Scene&&)`): when every object is an indivisible primitive, which is the usual case for
+    scenes with millions of objects, the list of objects itself is returned, so no second list of
+    millions of `std::shared_ptr`s is ever allocated, and no reference count is touched. */
+    std::vector<std::shared_ptr<Hittable>> take_primitive_components() && {
+        auto ret = std::move(objects);
+        objects = {};
+        aabb = AABB::empty();
+
+        /* `compounds` = The index of every compound object in `ret`, and the index in
+        `components` of its first primitive component */
+        std::vector<std::pair<size_t, size_t>> compounds;
+        std::vector<std::shared_ptr<Hittable>> components;
+        for (size_t i = 0; i < ret.size(); ++i) {
+            auto first_component = components.size();
+            if (ret[i]->append_primitive_components(components)) {
+                compounds.emplace_back(i, first_component);
+            }
+        }
+        if (compounds.empty()) {
+            return ret;
+        }
+
+        /* Otherwise, splice the components of the compound objects in place of those objects */
+        std::vector<std::shared_ptr<Hittable>> spliced;
+        spliced.reserve(ret.size() - compounds.size() + components.size());
+        size_t next_compound = 0;
+        for (size_t i = 0; i < ret.size(); ++i) {
+            if (next_compound == compounds.size() || compounds[next_compound].first != i) {
+                spliced.push_back(std::move(ret[i]));
+                continue;
+            }
+            auto first = compounds[next_compound].second;
+            auto last = (next_compound + 1 < compounds.size() ? compounds[next_compound + 1].second
+                                                              : components.size());
+            std::move(components.begin() + static_cast<std::ptrdiff_t>(first),
+                      components.begin() + static_cast<std::ptrdiff_t>(last),
+                      std::back_inserter(spliced));
+            ++next_compound;
+        }
+        return spliced;
+    }
+
+    /* Appends the materials of the objects of this `Scene` to `out`, in the order of the objects
+    (see `Hittable::append_materials()`). */
+    void append_materials(std::vector<Material*> &out) const override {
+        for (const auto &object : objects) {
+            object->append_materials(out);
+        }
+    }
+
+    /* Counts the memory used by this `Scene` (its list of objects and its arena) and by all of its
+    objects in `report`. The `Scene` itself is usually not owned by a `std::shared_ptr`. */
+    void report_memory(MemoryReport &report) const override {
+        if (!report.first_visit(this)) {return;}
+        report.add(MemoryCategory::OBJECT_LISTS, sizeof(*this));
+        report.add_vector(MemoryCategory::OBJECT_LISTS, objects);
+        arena.report_memory(report);
+        for (const auto &object : objects) {
+            object->report_memory(report);
+        }
+    }
+
     /* Prints every object in this `Scene` to the `std::ostream` specified by `os`. */
     void print_to(std::ostream &os) const override {
         os << "Scene with " << size() << " objects:\n";
@@ -0,0 +1,164 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <future>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>  /* For `std::setw` */
+#include "base/camera.h"
+#include "base/camera_path.h"
+
+/* `Sequence` renders an animation: a sequence of frames of the same scene, with the camera
+following a `CameraPath`, and with moving objects (see `Ray3D::time`) moving over the course of the
+sequence.
+
+Rendering each frame with `Camera::render(const Scene&)` would rebuild the `BVH` for every frame,
+which, for large scenes, can take as long as rendering a frame itself. Instead, `Sequence` builds
+the `BVH` once and reuses it for every frame; when objects move, it only refits the `BVH` to each
+frame's shutter interval (see `BVH::refit()`). Also, each frame is saved to its file in the
+background while the next frame is rendered, so that the (single-threaded) PPM output does not
+leave all other threads idle between frames.
+
+The sequence spans the scene times [0, 1]: with `N` frames, frame `k` spans the scene times
+[k / N, (k + 1) / N], and its shutter is open for the first `shutter_fraction` of that (like the
+shutter angle of a film camera, as a fraction of 360 degrees). The camera is placed at the point on
+its path corresponding to the opening of the frame's shutter. */
+class Sequence {
+    /* `camera` = The settings of the camera (image dimensions, samples per pixel, field of view,
+    and so on) for every frame. Its center and lookat point are overridden with those from `path`
+    for each frame. */
+    Camera camera;
+    /* `path` = The path that the camera follows over the sequence. */
+    CameraPath path;
+    /* `num_frames` = The number of frames in the sequence. 24 by default. */
+    size_t num_frames = 24;
+    /* `shutter_fraction` = The fraction (in [0, 1]) of each frame's scene times during which the
+    shutter is open. 0 (no motion blur) by default. */
+    double shutter_fraction = 0;
+    /* `file_prefix` = Frame `k` is saved to the file `file_prefix` followed by `k` (zero-padded
+    to 4 digits) and ".ppm". */
+    std::string file_prefix = "frame_";
+
+public:
+
+    /* `FrameTiming` = How long each step of rendering one frame took, in milliseconds. */
+    struct FrameTiming {
+        /* `refit_ms` = Time spent refitting the `BVH` to the frame's shutter interval.
+        `render_ms` = Time spent rendering the frame.
+        `save_ms` = Time spent saving the frame to its file (in the background). */
+        long long refit_ms, render_ms, save_ms;
+    };
+
+    /* Renders every frame of this sequence of the `Scene` `world`, building a single `BVH` over
+    it for all frames (which takes the objects out of `world` if it is an rvalue; see
+    `BVH(Scene&&)`). Returns the timing of each frame. */
+    auto render(const Scene &world) {
+        BVH bvh(world);
+        return render(bvh);
+    }
+    auto render(Scene &&world) {
+        BVH bvh(std::move(world));
+        return render(bvh);
+    }
+
+    /* Renders every frame of this sequence using the `BVH` `bvh`, which is refit to each frame's
+    shutter interval (and so is left refit to the last frame's). Returns the timing of each frame,
+    after printing them along with the total time. */
+    std::vector<FrameTiming> render(BVH &bvh) {
+        using Clock = std::chrono::steady_clock;
+        auto start = Clock::now();
+
+        std::vector<FrameTiming> timings(num_frames);
+        /* `pending_save` = The background task saving the previous frame, if any. It returns the
+        time it took. Only one frame is saved at a time, so that at most two frames are ever held
+        in memory. */
+        std::future<long long> pending_save;
+
+        for (size_t frame = 0; frame < num_frames; ++frame) {
+            auto frame_time = static_cast<double>(frame) / static_cast<double>(num_frames);
+            auto shutter_close = std::min(
+                1., frame_time + shutter_fraction / static_cast<double>(num_frames)
+            );
+
+            auto refit_start = Clock::now();
+            bvh.refit(Interval(frame_time, shutter_close));
+            timings[frame].refit_ms = ms_diff(refit_start, Clock::now());
+
+            /* Each frame gets its own copy of `camera`, so that settings `Camera::init()` infers
+            for one frame (like the focus distance) are not kept for the next */
+            auto [center, lookat] = path.at(frame_time);
+            auto frame_camera = camera;
+            frame_camera.set_camera_center(center)
+                        .set_camera_lookat(lookat)
+                        .set_shutter_interval(frame_time, shutter_close);
+
+            auto render_start = Clock::now();
+            auto img = frame_camera.render(bvh);
+            timings[frame].render_ms = ms_diff(render_start, Clock::now());
+
+            /* Wait for the previous frame to finish saving, then save this frame in the
+            background while the next one renders */
+            if (pending_save.valid()) {
+                timings[frame - 1].save_ms = pending_save.get();
+            }
+            std::ostringstream file_name;
+            file_name << file_prefix << std::setw(4) << std::setfill('0') << frame << ".ppm";
+            pending_save = std::async(std::launch::async,
+                [img = std::move(img), file = file_name.str()]() -> long long {
+                    auto save_start = Clock::now();
+                    img.send_as_ppm<true>(file);
+                    return ms_diff(save_start, Clock::now());
+                }
+            );
+        }
+        if (pending_save.valid()) {
+            timings.back().save_ms = pending_save.get();
+        }
+
+        /* Report the timing of every frame. Because saving overlaps with rendering, the total
+        time is less than the sum of all the times. */
+        std::cout << "Sequence of " << num_frames << " frames rendered to \"" << file_prefix
+                  << "*.ppm\" in " << ms_diff(start, Clock::now()) << "ms:\n"
+                  << " Frame | Refit (ms) | Render (ms) | Save (ms, in background)\n";
+        for (size_t frame = 0; frame < num_frames; ++frame) {
+            std::cout << std::setw(6) << frame << " | " << std::setw(10) << timings[frame].refit_ms
+                      << " | " << std::setw(11) << timings[frame].render_ms << " | "
+                      << std::setw(8) << timings[frame].save_ms << '\n';
+        }
+        std::cout << std::endl;
+
+        return timings;
+    }
+
+    /* Setters. Each returns a mutable reference to this object to create a functional interface */
+
+    /* Sets the number of frames in the sequence to `frames` (at least 1). */
+    auto& set_num_frames(size_t frames) {
+        if (frames == 0) {
+            std::cout << "Error: A `Sequence` must have at least one frame" << std::endl;
+            std::exit(-1);
+        }
+        num_frames = frames;
+        return *this;
+    }
+    /* Sets the fraction of each frame's scene times during which the shutter is open to
+    `fraction`, which must be in [0, 1]. */
+    auto& set_shutter_fraction(double fraction) {
+        if (!(0 <= fraction && fraction <= 1)) {
+            std::cout << "Error: In `Sequence::set_shutter_fraction(" << fraction << ")`, the "
+                      << "fraction is not in [0, 1]" << std::endl;
+            std::exit(-1);
+        }
+        shutter_fraction = fraction;
+        return *this;
+    }
+    /* Sets the prefix of the file names that the frames are saved to to `prefix`. */
+    auto& set_file_prefix(const std::string &prefix) {file_prefix = prefix; return *this;}
+
+    /* Constructs a `Sequence` of frames rendered with the settings of `camera_`, with the camera
+    following the path `path_`. */
+    Sequence(const Camera &camera_, CameraPath path_) : camera{camera_}, path{std::move(path_)} {}
+};
+
+#endif
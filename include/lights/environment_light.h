@@ -0,0 +1,151 @@
+#ifndef ENVIRONMENT_LIGHT_H
+#define ENVIRONMENT_LIGHT_H
+
+#include <cmath>
+#include <vector>
+#include <string>
+#include <numbers>
+#include <utility>  /* For `std::pair` */
+#include <iostream>
+#include <algorithm>  /* For `std::clamp` and `std::min` */
+#include "util/rgb.h"
+#include "util/image.h"
+#include "math/vec3d.h"
+#include "math/distribution.h"
+
+/* `EnvironmentLight` is light arriving from infinitely far away in every direction, such as the
+sky, given by an equirectangular (latitude-longitude) high dynamic range image: the columns of the
+image span the longitudes (a full turn about the y-axis, starting at -x), and its rows span the
+latitudes, from straight up (+y; the top row) to straight down (-y; the bottom row). Every pixel
+is a constant radiance over its patch of directions.
+
+Much of the light of a typical environment map comes from a few small, very bright pixels (the
+sun, for instance), which rays scattered in random directions rarely hit; so renders lit only by
+rays that happen to escape the scene are extremely noisy. Instead, `sample()` chooses directions
+with probability proportional to the radiance of the pixel they point at (times the solid angle
+of the pixel), using a 2D piecewise-constant distribution over the image. `Camera` uses it to
+sample the light directly at every diffuse bounce (next event estimation), and combines that with
+the rays that escape by multiple importance sampling (see `Camera::set_environment()`). */
+class EnvironmentLight {
+    Image image;
+    /* `intensity` = The factor that every radiance in `image` is multiplied by */
+    double intensity;
+    /* `rotation` = The angle (in radians) by which the environment is rotated counterclockwise
+    about the y-axis (when seen from +y) */
+    double rotation;
+    Distribution2D distribution;
+
+    /* Returns the distribution of the pixels of `img`, in proportion to their luminance times
+    their solid angle, which is proportional to the sine of their polar angle. */
+    static Distribution2D distribution_of(const Image &img) {
+        auto w = img.width(), h = img.height();
+        std::vector<double> func(w * h);
+        #pragma omp parallel for
+        for (size_t row = 0; row < h; ++row) {
+            auto sin_theta = std::sin(std::numbers::pi * (static_cast<double>(row) + 0.5)
+                                      / static_cast<double>(h));
+            for (size_t col = 0; col < w; ++col) {
+                func[row * w + col] = std::max(0., img[row][col].luminance()) * sin_theta;
+            }
+        }
+        return Distribution2D(func, w, h);
+    }
+
+    /* Returns the image coordinates (`u`, `v`) in [0, 1] x [0, 1] of the direction `unit_dir` (a
+    unit vector): `u` along the rows, and `v` down the columns. */
+    std::pair<double, double> direction_to_uv(const Vec3D &unit_dir) const {
+        auto phi = std::atan2(-unit_dir.z, unit_dir.x) - rotation;
+        auto u = phi / (2 * std::numbers::pi) + 0.5;
+        u -= std::floor(u);
+        auto v = std::acos(std::clamp(unit_dir.y, -1., 1.)) / std::numbers::pi;
+        return {u, v};
+    }
+
+    /* Returns the unit vector in the direction with image coordinates (`u`, `v`). */
+    Vec3D uv_to_direction(double u, double v) const {
+        auto phi = 2 * std::numbers::pi * (u - 0.5) + rotation;
+        auto theta = std::numbers::pi * v;
+        auto sin_theta = std::sin(theta);
+        return Vec3D{sin_theta * std::cos(phi), std::cos(theta), -sin_theta * std::sin(phi)};
+    }
+
+    /* Returns the radiance of the pixel at the image coordinates (`u`, `v`). */
+    RGB radiance_at(double u, double v) const {
+        auto col = std::min(static_cast<size_t>(u * static_cast<double>(image.width())),
+                            image.width() - 1);
+        auto row = std::min(static_cast<size_t>(v * static_cast<double>(image.height())),
+                            image.height() - 1);
+        return intensity * image[row][col];
+    }
+
+public:
+
+    /* `SampleInfo` = A direction `direction` (a unit vector) towards the environment, its radiance
+    `radiance`, and the probability density `pdf` (per unit solid angle) of sampling it */
+    struct SampleInfo {
+        Vec3D direction;
+        RGB radiance;
+        double pdf;
+    };
+
+    /* Returns the radiance arriving from the direction `dir` (which need not be a unit vector). */
+    RGB radiance(const Vec3D &dir) const {
+        auto [u, v] = direction_to_uv(dir.unit_vector());
+        return radiance_at(u, v);
+    }
+
+    /* Returns a direction sampled in proportion to the radiance from it, using the
+    uniformly-random numbers `u0` and `u1` in [0, 1). The `pdf` is 0 for the (measure zero) samples
+    exactly at the poles. */
+    SampleInfo sample(double u0, double u1) const {
+        auto s = distribution.sample(u0, u1);
+        auto sin_theta = std::sin(std::numbers::pi * s.v);
+        auto pdf = (sin_theta > 0
+                    ? s.pdf / (2 * std::numbers::pi * std::numbers::pi * sin_theta)
+                    : 0.);
+        return SampleInfo{uv_to_direction(s.u, s.v), radiance_at(s.u, s.v), pdf};
+    }
+
+    /* Returns the probability density (per unit solid angle) with which `sample()` samples the
+    direction `dir` (which need not be a unit vector). The image coordinates (u, v) map to
+    directions with a Jacobian of 2 pi^2 sin(theta), where theta = pi v is the polar angle. */
+    double pdf(const Vec3D &dir) const {
+        auto [u, v] = direction_to_uv(dir.unit_vector());
+        auto sin_theta = std::sin(std::numbers::pi * v);
+        if (sin_theta <= 0) {return 0;}
+        return distribution.pdf(u, v) / (2 * std::numbers::pi * std::numbers::pi * sin_theta);
+    }
+
+    /* Prints this `EnvironmentLight` to the `std::ostream` specified by `os`. */
+    void print_to(std::ostream &os) const {
+        os << "EnvironmentLight {" << image.width() << " x " << image.height() << " image, "
+           << "intensity: " << intensity << ", rotation: " << rotation * 180 / std::numbers::pi
+           << " degrees} " << std::flush;
+    }
+
+    /* --- CONSTRUCTORS --- */
+
+    /* Constructs the `EnvironmentLight` of the equirectangular image `image_` (whose colors are
+    linear radiances), scaled by `intensity_`, and rotated by `rotation_degrees` degrees
+    counterclockwise about the y-axis. */
+    EnvironmentLight(const Image &image_, double intensity_ = 1, double rotation_degrees = 0)
+        : image{image_}, intensity{intensity_},
+          rotation{rotation_degrees * std::numbers::pi / 180}, distribution{distribution_of(image_)}
+    {}
+
+    /* Creates the `EnvironmentLight` of the equirectangular PFM image in the file with name
+    `file_name`, scaled by `intensity_`, and rotated by `rotation_degrees` degrees
+    counterclockwise about the y-axis. */
+    static auto from_pfm_file(const std::string &file_name, double intensity_ = 1,
+                              double rotation_degrees = 0) {
+        return EnvironmentLight(Image::from_pfm_file(file_name), intensity_, rotation_degrees);
+    }
+};
+
+/* Overload `operator<<` for `EnvironmentLight` to allow printing it to output streams */
+std::ostream& operator<< (std::ostream &os, const EnvironmentLight &light) {
+    light.print_to(os);
+    return os;
+}
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>  /* For `std::clamp`, `std::min`, and `std::max` */
+
+/* `AliasTable` samples an index in [0, `n`) with probability proportional to its (non-negative)
+weight in O(1) time, whatever the weights are, by Walker's alias method: there is one bucket per
+index, each of which holds that index with probability `prob` and another index, its `alias`, with
+probability 1 - `prob`. A sample picks a bucket uniformly, and then one of its two indices. The
+buckets are filled so that every index's total probability (over its own bucket and the buckets
+it is the alias of) is exactly its share of the total weight. (Inverting a CDF with a binary
+search is simpler, but takes O(log n) time per sample, and its memory accesses jump all over the
+table.)
+
+The table is built in parallel, with the sweeping algorithm of "Parallel Weighted Random Sampling"
+(Huebschle-Schneider and Sanders, 2019): the weights are scaled so that their average is 1, and
+split into light (< 1) and heavy (>= 1) indices. A sweep then walks through both in order, filling
+the bucket of each light index with the current heavy index as the alias, until the current heavy
+index has given away enough that it is light too, at which point its own bucket is filled, with the
+next heavy index as the alias. The state of the sweep after any number of buckets can be found
+from prefix sums of the light and heavy weights, by a binary search, so every thread can start
+sweeping from its own share of the buckets at once. */
+class AliasTable {
+    /* `Bucket` = The probability `prob` with which the bucket holds its own index, and the index
+    `alias` it holds otherwise */
+    struct Bucket {
+        double prob;
+        uint32_t alias;
+    };
+
+    /* `CHUNK_SIZE` = About how many buckets each parallel task fills */
+    static constexpr size_t CHUNK_SIZE = 1 << 14;
+
+    std::vector<Bucket> buckets;
+    /* `pmfs[i]` = The probability of sampling the index `i` */
+    std::vector<double> pmfs;
+
+    /* Returns the exclusive prefix sums (`ret[i]` = the sum of `values[indices[k]]` over k < i,
+    with `indices.size() + 1` sums in all) of the values of `indices`, computed in parallel. */
+    static std::vector<double> prefix_sums(const std::vector<double> &values,
+                                           const std::vector<uint32_t> &indices) {
+        auto n = indices.size();
+        auto num_chunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        std::vector<double> ret(n + 1, 0), chunk_sums(num_chunks + 1, 0);
+
+        #pragma omp parallel for
+        for (size_t c = 0; c < num_chunks; ++c) {
+            double sum = 0;
+            for (size_t i = c * CHUNK_SIZE; i < std::min(n, (c + 1) * CHUNK_SIZE); ++i) {
+                sum += values[indices[i]];
+                ret[i + 1] = sum;
+            }
+            chunk_sums[c + 1] = sum;
+        }
+        for (size_t c = 0; c < num_chunks; ++c) {
+            chunk_sums[c + 1] += chunk_sums[c];
+        }
+        #pragma omp parallel for
+        for (size_t c = 1; c < num_chunks; ++c) {
+            for (size_t i = c * CHUNK_SIZE; i < std::min(n, (c + 1) * CHUNK_SIZE); ++i) {
+                ret[i + 1] += chunk_sums[c];
+            }
+        }
+        return ret;
+    }
+
+    /* Returns the indices of `weights` that are light (if `light`) or heavy (otherwise), in
+    increasing order, computed in parallel. */
+    static std::vector<uint32_t> partition(const std::vector<double> &weights, bool light) {
+        auto n = weights.size();
+        auto num_chunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        std::vector<size_t> offsets(num_chunks + 1, 0);
+        #pragma omp parallel for
+        for (size_t c = 0; c < num_chunks; ++c) {
+            for (size_t i = c * CHUNK_SIZE; i < std::min(n, (c + 1) * CHUNK_SIZE); ++i) {
+                offsets[c + 1] += ((weights[i] < 1) == light);
+            }
+        }
+        for (size_t c = 0; c < num_chunks; ++c) {
+            offsets[c + 1] += offsets[c];
+        }
+        std::vector<uint32_t> ret(offsets.back());
+        #pragma omp parallel for
+        for (size_t c = 0; c < num_chunks; ++c) {
+            auto out = offsets[c];
+            for (size_t i = c * CHUNK_SIZE; i < std::min(n, (c + 1) * CHUNK_SIZE); ++i) {
+                if ((weights[i] < 1) == light) {ret[out++] = static_cast<uint32_t>(i);}
+            }
+        }
+        return ret;
+    }
+
+    /* Fills the buckets of the (average 1) `weights`, given their `light` and `heavy` indices and
+    the prefix sums of their weights. */
+    void sweep(const std::vector<double> &weights, const std::vector<uint32_t> &light,
+               const std::vector<uint32_t> &heavy, const std::vector<double> &light_sums,
+               const std::vector<double> &heavy_sums) {
+        auto n = weights.size(), num_light = light.size(), num_heavy = heavy.size();
+
+        /* After the buckets of the first `i` light and `j` heavy indices are filled, the heavy
+        index `j` has `residual(i, j)` of its weight left, since every bucket holds exactly 1 */
+        auto residual = [&](size_t i, size_t j) {
+            return light_sums[i] + heavy_sums[j + 1] - static_cast<double>(i + j);
+        };
+        /* Returns how many light buckets the sweep has filled after filling `k` buckets. The sweep
+        fills the bucket of the light index `i - 1` (rather than that of a heavy index) as its
+        `k`th bucket exactly if the residual before it is more than 1; and that residual decreases
+        with `i`, so the last `i` where it is more than 1 is found by a binary search. */
+        auto split = [&](size_t k) {
+            auto lo = (k + 1 > num_heavy ? k + 1 - num_heavy : 0), hi = std::min(num_light, k);
+            while (lo < hi) {
+                auto mid = (lo + hi + 1) / 2;
+                if (residual(mid - 1, k - mid) > 1) {lo = mid;} else {hi = mid - 1;}
+            }
+            return lo;
+        };
+
+        auto num_chunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        #pragma omp parallel for schedule(dynamic)
+        for (size_t c = 0; c < num_chunks; ++c) {
+            auto k = c * CHUNK_SIZE, k_end = std::min(n, (c + 1) * CHUNK_SIZE);
+            auto i = split(k), j = k - i;
+            for (; k < k_end && j < num_heavy; ++k) {
+                /* The residual is recomputed from the prefix sums (rather than updated), so that
+                every decision is rounded exactly like in `split()`, and the chunks line up */
+                auto w = residual(i, j);
+                if (w > 1 && i < num_light) {
+                    buckets[light[i]] = Bucket{weights[light[i]], heavy[j]};
+                    ++i;
+                } else {
+                    auto next = (j + 1 < num_heavy ? heavy[j + 1] : heavy[j]);
+                    buckets[heavy[j]] = Bucket{std::clamp(w, 0., 1.), next};
+                    ++j;
+                }
+            }
+            /* Only rounding errors leave light indices without a heavy index to fill them */
+            for (; k < k_end && i < num_light; ++k, ++i) {
+                buckets[light[i]] = Bucket{1, light[i]};
+            }
+        }
+    }
+
+public:
+
+    /* `SampleInfo` = The sampled `index`, and `remapped`: the uniformly-random number used to
+    sample it, turned back into a uniformly-random number in [0, 1) independent of the index */
+    struct SampleInfo {
+        size_t index;
+        double remapped;
+    };
+
+    auto size() const {return buckets.size();}
+
+    /* Returns the probability of sampling the index `index`. */
+    double pmf(size_t index) const {
+        return pmfs[index];
+    }
+
+    /* Returns the index sampled by the uniformly-random number `u` in [0, 1). */
+    SampleInfo sample(double u) const {
+        auto scaled = u * static_cast<double>(buckets.size());
+        auto b = std::min(static_cast<size_t>(scaled), buckets.size() - 1);
+        auto fraction = scaled - static_cast<double>(b);
+        const auto &bucket = buckets[b];
+        if (fraction < bucket.prob) {
+            return SampleInfo{b, fraction / bucket.prob};
+        }
+        return SampleInfo{bucket.alias, (fraction - bucket.prob) / (1 - bucket.prob)};
+    }
+
+    /* Constructs the `AliasTable` of the (non-negative) weights `weights`, which must not be
+    empty. If the weights are all 0, then every index is equally likely. */
+    AliasTable(const std::vector<double> &weights) : buckets(weights.size()), pmfs(weights.size()) {
+        auto n = weights.size();
+        if (n == 0 || n > std::numeric_limits<uint32_t>::max()) {
+            std::cout << "Error: An AliasTable cannot have " << n << " weights" << std::endl;
+            std::exit(-1);
+        }
+
+        double total = 0;
+        #pragma omp parallel for reduction(+:total)
+        for (size_t i = 0; i < n; ++i) {
+            total += std::max(0., weights[i]);
+        }
+
+        /* Scale the weights so that their average is 1 */
+        std::vector<double> scaled(n);
+        #pragma omp parallel for
+        for (size_t i = 0; i < n; ++i) {
+            pmfs[i] = (total > 0 ? std::max(0., weights[i]) / total : 1 / static_cast<double>(n));
+            scaled[i] = pmfs[i] * static_cast<double>(n);
+        }
+
+        auto light = partition(scaled, true), heavy = partition(scaled, false);
+        sweep(scaled, light, heavy, prefix_sums(scaled, light), prefix_sums(scaled, heavy));
+    }
+};
+
+#endif
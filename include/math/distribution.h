@@ -0,0 +1,92 @@
+#ifndef DISTRIBUTION_H
+#define DISTRIBUTION_H
+
+#include <vector>
+#include <utility>  /* For `std::move` */
+#include <optional>
+#include <algorithm>  /* For `std::min` and `std::max` */
+#include "math/alias_table.h"
+
+/* `Distribution2D` is a piecewise-constant probability distribution over [0, 1) x [0, 1), given
+by a grid of `nu` x `nv` non-negative values. `v` is sampled first, from the marginal distribution
+(proportional to the sum of each row of values), and then `u` from the conditional distribution of
+the chosen row. Both are sampled from `AliasTable`s (rather than by inverting CDFs with binary
+searches), so that every sample takes constant time, however large the grid is. */
+class Distribution2D {
+    /* `conditionals[row]` = The distribution of the pieces within the row `row`; `marginal` = The
+    distribution of the rows */
+    std::vector<AliasTable> conditionals;
+    AliasTable marginal;
+
+    /* Returns the alias tables of the `nv` rows (of `nu` values each) of `func`, built in
+    parallel. */
+    static std::vector<AliasTable> conditionals_of(const std::vector<double> &func, size_t nu,
+                                                   size_t nv) {
+        std::vector<std::optional<AliasTable>> tables(nv);
+        #pragma omp parallel for
+        for (size_t row = 0; row < nv; ++row) {
+            tables[row].emplace(std::vector<double>(
+                func.begin() + static_cast<std::ptrdiff_t>(row * nu),
+                func.begin() + static_cast<std::ptrdiff_t>((row + 1) * nu)
+            ));
+        }
+        std::vector<AliasTable> ret;
+        ret.reserve(nv);
+        for (auto &table : tables) {ret.push_back(std::move(*table));}
+        return ret;
+    }
+
+    /* Returns the alias table of the sums of the `nv` rows (of `nu` values each) of `func`. */
+    static AliasTable marginal_of(const std::vector<double> &func, size_t nu, size_t nv) {
+        std::vector<double> row_sums(nv, 0);
+        #pragma omp parallel for
+        for (size_t row = 0; row < nv; ++row) {
+            for (size_t col = 0; col < nu; ++col) {
+                row_sums[row] += std::max(0., func[row * nu + col]);
+            }
+        }
+        return AliasTable(row_sums);
+    }
+
+    /* Returns the point in [0, 1) of the sample `s` of an `AliasTable` of `n` pieces. */
+    static double to_point(const AliasTable::SampleInfo &s, size_t n) {
+        return std::min((static_cast<double>(s.index) + s.remapped) / static_cast<double>(n),
+                        1 - 1e-12);
+    }
+
+public:
+
+    /* `SampleInfo` = A sample (`u`, `v`) in [0, 1) x [0, 1), and the probability density `pdf`
+    of sampling it */
+    struct SampleInfo {
+        double u, v, pdf;
+    };
+
+    /* Returns the sample corresponding to the uniformly-random numbers `u0` and `u1` in [0, 1). */
+    SampleInfo sample(double u0, double u1) const {
+        auto v = marginal.sample(u1);
+        const auto &conditional = conditionals[v.index];
+        auto u = conditional.sample(u0);
+        auto pdf = conditional.pmf(u.index) * static_cast<double>(conditional.size())
+                   * marginal.pmf(v.index) * static_cast<double>(marginal.size());
+        return SampleInfo{to_point(u, conditional.size()), to_point(v, marginal.size()), pdf};
+    }
+
+    /* Returns the probability density of sampling the point (`u`, `v`). */
+    double pdf(double u, double v) const {
+        auto nv = marginal.size();
+        auto row = std::min(static_cast<size_t>(v * static_cast<double>(nv)), nv - 1);
+        const auto &conditional = conditionals[row];
+        auto nu = conditional.size();
+        auto col = std::min(static_cast<size_t>(u * static_cast<double>(nu)), nu - 1);
+        return conditional.pmf(col) * static_cast<double>(nu)
+               * marginal.pmf(row) * static_cast<double>(nv);
+    }
+
+    /* Constructs the `Distribution2D` of the `nu` x `nv` values `func` (row by row; each row has
+    `nu` values, and there are `nv` rows, of increasing `v`). */
+    Distribution2D(const std::vector<double> &func, size_t nu, size_t nv)
+        : conditionals{conditionals_of(func, nu, nv)}, marginal{marginal_of(func, nu, nv)} {}
+};
+
+#endif
@@ -5,12 +5,24 @@
 #include "math/vec3d.h"
 
 /* `Ray3D` represents a ray in 3D space; that is, an origin (a 3D point) and
-a direction (a 3D vector). */
+a direction (a 3D vector), along with the time at which the ray was shot. */
 struct Ray3D {
     /* `origin` = a 3D point representing the origin of the ray. (0, 0, 0) by default. */
     Point3D origin{0, 0, 0};
     /* `dir` = a 3D vector representing the direction of the ray. (0, 0, 0) by default. */
     Vec3D dir{0, 0, 0};
+    /* `time` = The scene time at which this ray exists, for rendering moving objects (motion
+    blur). Scene time runs from 0 to 1; moving objects describe their motion over that range,
+    and every ray is shot at some time within the camera's shutter interval, which is always a
+    subset of [0, 1]. Note that this is unrelated to the ray parameter `t` in `operator()`. 0 by
+    default. */
+    double time = 0;
+    /* `spread` = The angle (in radians) by which the beam of light this ray stands for widens per
+    unit of distance travelled: for camera rays, the angle one pixel subtends, so that the width of
+    a pixel's footprint on a surface at distance d is about `spread * d`. Texture lookups use it to
+    choose how blurry a version of a texture to sample (see `hit_info::uv_footprint`). 0 (unknown;
+    sample textures at full detail) by default, and for scattered rays. */
+    double spread = 0;
 
     /* Returns the point located at time `t` on this ray */
     auto operator() (double t) const {return origin + t * dir;}
@@ -18,7 +30,8 @@ struct Ray3D {
 
 /* Overload `operator<<` to allow printing `Ray3D`s to output streams */
 std::ostream& operator<< (std::ostream &os, const Ray3D &ray) {
-    os << "Ray3D {origin: " << ray.origin << ", dir: " << ray.dir << "}";
+    os << "Ray3D {origin: " << ray.origin << ", dir: " << ray.dir << ", time: " << ray.time
+       << ", spread: " << ray.spread << "}";
     return os;
 }
 
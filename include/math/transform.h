@@ -0,0 +1,170 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <array>
+#include <numbers>
+#include "math/vec3d.h"
+#include "math/ray3d.h"
+#include "acceleration/aabb.h"
+
+/* `Transform` represents an affine transformation of 3D space; that is, a linear transformation
+(rotation, scaling, shearing, ...) followed by a translation. The linear part is stored as a 3x3
+matrix, alongside its precomputed inverse, so that both the transformation and its inverse can be
+applied without ever inverting a matrix during rendering. */
+class Transform {
+    /* `linear` = The rows of the 3x3 matrix of the linear part of this `Transform`. */
+    std::array<Vec3D, 3> linear;
+    /* `inverse_linear` = The rows of the inverse of the matrix `linear`. */
+    std::array<Vec3D, 3> inverse_linear;
+    /* `translation` = The translation applied after the linear part. */
+    Vec3D translation;
+
+    /* Returns the product of the 3x3 matrix with rows `rows` and the vector `v`. */
+    static auto multiply(const std::array<Vec3D, 3> &rows, const Vec3D &v) {
+        return Vec3D{dot(rows[0], v), dot(rows[1], v), dot(rows[2], v)};
+    }
+
+    /* Returns the product of the 3x3 matrices with rows `a` and `b` (in that order). */
+    static auto multiply(const std::array<Vec3D, 3> &a, const std::array<Vec3D, 3> &b) {
+        /* Row `i` of `a * b` is the combination of the rows of `b` weighted by row `i` of `a` */
+        std::array<Vec3D, 3> ret;
+        for (size_t i = 0; i < 3; ++i) {
+            ret[i] = a[i].x * b[0] + a[i].y * b[1] + a[i].z * b[2];
+        }
+        return ret;
+    }
+
+    /* Returns the inverse of the 3x3 matrix with rows `rows`. The columns of the inverse are the
+    cross products of pairs of rows, divided by the determinant (this is the adjugate formula). */
+    static auto inverse(const std::array<Vec3D, 3> &rows) {
+        auto c0 = cross(rows[1], rows[2]), c1 = cross(rows[2], rows[0]);
+        auto c2 = cross(rows[0], rows[1]);
+        auto inv_det = 1 / dot(rows[0], c0);
+        return std::array<Vec3D, 3>{
+            Vec3D{c0.x, c1.x, c2.x} * inv_det,
+            Vec3D{c0.y, c1.y, c2.y} * inv_det,
+            Vec3D{c0.z, c1.z, c2.z} * inv_det
+        };
+    }
+
+    Transform(const std::array<Vec3D, 3> &linear_, const Vec3D &translation_)
+        : linear{linear_}, inverse_linear{inverse(linear_)}, translation{translation_} {}
+
+public:
+
+    /* Returns the image of the point `p` under this `Transform`. */
+    auto apply_to_point(const Point3D &p) const {return multiply(linear, p) + translation;}
+    /* Returns the image of the vector `v` under this `Transform`. Vectors are differences of
+    points, so they are unaffected by the translation. */
+    auto apply_to_vector(const Vec3D &v) const {return multiply(linear, v);}
+    /* Returns the image of the normal vector `n` under this `Transform`. Normals transform by the
+    inverse transpose of the linear part, so that they stay perpendicular to transformed surfaces.
+    The result is generally NOT a unit vector, even if `n` is. */
+    auto apply_to_normal(const Vec3D &n) const {
+        return n.x * inverse_linear[0] + n.y * inverse_linear[1] + n.z * inverse_linear[2];
+    }
+
+    /* Returns the preimage of the point `p` under this `Transform`. */
+    auto inverse_apply_to_point(const Point3D &p) const {
+        return multiply(inverse_linear, p - translation);
+    }
+    /* Returns the preimage of the vector `v` under this `Transform`. */
+    auto inverse_apply_to_vector(const Vec3D &v) const {return multiply(inverse_linear, v);}
+    /* Returns the preimage of the ray `ray` under this `Transform`. Because the transformation is
+    affine, the point at time `t` on the returned ray is the preimage of the point at time `t` on
+    `ray`, so hit times computed against the returned ray are valid for `ray` itself. */
+    auto inverse_apply_to_ray(const Ray3D &ray) const {
+        auto ret = ray;  /* Copy, so that all other properties of the ray are preserved */
+        ret.origin = inverse_apply_to_point(ray.origin);
+        ret.dir = inverse_apply_to_vector(ray.dir);
+        return ret;
+    }
+
+    /* Returns an `AABB` bounding the image of the `AABB` `aabb` under this `Transform`. Because
+    the image of a box under an affine transformation is a parallelepiped, which is convex, it
+    suffices to bound the images of the eight corners of `aabb`. */
+    auto apply_to_aabb(const AABB &aabb) const {
+        auto ret = AABB::empty();
+        for (size_t corner = 0; corner < 8; ++corner) {
+            ret.merge_with(apply_to_point(Point3D{
+                aabb[0][corner & 1], aabb[1][(corner >> 1) & 1], aabb[2][(corner >> 2) & 1]
+            }));
+        }
+        return ret;
+    }
+
+    /* Returns the inverse of this `Transform`. */
+    auto inverse() const {
+        auto ret = *this;
+        std::swap(ret.linear, ret.inverse_linear);
+        ret.translation = -multiply(inverse_linear, translation);
+        return ret;
+    }
+
+    /* Returns the `Transform` that applies `rhs` first, and then `lhs`. */
+    friend auto operator* (const Transform &lhs, const Transform &rhs) {
+        return Transform(multiply(lhs.linear, rhs.linear),
+                         multiply(lhs.linear, rhs.translation) + lhs.translation);
+    }
+
+    /* Overload `operator<<` to allow printing `Transform`s to output streams */
+    friend std::ostream& operator<< (std::ostream &os, const Transform &t);
+
+    /* --- NAMED CONSTRUCTORS --- */
+
+    /* Returns the identity `Transform`, which maps every point to itself. */
+    static auto identity() {
+        return Transform({Vec3D{1, 0, 0}, Vec3D{0, 1, 0}, Vec3D{0, 0, 1}}, Vec3D::zero());
+    }
+
+    /* Returns the `Transform` that translates every point by `offset`. */
+    static auto translation_by(const Vec3D &offset) {
+        auto ret = identity();
+        ret.translation = offset;
+        return ret;
+    }
+
+    /* Returns the `Transform` that scales the x-, y-, and z-coordinates of every point by `sx`,
+    `sy`, and `sz` respectively. All of the scale factors must be nonzero. */
+    static auto scaling(double sx, double sy, double sz) {
+        return Transform({Vec3D{sx, 0, 0}, Vec3D{0, sy, 0}, Vec3D{0, 0, sz}}, Vec3D::zero());
+    }
+
+    /* Returns the `Transform` whose linear part and translation are linearly interpolated,
+    component by component, between those of `a` (when `d` is 0) and those of `b` (when `d` is 1).
+    The image of any point under the result is then the corresponding linear interpolation of its
+    images under `a` and `b`. Note that interpolating two rotations this way does not yield a
+    rotation (it also scales a little in between), which is only noticeable for large angles. */
+    static auto lerp(const Transform &a, const Transform &b, double d) {
+        std::array<Vec3D, 3> linear;
+        for (size_t i = 0; i < 3; ++i) {
+            linear[i] = a.linear[i] + d * (b.linear[i] - a.linear[i]);
+        }
+        return Transform(linear, a.translation + d * (b.translation - a.translation));
+    }
+
+    /* Returns the `Transform` that rotates every point by `degrees` DEGREES, not radians, about
+    the line through the origin with direction `axis` (counterclockwise when looking from the tip
+    of `axis` towards the origin, as usual for right-handed coordinates). */
+    static auto rotation(const Vec3D &axis, double degrees) {
+        /* Rodrigues' rotation formula: R = cos(a)I + sin(a)[k]x + (1 - cos(a))kk^T, where `k` is
+        the unit axis and [k]x is the matrix of the cross product with `k`. */
+        auto k = axis.unit_vector();
+        auto radians = degrees * std::numbers::pi / 180;
+        auto c = std::cos(radians), s = std::sin(radians), t = 1 - c;
+        return Transform({
+            Vec3D{c + t * k.x * k.x,       t * k.x * k.y - s * k.z, t * k.x * k.z + s * k.y},
+            Vec3D{t * k.y * k.x + s * k.z, c + t * k.y * k.y,       t * k.y * k.z - s * k.x},
+            Vec3D{t * k.z * k.x - s * k.y, t * k.z * k.y + s * k.x, c + t * k.z * k.z}
+        }, Vec3D::zero());
+    }
+};
+
+/* Overload `operator<<` to allow printing `Transform`s to output streams */
+std::ostream& operator<< (std::ostream &os, const Transform &t) {
+    os << "Transform {linear: [" << t.linear[0] << ", " << t.linear[1] << ", " << t.linear[2]
+       << "], translation: " << t.translation << "} ";
+    return os;
+}
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include <array>
+#include <cmath>
+#include <vector>
+#include <algorithm>  /* For `std::max` and `std::min` */
+#include "util/image.h"
+#include "util/aov_buffers.h"
+
+/* `Denoiser` removes Monte Carlo noise from a rendered image, using the AOVs rendered along with it
+(see `Camera::render(world, aovs)`), so that an image rendered with a few dozen samples per pixel
+looks close to one rendered with many hundreds.
+
+It is an edge-avoiding a-trous wavelet filter ("Edge-Avoiding A-Trous Wavelet Transform for fast
+Global Illumination Filtering", Dammertz et al., 2010), guided by per-pixel variance like SVGF
+("Spatiotemporal Variance-Guided Filtering", Schied et al., 2017):
+- First, the color of every pixel is divided by its albedo, so that only the lighting (which is
+  smooth, but noisy) is filtered, and textures (which are sharp, but not noisy) are not blurred. The
+  albedo is multiplied back in at the end.
+- Then, `iterations` passes of a 5 x 5 B3-spline kernel are applied, where the taps of the i-th
+  pass are 2^i pixels apart; so a few passes (each only costing 25 taps per pixel) blur over a
+  large area.
+- Each tap is weighted down by how different its surface is from the center pixel's: by the angle
+  between their normals, by the difference in their depths, and by the difference in their
+  lighting relative to how noisy the center pixel is (its standard deviation). So edges between
+  surfaces are kept sharp, and pixels are only blurred as much as they are noisy. The variance is
+  filtered along with the color, so each pass trusts the already-smoothed pixels more.
+
+Pixels where no sample hit anything (the background) are left unchanged. Each pass is parallelized
+over the rows of the image, on planar arrays of floats. */
+class Denoiser {
+    /* `iterations` = The number of a-trous passes. 5 by default, for a 125 x 125 pixel footprint */
+    size_t iterations = 5;
+    /* `sigma_luminance`, `sigma_normal`, and `sigma_depth` = How tolerant the filter is of
+    differences in lighting (in standard deviations of the center pixel), of the angle between
+    normals (as the exponent of their cosine; HIGHER is less tolerant), and of differences in depth
+    (relative to the center pixel's depth, per pixel of distance). */
+    double sigma_luminance = 4, sigma_normal = 128, sigma_depth = 0.02;
+
+    /* `KERNEL` = The 1D B3-spline kernel; the 2D kernel is its outer product with itself */
+    static constexpr std::array<float, 5> KERNEL{1.f / 16, 1.f / 4, 3.f / 8, 1.f / 4, 1.f / 16};
+
+    /* `Planes` = The planar (one array per channel) buffers that the passes work on */
+    struct Planes {
+        std::array<std::vector<float>, 3> lighting, normal;
+        std::vector<float> depth, variance;
+        std::vector<char> hit;
+    };
+
+    /* Returns the variance of the pixel at (row `row`, column `col`) of `in`, blurred with a 3 x 3
+    Gaussian over the neighboring pixels that hit something. With few samples per pixel, many pixels
+    have a variance of (nearly) 0 only because none of their samples happened to find a light; the
+    blur gives them the variance of their neighborhood, so that they are filtered too. */
+    static float blurred_variance(const Planes &in, size_t w, size_t h, size_t row, size_t col) {
+        constexpr std::array<float, 3> GAUSSIAN{0.25f, 0.5f, 0.25f};
+        float sum = 0, weight_sum = 0;
+        for (size_t r = (row > 0 ? row - 1 : 0); r <= std::min(row + 1, h - 1); ++r) {
+            for (size_t c = (col > 0 ? col - 1 : 0); c <= std::min(col + 1, w - 1); ++c) {
+                if (auto q = r * w + c; in.hit[q]) {
+                    auto weight = GAUSSIAN[r + 1 - row] * GAUSSIAN[c + 1 - col];
+                    sum += weight * in.variance[q];
+                    weight_sum += weight;
+                }
+            }
+        }
+        return sum / weight_sum;
+    }
+
+    /* Applies one a-trous pass, with taps `step` pixels apart, to the lighting and variance of
+    `in`, writing them to `out` (whose other buffers are not used). */
+    void filter_pass(const Planes &in, Planes &out, size_t w, size_t h, size_t step) const {
+        auto lum = [&](size_t i) {
+            return 0.2126f * in.lighting[0][i] + 0.7152f * in.lighting[1][i]
+                 + 0.0722f * in.lighting[2][i];
+        };
+        const auto sigma_n = static_cast<float>(sigma_normal);
+        const auto sigma_l = static_cast<float>(sigma_luminance);
+        const auto sigma_z = static_cast<float>(sigma_depth * static_cast<double>(step));
+
+        #pragma omp parallel for schedule(dynamic, 4)
+        for (size_t row = 0; row < h; ++row) {
+            for (size_t col = 0; col < w; ++col) {
+                auto p = row * w + col;
+                if (!in.hit[p]) {
+                    for (size_t c = 0; c < 3; ++c) {out.lighting[c][p] = in.lighting[c][p];}
+                    out.variance[p] = in.variance[p];
+                    continue;
+                }
+
+                auto lum_p = lum(p);
+                auto inv_sigma_l = 1 / (sigma_l * std::sqrt(blurred_variance(in, w, h, row, col))
+                                        + 1e-4f);
+                auto inv_sigma_z = 1 / (sigma_z * in.depth[p] + 1e-6f);
+                std::array<float, 3> sum{0, 0, 0};
+                float weight_sum = 0, variance_sum = 0;
+
+                for (int dy = -2; dy <= 2; ++dy) {
+                    auto r = static_cast<long long>(row) + dy * static_cast<long long>(step);
+                    if (r < 0 || r >= static_cast<long long>(h)) {continue;}
+                    for (int dx = -2; dx <= 2; ++dx) {
+                        auto c = static_cast<long long>(col) + dx * static_cast<long long>(step);
+                        if (c < 0 || c >= static_cast<long long>(w)) {continue;}
+                        auto q = static_cast<size_t>(r) * w + static_cast<size_t>(c);
+                        if (!in.hit[q]) {continue;}
+
+                        auto cos_normals = in.normal[0][p] * in.normal[0][q]
+                                         + in.normal[1][p] * in.normal[1][q]
+                                         + in.normal[2][p] * in.normal[2][q];
+                        auto weight = KERNEL[static_cast<size_t>(dx + 2)]
+                                    * KERNEL[static_cast<size_t>(dy + 2)]
+                                    * std::pow(std::max(0.f, cos_normals), sigma_n)
+                                    * std::exp(-std::abs(in.depth[p] - in.depth[q]) * inv_sigma_z
+                                               - std::abs(lum_p - lum(q)) * inv_sigma_l);
+                        if (q == p) {
+                            /* The center always counts fully, even if its normal is degenerate */
+                            weight = KERNEL[2] * KERNEL[2];
+                        }
+
+                        for (size_t ch = 0; ch < 3; ++ch) {
+                            sum[ch] += weight * in.lighting[ch][q];
+                        }
+                        weight_sum += weight;
+                        variance_sum += weight * weight * in.variance[q];
+                    }
+                }
+
+                for (size_t ch = 0; ch < 3; ++ch) {out.lighting[ch][p] = sum[ch] / weight_sum;}
+                out.variance[p] = variance_sum / (weight_sum * weight_sum);
+            }
+        }
+    }
+
+public:
+
+    /* Returns the denoised version of `noisy`, which must have been rendered together with `aovs`
+    (see `Camera::render(world, aovs)`), so that they have the same dimensions. */
+    Image denoise(const Image &noisy, const AOVBuffers &aovs) const {
+        auto w = noisy.width(), h = noisy.height();
+        if (aovs.width() != w || aovs.height() != h) {
+            std::cout << "Error: In Denoiser::denoise(), the " << w << " x " << h
+                      << " image and the " << aovs.width() << " x " << aovs.height()
+                      << " AOVs do not match; render them together with "
+                      << "Camera::render(world, aovs)" << std::endl;
+            std::exit(-1);
+        }
+
+        /* Divide out the albedo, so that only the lighting is filtered */
+        constexpr double MIN_ALBEDO = 1e-3;
+        Planes planes, scratch;
+        for (auto *pl : {&planes, &scratch}) {
+            for (size_t c = 0; c < 3; ++c) {pl->lighting[c].resize(w * h);}
+            pl->variance.resize(w * h);
+        }
+        for (size_t c = 0; c < 3; ++c) {planes.normal[c].resize(w * h);}
+        planes.depth.resize(w * h);
+        planes.hit.resize(w * h);
+        for (size_t row = 0; row < h; ++row) {
+            for (size_t col = 0; col < w; ++col) {
+                auto p = row * w + col;
+                auto albedo = aovs.albedo(row, col);
+                auto normal = aovs.normal(row, col);
+                const auto &color = noisy[row][col];
+                std::array<double, 3> a{std::max(albedo.r, MIN_ALBEDO),
+                                        std::max(albedo.g, MIN_ALBEDO),
+                                        std::max(albedo.b, MIN_ALBEDO)};
+                planes.lighting[0][p] = static_cast<float>(color.r / a[0]);
+                planes.lighting[1][p] = static_cast<float>(color.g / a[1]);
+                planes.lighting[2][p] = static_cast<float>(color.b / a[2]);
+                planes.normal[0][p] = static_cast<float>(normal.x);
+                planes.normal[1][p] = static_cast<float>(normal.y);
+                planes.normal[2][p] = static_cast<float>(normal.z);
+                planes.depth[p] = static_cast<float>(aovs.depth(row, col));
+                planes.hit[p] = aovs.depth(row, col) > 0;
+
+                /* The variance of the lighting is that of the color, divided by the squared
+                luminance of the albedo */
+                auto albedo_lum = 0.2126 * a[0] + 0.7152 * a[1] + 0.0722 * a[2];
+                planes.variance[p] = static_cast<float>(aovs.variance(row, col)
+                                                        / (albedo_lum * albedo_lum));
+            }
+        }
+
+        for (size_t i = 0; i < iterations; ++i) {
+            filter_pass(planes, scratch, w, h, size_t{1} << i);
+            std::swap(planes.lighting, scratch.lighting);
+            std::swap(planes.variance, scratch.variance);
+        }
+
+        /* Multiply the albedo back in */
+        auto ret = Image::with_dimensions(w, h);
+        for (size_t row = 0; row < h; ++row) {
+            for (size_t col = 0; col < w; ++col) {
+                auto p = row * w + col;
+                auto albedo = aovs.albedo(row, col);
+                ret[row][col] = RGB::from_mag(
+                    planes.lighting[0][p] * std::max(albedo.r, MIN_ALBEDO),
+                    planes.lighting[1][p] * std::max(albedo.g, MIN_ALBEDO),
+                    planes.lighting[2][p] * std::max(albedo.b, MIN_ALBEDO)
+                );
+            }
+        }
+        return ret;
+    }
+
+    /* Setters. Each returns a mutable reference to this object to create a functional interface */
+
+    /* Sets the number of a-trous passes to `iterations_`. Each pass doubles the radius blurred. */
+    auto& set_iterations(size_t iterations_) {iterations = iterations_; return *this;}
+    /* Sets how many standard deviations of the center pixel's lighting a tap may differ by before
+    it is weighted down (by a factor of e). Higher values blur more. */
+    auto& set_sigma_luminance(double sigma) {sigma_luminance = sigma; return *this;}
+    /* Sets the exponent of the cosine of the angle between normals. Higher values keep edges
+    between differently-oriented surfaces sharper. */
+    auto& set_sigma_normal(double sigma) {sigma_normal = sigma; return *this;}
+    /* Sets the tolerated difference in depth, relative to the center pixel's depth, per pixel of
+    distance. Higher values blur more across depth discontinuities. */
+    auto& set_sigma_depth(double sigma) {sigma_depth = sigma; return *this;}
+};
+
+#endif
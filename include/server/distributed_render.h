@@ -0,0 +1,346 @@
+#ifndef DISTRIBUTED_RENDER_H
+#define DISTRIBUTED_RENDER_H
+
+#include <map>
+#include <thread>
+#include <vector>
+#include <sstream>
+#include <algorithm>  /* For `std::min` and `std::max` */
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include "server/socket_util.h"
+#include "server/scene_registry.h"
+
+/* The protocol between a `DistributedRender` (the coordinator) and each of its workers. Every
+message is one line, except that a "RESULT" line is followed by binary data:
+- Coordinator: "SCENE <name> <width> <height> <samples per pixel> <sample seed>". The worker
+  generates the scene, builds its `BVH`, and replies "READY" (or "ERROR <why>" and exits).
+- Coordinator: "JOB <index> <column> <row> <width> <height> <first sample> <number of samples>".
+  The worker renders the sums of those samples of the pixels in that crop window (see
+  `Camera::render_sample_sums()`), and replies "RESULT <index>", followed by the `width * height`
+  sums (row by row) as three `double`s (red, green, blue) each.
+- The coordinator closes the connection when there are no more jobs; the worker then exits. */
+
+/* Runs a render worker which receives its commands from, and sends its results to, the socket
+`fd` (see the protocol above), rendering scenes from `scenes`. Returns once the coordinator closes
+the connection. Every sample is seeded (see `Camera::set_sample_seed()`), so that the results are
+exactly the same no matter which worker renders which job. */
+void run_render_worker(int fd, const SceneRegistry &scenes) {
+    auto setup = read_line(fd);
+    std::istringstream setup_in(setup.value_or(""));
+    std::string verb, name;
+    size_t width = 0, height = 0, samples_per_pixel = 0;
+    uint64_t sample_seed = 0;
+    if (!(setup_in >> verb >> name >> width >> height >> samples_per_pixel >> sample_seed)
+        || verb != "SCENE" || !scenes.contains(name))
+    {
+        write_all(fd, "ERROR expected \"SCENE <name> <width> <height> <spp> <seed>\" with a known"
+                      " scene, got \"" + setup.value_or("") + "\"\n");
+        return;
+    }
+
+    const auto &scene = scenes.at(name);
+    BVH bvh(scene.make_scene());
+    auto camera = scene.camera;
+    camera.set_image_dimensions(width, height)
+          .set_samples_per_pixel(samples_per_pixel)
+          .set_sample_seed(sample_seed);
+    write_all(fd, "READY\n");
+
+    std::vector<double> sums;
+    while (auto job = read_line(fd)) {
+        std::istringstream job_in(*job);
+        size_t index, col, row, job_width, job_height, first_sample, num_samples;
+        if (!(job_in >> verb >> index >> col >> row >> job_width >> job_height >> first_sample
+                     >> num_samples) || verb != "JOB")
+        {
+            write_all(fd, "ERROR expected a JOB, got \"" + *job + "\"\n");
+            return;
+        }
+
+        auto img = camera.set_crop_window(col, row, job_width, job_height)
+                         .render_sample_sums(bvh, first_sample, num_samples);
+        sums.clear();
+        for (size_t r = 0; r < img.height(); ++r) {
+            for (const auto &pixel : img[r]) {
+                sums.insert(sums.end(), {pixel.r, pixel.g, pixel.b});
+            }
+        }
+        if (!write_all(fd, "RESULT " + std::to_string(index) + "\n")
+            || !write_all(fd, sums.data(), sums.size() * sizeof(double)))
+        {
+            return;
+        }
+    }
+}
+
+/* `DistributedRender` renders an image of a registered scene (see `SceneRegistry`) with several
+worker processes, each of which runs `run_render_worker()`. The image is split into jobs, either
+square tiles (each with all samples of its pixels) or sample ranges (each with some of the samples
+of every pixel); the jobs are handed out to the workers as they become idle, and their sums of
+samples are merged into one accumulation buffer, which is finally divided by the number of samples
+per pixel.
+
+The workers are launched on this machine (as copies of the current executable, started with the
+arguments "--worker <file descriptor>", which `main()` must handle by calling `run_render_worker()`)
+and talk to this process over UNIX domain sockets, so the same protocol could be carried to other
+machines. The threads of this machine are divided evenly among the workers. The standard output of
+each worker is discarded, so that their progress bars do not garble this process's output.
+
+Because every sample is seeded by its pixel and index, and the results of the jobs are merged in
+the order of the jobs (not in the order they finish), the image is deterministic: tiles give
+exactly the image that a single `Camera::render()` with the same sample seed gives, and sample
+ranges give that image up to the rounding of the sums, regardless of the number of workers. */
+class DistributedRender {
+    /* `Job` = The pixels (a crop window) and the range of samples of one job. */
+    struct Job {
+        size_t col, row, width, height, first_sample, num_samples;
+    };
+    /* `Worker` = A running worker process, the socket to it, and the index of the job it is
+    currently rendering, if any. */
+    struct Worker {
+        pid_t pid;
+        int fd;
+        std::optional<size_t> current_job;
+    };
+
+    std::string scene_name;
+    size_t image_w, image_h, samples_per_pixel;
+    uint64_t sample_seed;
+    /* `num_workers` = The number of worker processes. 2 by default. */
+    size_t num_workers = 2;
+    /* If `tile_size` is positive, the image is split into (at most) `tile_size` by `tile_size`
+    tiles; otherwise, the samples of every pixel are split into `num_sample_ranges` ranges. Tiles
+    of 64 by 64 pixels by default. */
+    size_t tile_size = 64, num_sample_ranges = 0;
+
+    /* Returns the jobs that the image is split into. */
+    std::vector<Job> make_jobs() const {
+        std::vector<Job> jobs;
+        if (tile_size > 0) {
+            for (size_t row = 0; row < image_h; row += tile_size) {
+                for (size_t col = 0; col < image_w; col += tile_size) {
+                    jobs.push_back(Job{col, row, std::min(tile_size, image_w - col),
+                                       std::min(tile_size, image_h - row), 0, samples_per_pixel});
+                }
+            }
+        } else {
+            /* Spread the remainder of the division over the first ranges */
+            auto ranges = std::min(num_sample_ranges, samples_per_pixel);
+            size_t first_sample = 0;
+            for (size_t i = 0; i < ranges; ++i) {
+                auto num_samples = samples_per_pixel / ranges + (i < samples_per_pixel % ranges);
+                jobs.push_back(Job{0, 0, image_w, image_h, first_sample, num_samples});
+                first_sample += num_samples;
+            }
+        }
+        return jobs;
+    }
+
+    /* Launches a worker process with `threads` OpenMP threads, and sends it the scene. */
+    Worker launch_worker(size_t threads) const {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+            std::cout << "Error: Could not create a socket pair for a worker ("
+                      << std::strerror(errno) << ")" << std::endl;
+            std::exit(-1);
+        }
+
+        auto pid = fork();
+        if (pid < 0) {
+            std::cout << "Error: Could not fork a worker (" << std::strerror(errno) << ")"
+                      << std::endl;
+            std::exit(-1);
+        }
+        if (pid == 0) {
+            /* In the worker: keep only its own end of the socket pair open across `exec`, and
+            discard its standard output */
+            fcntl(fds[1], F_SETFD, 0);
+            if (auto null_fd = open("/dev/null", O_WRONLY); null_fd >= 0) {
+                dup2(null_fd, STDOUT_FILENO);
+            }
+            auto threads_string = std::to_string(threads), fd_string = std::to_string(fds[1]);
+            setenv("OMP_NUM_THREADS", threads_string.c_str(), 1);
+            execl("/proc/self/exe", "cpp_raytracer", "--worker", fd_string.c_str(),
+                  static_cast<char*>(nullptr));
+            _exit(127);  /* Only reached if `exec` failed */
+        }
+
+        close(fds[1]);
+        Worker worker{pid, fds[0], {}};
+        write_all(worker.fd, "SCENE " + scene_name + " " + std::to_string(image_w) + " "
+                             + std::to_string(image_h) + " " + std::to_string(samples_per_pixel)
+                             + " " + std::to_string(sample_seed) + "\n");
+        return worker;
+    }
+
+    /* Exits with an error if `reply` (from a worker) is not `expected`. */
+    static void check_reply(const std::optional<std::string> &reply, const std::string &expected) {
+        if (!reply || *reply != expected) {
+            std::cout << "Error: Expected \"" << expected << "\" from a render worker, but got "
+                      << (reply ? "\"" + *reply + "\"" : "nothing (it exited)") << std::endl;
+            std::exit(-1);
+        }
+    }
+
+public:
+
+    /* Renders the image, and returns it. */
+    auto render() {
+        auto start = std::chrono::steady_clock::now();
+        auto jobs = make_jobs();
+        auto threads = std::max(size_t{1}, std::thread::hardware_concurrency() / num_workers);
+
+        std::vector<Worker> workers;
+        for (size_t i = 0; i < num_workers; ++i) {
+            workers.push_back(launch_worker(threads));
+        }
+        for (const auto &worker : workers) {
+            check_reply(read_line(worker.fd), "READY");
+        }
+        std::cout << "Distributing " << jobs.size() << " jobs of scene \"" << scene_name << "\" ("
+                  << image_w << " x " << image_h << ", " << samples_per_pixel << " samples per"
+                  << " pixel) among " << num_workers << " workers with " << threads
+                  << " threads each (workers ready after "
+                  << ms_diff(start, std::chrono::steady_clock::now()) << "ms)" << std::endl;
+
+        /* `sums` = The accumulation buffer. Finished jobs wait in `finished` until every job
+        before them has been merged, so that the sums are always added in the same order. */
+        auto sums = Image::with_dimensions(image_w, image_h);
+        std::map<size_t, Image> finished;
+        size_t next_job_to_send = 0, next_job_to_merge = 0;
+        std::vector<double> buffer;
+        ProgressBar pb(jobs.size(), "Rendering " + std::to_string(jobs.size()) + " jobs");
+
+        while (next_job_to_merge < jobs.size()) {
+            /* Give every idle worker the next job */
+            for (auto &worker : workers) {
+                if (!worker.current_job && next_job_to_send < jobs.size()) {
+                    const auto &job = jobs[next_job_to_send];
+                    write_all(worker.fd, "JOB " + std::to_string(next_job_to_send) + " "
+                        + std::to_string(job.col) + " " + std::to_string(job.row) + " "
+                        + std::to_string(job.width) + " " + std::to_string(job.height) + " "
+                        + std::to_string(job.first_sample) + " "
+                        + std::to_string(job.num_samples) + "\n");
+                    worker.current_job = next_job_to_send++;
+                }
+            }
+
+            /* Wait for any busy worker to finish its job */
+            std::vector<pollfd> poll_fds;
+            for (const auto &worker : workers) {
+                poll_fds.push_back(pollfd{worker.fd, static_cast<short>(
+                    worker.current_job ? POLLIN : 0
+                ), 0});
+            }
+            if (poll(poll_fds.data(), poll_fds.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cout << "Error: `poll()` failed (" << std::strerror(errno) << ")"
+                          << std::endl;
+                std::exit(-1);
+            }
+
+            for (size_t i = 0; i < workers.size(); ++i) {
+                if (!(poll_fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                    continue;
+                }
+                auto &worker = workers[i];
+                /* An idle worker is only polled for hangups (which `poll()` always reports), so it
+                has exited without a job; drop it, and give its share of the jobs to the rest */
+                if (!worker.current_job) {
+                    std::cout << "Warning: Render worker (pid " << worker.pid << ") exited while"
+                              << " idle; continuing with the remaining workers" << std::endl;
+                    close(worker.fd);
+                    waitpid(worker.pid, nullptr, 0);
+                    worker.fd = -1;
+                    continue;
+                }
+                auto index = *worker.current_job;
+                const auto &job = jobs[index];
+                check_reply(read_line(worker.fd), "RESULT " + std::to_string(index));
+
+                buffer.resize(job.width * job.height * 3);
+                if (!read_exact(worker.fd, buffer.data(), buffer.size() * sizeof(double))) {
+                    std::cout << "Error: A render worker exited while sending its result"
+                              << std::endl;
+                    std::exit(-1);
+                }
+                auto img = Image::with_dimensions(job.width, job.height);
+                for (size_t r = 0, k = 0; r < job.height; ++r) {
+                    for (auto &pixel : img[r]) {
+                        pixel = RGB::from_mag(buffer[k], buffer[k + 1], buffer[k + 2]);
+                        k += 3;
+                    }
+                }
+                finished.emplace(index, std::move(img));
+                worker.current_job.reset();
+                pb.complete_iteration();
+            }
+            std::erase_if(workers, [](const Worker &worker) {return worker.fd < 0;});
+            if (workers.empty()) {
+                std::cout << "Error: Every render worker exited before the render finished"
+                          << std::endl;
+                std::exit(-1);
+            }
+
+            /* Merge every finished job that is next in order */
+            for (auto it = finished.find(next_job_to_merge); it != finished.end();
+                 it = finished.find(next_job_to_merge))
+            {
+                const auto &job = jobs[next_job_to_merge];
+                sums.add_region(it->second, job.col, job.row);
+                finished.erase(it);
+                ++next_job_to_merge;
+            }
+        }
+
+        /* No jobs are left, so let the workers exit */
+        for (const auto &worker : workers) {
+            close(worker.fd);
+            waitpid(worker.pid, nullptr, 0);
+        }
+
+        for (size_t row = 0; row < image_h; ++row) {
+            for (auto &pixel : sums[row]) {
+                pixel /= static_cast<double>(samples_per_pixel);
+            }
+        }
+        std::cout << "Distributed render finished in "
+                  << ms_diff(start, std::chrono::steady_clock::now()) << "ms" << std::endl;
+        return sums;
+    }
+
+    /* Setters. Each returns a mutable reference to this object to create a functional interface */
+
+    /* Sets the number of worker processes to `workers` (at least 1). */
+    auto& set_num_workers(size_t workers) {
+        num_workers = std::max(size_t{1}, workers);
+        return *this;
+    }
+    /* Splits the image into (at most) `size` by `size` tiles (`size` must be positive), each
+    rendered with all samples of its pixels. This is the default, with tiles of 64 by 64 pixels. */
+    auto& split_into_tiles(size_t size) {
+        tile_size = std::max(size_t{1}, size);
+        return *this;
+    }
+    /* Splits the samples of every pixel into `ranges` ranges of (almost) equal size, each rendered
+    over the whole image. This balances the work between the jobs better than tiles (which may
+    cost very different amounts of time), but each job's result is a whole image. */
+    auto& split_into_sample_ranges(size_t ranges) {
+        tile_size = 0;
+        num_sample_ranges = std::max(size_t{1}, ranges);
+        return *this;
+    }
+
+    /* Constructs a `DistributedRender` of the scene registered as `scene_name_`, as a `width_` by
+    `height_` image with `samples_per_pixel_` samples per pixel, seeded with `sample_seed_`. */
+    DistributedRender(const std::string &scene_name_, size_t width_, size_t height_,
+                      size_t samples_per_pixel_, uint64_t sample_seed_)
+        : scene_name{scene_name_}, image_w{width_}, image_h{height_},
+          samples_per_pixel{samples_per_pixel_}, sample_seed{sample_seed_} {}
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef RENDER_CLIENT_H
+#define RENDER_CLIENT_H
+
+#include <iostream>
+#include "server/socket_util.h"
+
+/* Sends the single-line command `command` (see `RenderServer` for the commands) to the
+`RenderServer` listening on the UNIX domain socket `socket_path`, waits for its reply, and returns
+it. A `RENDER` command only gets its reply once the render has finished. Returns an empty
+`std::optional` (after printing why) if the server could not be reached or did not reply. */
+std::optional<std::string> send_render_command(const std::string &socket_path,
+                                               const std::string &command) {
+    sockaddr_un address;
+    if (!make_socket_address(socket_path, address)) {
+        std::cout << "Error: The socket path \"" << socket_path << "\" is too long" << std::endl;
+        return {};
+    }
+
+    auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::cout << "Error: Could not create a socket (" << std::strerror(errno) << ")"
+                  << std::endl;
+        return {};
+    }
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        std::cout << "Error: Could not connect to a render server at \"" << socket_path << "\" ("
+                  << std::strerror(errno) << ")" << std::endl;
+        close(fd);
+        return {};
+    }
+
+    std::optional<std::string> reply;
+    if (write_all(fd, command + '\n')) {
+        reply = read_line(fd);
+    }
+    close(fd);
+    if (!reply) {
+        std::cout << "Error: The render server at \"" << socket_path << "\" did not reply"
+                  << std::endl;
+    }
+    return reply;
+}
+
+#endif
@@ -0,0 +1,453 @@
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+#include <map>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <sstream>
+#include <fstream>
+#include <functional>
+#include <condition_variable>
+#include <sys/time.h>  /* For `timeval` */
+#include "base/camera.h"
+#include "server/socket_util.h"
+#include "server/scene_registry.h"
+
+/* `RenderRequest` is a request to render an image of one of the scenes of a `RenderServer`. Every
+setting that is not given is taken from the default `Camera` the scene was registered with. */
+struct RenderRequest {
+    /* `scene` = The name of the scene to render. `output_file` = Where to save the image (PPM). */
+    std::string scene, output_file;
+    /* `priority` = Requests with higher priorities are rendered first; requests with equal
+    priorities are rendered in the order they were received. 0 by default. */
+    int priority = 0;
+    std::optional<size_t> width, height, samples_per_pixel, max_depth;
+    std::optional<Point3D> center, lookat;
+    /* `vertical_fov` is in DEGREES */
+    std::optional<double> vertical_fov;
+    /* `region` = The column and row of the top-left pixel, the width, and the height of the crop
+    window to render (see `Camera::set_crop_window()`), if any. */
+    std::optional<std::array<size_t, 4>> region;
+
+    /* Parses the `key=value` pairs (separated by whitespace) in `args` into a `RenderRequest`.
+    Points and regions are given as comma-separated numbers; for example,
+    "scene=cornell_box out=a.ppm priority=2 width=400 height=400 spp=16 center=278,278,-800
+    lookat=278,278,0 fov=40 region=100,100,200,200". Returns the `RenderRequest` if successful;
+    otherwise, sets `error` to a description of the problem and returns an empty `std::optional`. */
+    static std::optional<RenderRequest> parse(const std::string &args, std::string &error) {
+        RenderRequest ret;
+        std::istringstream in(args);
+        std::string token;
+        while (in >> token) {
+            auto equals = token.find('=');
+            if (equals == std::string::npos) {
+                error = "expected key=value, got \"" + token + "\"";
+                return {};
+            }
+            auto key = token.substr(0, equals), value = token.substr(equals + 1);
+            auto numbers = parse_numbers(value);
+
+            /* Each key expects a given number of numbers, except for the string-valued keys */
+            auto expect = [&](size_t count) {
+                if (numbers.size() != count) {
+                    error = "\"" + key + "\" expects " + std::to_string(count)
+                          + " comma-separated number(s), got \"" + value + "\"";
+                    return false;
+                }
+                return true;
+            };
+            /* Integers are checked (see `is_integer_in()`) before they are converted */
+            auto expect_integers = [&](size_t count, double min = 0, double max = MAX_INTEGER) {
+                if (!expect(count)) {
+                    return false;
+                }
+                for (auto number : numbers) {
+                    if (!is_integer_in(number, min, max)) {
+                        error = "\"" + key + "\" expects integers in [" + std::to_string(
+                                static_cast<long long>(min)) + ", " + std::to_string(
+                                static_cast<long long>(max)) + "], got \"" + value + "\"";
+                        return false;
+                    }
+                }
+                return true;
+            };
+            auto expect_finite = [&](size_t count) {
+                if (!expect(count)) {
+                    return false;
+                }
+                for (auto number : numbers) {
+                    if (!std::isfinite(number)) {
+                        error = "\"" + key + "\" expects finite numbers, got \"" + value + "\"";
+                        return false;
+                    }
+                }
+                return true;
+            };
+            auto as_size = [&](size_t index) {return static_cast<size_t>(numbers[index]);};
+
+            if (key == "scene") {
+                ret.scene = value;
+            } else if (key == "out") {
+                ret.output_file = value;
+            } else if (key == "priority") {
+                if (!expect_integers(1, std::numeric_limits<int>::min(),
+                                     std::numeric_limits<int>::max())) {return {};}
+                ret.priority = static_cast<int>(numbers[0]);
+            } else if (key == "width") {
+                if (!expect_integers(1, 1, MAX_IMAGE_SIDE)) {return {};}
+                ret.width = as_size(0);
+            } else if (key == "height") {
+                if (!expect_integers(1, 1, MAX_IMAGE_SIDE)) {return {};}
+                ret.height = as_size(0);
+            } else if (key == "spp") {
+                if (!expect_integers(1, 1)) {return {};}
+                ret.samples_per_pixel = as_size(0);
+            } else if (key == "depth") {
+                if (!expect_integers(1)) {return {};}
+                ret.max_depth = as_size(0);
+            } else if (key == "center") {
+                if (!expect_finite(3)) {return {};}
+                ret.center = Point3D{numbers[0], numbers[1], numbers[2]};
+            } else if (key == "lookat") {
+                if (!expect_finite(3)) {return {};}
+                ret.lookat = Point3D{numbers[0], numbers[1], numbers[2]};
+            } else if (key == "fov") {
+                if (!expect(1)) {return {};}
+                if (!(numbers[0] > 0 && numbers[0] < 180)) {
+                    error = "\"fov\" expects a number of degrees in (0, 180), got \"" + value
+                          + "\"";
+                    return {};
+                }
+                ret.vertical_fov = numbers[0];
+            } else if (key == "region") {
+                if (!expect_integers(4, 0, MAX_IMAGE_SIDE)) {return {};}
+                ret.region = std::array{as_size(0), as_size(1), as_size(2), as_size(3)};
+            } else {
+                error = "unknown key \"" + key + "\"";
+                return {};
+            }
+        }
+
+        if (ret.scene.empty() || ret.output_file.empty()) {
+            error = "both \"scene\" and \"out\" must be given";
+            return {};
+        }
+        return ret;
+    }
+
+    /* Returns the integer in `value` if `value` is a single integer in [`min`, `max`], checked
+    exactly as `parse()` checks integer values; otherwise, returns an empty `std::optional`. For
+    other integers given by users, such as command-line arguments. */
+    static std::optional<long long> parse_integer(const std::string &value, double min = 0,
+                                                  double max = MAX_INTEGER) {
+        auto numbers = parse_numbers(value);
+        if (numbers.size() != 1 || !is_integer_in(numbers[0], min, max)) {
+            return {};
+        }
+        return static_cast<long long>(numbers[0]);
+    }
+
+private:
+
+    /* Returns `true` if `number` is an integer in [`min`, `max`]. Numbers are checked with this
+    before they are converted to an integer type, since converting a NaN, an infinity, or a number
+    out of range of the integer type is undefined. */
+    static bool is_integer_in(double number, double min, double max) {
+        return number >= min && number <= max && number == std::floor(number);
+    }
+
+    /* `MAX_IMAGE_SIDE` = The largest width or height of an image that can be requested.
+    `MAX_INTEGER` = The largest integer that can be requested otherwise (the largest integer up to
+    which every integer is exactly representable as a `double`). */
+    static constexpr double MAX_IMAGE_SIDE = 1 << 16;
+    static constexpr double MAX_INTEGER = 9007199254740992.;
+
+    /* Returns the comma-separated numbers in `value`; if any of them is not a number, the result
+    is empty (which no key accepts). */
+    static std::vector<double> parse_numbers(const std::string &value) {
+        std::vector<double> ret;
+        std::istringstream in(value);
+        std::string part;
+        while (std::getline(in, part, ',')) {
+            std::size_t num_parsed = 0;
+            try {
+                ret.push_back(std::stod(part, &num_parsed));
+            } catch (const std::exception&) {
+                return {};
+            }
+            if (num_parsed != part.size()) {
+                return {};
+            }
+        }
+        return ret;
+    }
+};
+
+/* `RenderServer` is a long-running render daemon, which keeps scenes resident in memory (as built
+`BVH`s) between renders. Interactive look-dev (re-rendering the same scene over and over with small
+changes to the camera, or just a region of the image) then never pays for generating the scene or
+building its `BVH` again, which for large scenes takes far longer than a quick preview render.
+
+Clients connect to a local UNIX domain socket and send one command per connection, as a single
+line of text; the server replies with a single line, starting with "OK" or "ERROR". The commands:
+- "LIST": Replies with the names of all scenes.
+- "RENDER <key=value>...": Queues a render (see `RenderRequest::parse()` for the keys), and replies
+  once it has been saved, with the output file, and the milliseconds spent waiting in the queue
+  and rendering. Requests are rendered one at a time (each using all threads), highest priority
+  first.
+- "SHUTDOWN": Stops accepting commands, finishes all queued renders, and exits `run()`.
+
+Scenes are registered with `add_scene()`, and are loaded (generated, and a `BVH` built over them)
+the first time they are rendered, or all at once when the server starts if `preload` is true. */
+class RenderServer {
+    /* `SceneEntry` = A registered scene: how to generate it, the default settings of the camera
+    it is rendered with, and its `BVH` once it is loaded. */
+    struct SceneEntry {
+        std::function<Scene()> make_scene;
+        Camera camera;
+        std::unique_ptr<BVH> bvh;
+    };
+    /* `scenes` = The registered scenes, by name. Only the worker thread loads scenes, and no
+    scenes are added once `run()` starts, so the names can be read from any thread. */
+    std::map<std::string, SceneEntry> scenes;
+
+    /* `Job` = A queued `RenderRequest`, along with the connection to reply to once it is done. */
+    struct Job {
+        RenderRequest request;
+        int client_fd;
+        /* `sequence_number` = The number of jobs queued before this one; breaks ties between
+        equal priorities in favor of the older job. */
+        size_t sequence_number;
+        std::chrono::steady_clock::time_point queued_at;
+
+        /* `std::priority_queue` pops the greatest element first, so a `Job` is "less" than another
+        if it should be rendered later. */
+        bool operator< (const Job &other) const {
+            if (request.priority != other.request.priority) {
+                return request.priority < other.request.priority;
+            }
+            return sequence_number > other.sequence_number;
+        }
+    };
+    std::priority_queue<Job> jobs;
+    size_t num_jobs_queued = 0;
+    /* `jobs_mutex` guards `jobs` and `shutting_down`; `jobs_cv` is notified whenever either
+    changes. */
+    std::mutex jobs_mutex;
+    std::condition_variable jobs_cv;
+    bool shutting_down = false;
+
+    /* Generates the scene `name` and builds its `BVH`, if that has not been done already. */
+    BVH& load_scene(const std::string &name) {
+        auto &entry = scenes.at(name);
+        if (!entry.bvh) {
+            std::cout << "Loading scene \"" << name << "\"..." << std::endl;
+            entry.bvh = std::make_unique<BVH>(entry.make_scene());
+        }
+        return *entry.bvh;
+    }
+
+    /* Renders `job`, saves the image, and replies to its client. */
+    void process(const Job &job) {
+        auto start = std::chrono::steady_clock::now();
+        const auto &request = job.request;
+        auto &bvh = load_scene(request.scene);
+
+        auto camera = scenes.at(request.scene).camera;
+        if (request.width || request.height) {
+            camera.set_image_dimensions(request.width.value_or(camera.image_width()),
+                                        request.height.value_or(camera.image_height()));
+        }
+        if (request.samples_per_pixel) {camera.set_samples_per_pixel(*request.samples_per_pixel);}
+        if (request.max_depth) {camera.set_max_depth(*request.max_depth);}
+        if (request.center) {camera.set_camera_center(*request.center);}
+        if (request.lookat) {camera.set_camera_lookat(*request.lookat);}
+        if (request.vertical_fov) {camera.set_vertical_fov(*request.vertical_fov);}
+
+        /* Reject invalid settings here, because the `Camera` would exit the whole server on them.
+        The output file is opened (and so created, if it does not exist) before rendering, so that
+        a bad path is reported at once rather than after the whole render */
+        std::string error;
+        if (!std::ofstream(request.output_file, std::ios::app).is_open()) {
+            error = "could not open \"" + request.output_file + "\" for writing";
+        } else if (camera.image_width() == 0 || camera.image_height() == 0) {
+            error = "the image must not be empty";
+        } else if (request.region) {
+            auto [col, row, width, height] = *request.region;
+            if (width == 0 || height == 0 || col + width > camera.image_width()
+                || row + height > camera.image_height())
+            {
+                error = "the region is empty or does not fit in the "
+                      + std::to_string(camera.image_width()) + " x "
+                      + std::to_string(camera.image_height()) + " image";
+            } else {
+                camera.set_crop_window(col, row, width, height);
+            }
+        }
+        if (!error.empty()) {
+            write_all(job.client_fd, "ERROR " + error + "\n");
+            close(job.client_fd);
+            return;
+        }
+
+        if (!camera.render(bvh).try_send_as_ppm<true>(request.output_file)) {
+            write_all(job.client_fd, "ERROR could not write \"" + request.output_file + "\"\n");
+            close(job.client_fd);
+            return;
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        write_all(job.client_fd, "OK " + request.output_file + " queued_ms="
+                                 + std::to_string(ms_diff(job.queued_at, start)) + " render_ms="
+                                 + std::to_string(ms_diff(start, end)) + "\n");
+        close(job.client_fd);
+    }
+
+    /* The worker thread: renders queued jobs one at a time until shutdown, and then finishes the
+    remaining jobs. */
+    void work() {
+        while (true) {
+            std::unique_lock lock(jobs_mutex);
+            jobs_cv.wait(lock, [&] {return shutting_down || !jobs.empty();});
+            if (jobs.empty()) {
+                return;  /* Shutting down, and nothing left to do */
+            }
+            auto job = jobs.top();
+            jobs.pop();
+            lock.unlock();
+            process(job);
+        }
+    }
+
+    /* Handles the command `command` from the client connected on `client_fd`. Returns `false` if
+    the command was "SHUTDOWN". */
+    bool handle(const std::string &command, int client_fd) {
+        std::istringstream in(command);
+        std::string verb;
+        in >> verb;
+
+        if (verb == "LIST") {
+            std::string reply = "OK";
+            for (const auto &[name, entry] : scenes) {
+                reply += " " + name;
+            }
+            write_all(client_fd, reply + "\n");
+            close(client_fd);
+        } else if (verb == "RENDER") {
+            std::string args, error;
+            std::getline(in, args);
+            auto request = RenderRequest::parse(args, error);
+            if (request && !scenes.contains(request->scene)) {
+                error = "unknown scene \"" + request->scene + "\"";
+                request.reset();
+            }
+            if (!request) {
+                write_all(client_fd, "ERROR " + error + "\n");
+                close(client_fd);
+                return true;
+            }
+
+            /* The connection stays open until the worker thread replies */
+            std::lock_guard guard(jobs_mutex);
+            jobs.push(Job{std::move(*request), client_fd, num_jobs_queued++,
+                          std::chrono::steady_clock::now()});
+            jobs_cv.notify_one();
+        } else if (verb == "SHUTDOWN") {
+            write_all(client_fd, "OK shutting down\n");
+            close(client_fd);
+            return false;
+        } else {
+            write_all(client_fd, "ERROR unknown command \"" + verb + "\"\n");
+            close(client_fd);
+        }
+        return true;
+    }
+
+public:
+
+    /* Registers the scene `name`, which is generated by `make_scene` and rendered by default with
+    the settings of `camera`. */
+    auto& add_scene(const std::string &name, std::function<Scene()> make_scene,
+                    const Camera &camera) {
+        scenes[name] = SceneEntry{std::move(make_scene), camera, nullptr};
+        return *this;
+    }
+    /* Registers every scene of `registry` (see `add_scene()`). */
+    auto& add_scenes(const SceneRegistry &registry) {
+        for (const auto &[name, scene] : registry) {
+            add_scene(name, scene.make_scene, scene.camera);
+        }
+        return *this;
+    }
+
+    /* Serves commands on the UNIX domain socket `socket_path` (replacing any existing file there)
+    until a "SHUTDOWN" command is received and all queued renders have finished. If `preload` is
+    true, every registered scene is loaded before accepting any command. */
+    void run(const std::string &socket_path, bool preload = false) {
+        sockaddr_un address;
+        if (!make_socket_address(socket_path, address)) {
+            std::cout << "Error: The socket path \"" << socket_path << "\" is too long"
+                      << std::endl;
+            std::exit(-1);
+        }
+        auto server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socket_path.c_str());
+        if (server_fd < 0
+            || bind(server_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0
+            || listen(server_fd, 64) < 0)
+        {
+            std::cout << "Error: Could not listen on \"" << socket_path << "\" ("
+                      << std::strerror(errno) << ")" << std::endl;
+            std::exit(-1);
+        }
+
+        if (preload) {
+            for (const auto &[name, entry] : scenes) {
+                load_scene(name);
+            }
+        }
+
+        std::thread worker(&RenderServer::work, this);
+        std::cout << "Render server listening on \"" << socket_path << "\" with " << scenes.size()
+                  << " scenes" << std::endl;
+
+        while (true) {
+            auto client_fd = accept(server_fd, nullptr, nullptr);
+            if (client_fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                std::cout << "Error: `accept()` failed (" << std::strerror(errno) << ")"
+                          << std::endl;
+                break;
+            }
+            /* Commands are read on this thread, so give up on clients that connect but do not
+            send a command within a second, rather than blocking all other clients */
+            timeval timeout{.tv_sec = 1, .tv_usec = 0};
+            setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            if (auto command = read_line(client_fd); !command) {
+                close(client_fd);
+            } else if (!handle(*command, client_fd)) {
+                break;
+            }
+        }
+
+        /* Stop accepting connections, then let the worker finish the queued jobs */
+        close(server_fd);
+        unlink(socket_path.c_str());
+        {
+            std::lock_guard guard(jobs_mutex);
+            shutting_down = true;
+        }
+        jobs_cv.notify_one();
+        worker.join();
+        std::cout << "Render server on \"" << socket_path << "\" shut down" << std::endl;
+    }
+};
+
+#endif
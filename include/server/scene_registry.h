@@ -0,0 +1,21 @@
+#ifndef SCENE_REGISTRY_H
+#define SCENE_REGISTRY_H
+
+#include <map>
+#include <string>
+#include <functional>
+#include "base/camera.h"
+
+/* `RegisteredScene` = A scene that can be referred to by name, across processes: how to generate
+it, and the default settings of the camera it is rendered with. `make_scene` must generate the
+same scene every time it is called (in any process), so that processes which each generate the
+scene themselves (like the workers of a `DistributedRender`) all render the same scene. */
+struct RegisteredScene {
+    std::function<Scene()> make_scene;
+    Camera camera;
+};
+
+/* `SceneRegistry` = The named scenes that a `RenderServer` or `DistributedRender` can render. */
+using SceneRegistry = std::map<std::string, RegisteredScene>;
+
+#endif
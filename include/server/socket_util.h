@@ -0,0 +1,98 @@
+#ifndef SOCKET_UTIL_H
+#define SOCKET_UTIL_H
+
+#include <string>
+#include <optional>
+#include <cstring>  /* For `std::memcpy` and `std::strerror` */
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Helpers for the protocols that `RenderServer` and `send_render_command()`, and
+`DistributedRender` and its workers, speak over local (UNIX domain) stream sockets: every message
+is a single line of text ending in '\n', possibly followed by a known number of bytes of binary
+data. */
+
+/* `MAX_LINE_LENGTH` = The maximum length of a line we are willing to read, so that a misbehaving
+peer cannot make us buffer an unbounded amount of data. */
+constexpr size_t MAX_LINE_LENGTH = 1 << 16;
+
+/* Fills `address` with the UNIX domain socket address for the file `socket_path`. Returns `false`
+if `socket_path` is too long to fit in a `sockaddr_un`. */
+bool make_socket_address(const std::string &socket_path, sockaddr_un &address) {
+    address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return true;
+}
+
+/* Reads from the socket `fd` up to and including the next '\n', and returns the line without the
+'\n'. Returns an empty `std::optional` if the peer closes the connection before sending a complete
+line, if the line is longer than `MAX_LINE_LENGTH`, or on errors. Reads one byte at a time, because
+lines are short and this never reads past the end of the line. */
+std::optional<std::string> read_line(int fd) {
+    std::string line;
+    char c;
+    while (line.size() <= MAX_LINE_LENGTH) {
+        auto num_read = read(fd, &c, 1);
+        if (num_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (num_read <= 0) {
+            return {};
+        }
+        if (c == '\n') {
+            return line;
+        }
+        line += c;
+    }
+    return {};
+}
+
+/* Reads exactly `size` bytes from the socket `fd` into `data`. Returns `false` if the peer closes
+the connection before sending that many bytes, or on errors. */
+bool read_exact(int fd, void *data, size_t size) {
+    auto bytes = static_cast<char*>(data);
+    size_t num_read_total = 0;
+    while (num_read_total < size) {
+        auto num_read = read(fd, bytes + num_read_total, size - num_read_total);
+        if (num_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (num_read <= 0) {
+            return false;
+        }
+        num_read_total += static_cast<size_t>(num_read);
+    }
+    return true;
+}
+
+/* Writes the `size` bytes at `data` to the socket `fd`. Returns `false` if that fails (for
+instance, because the peer has closed the connection); `MSG_NOSIGNAL` makes that an error instead
+of a `SIGPIPE`, which would otherwise terminate the whole process. */
+bool write_all(int fd, const void *data, size_t size) {
+    auto bytes = static_cast<const char*>(data);
+    size_t written = 0;
+    while (written < size) {
+        auto num_written = send(fd, bytes + written, size - written, MSG_NOSIGNAL);
+        if (num_written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (num_written <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(num_written);
+    }
+    return true;
+}
+
+/* Writes all of `message` to the socket `fd`. Returns `false` if that fails. */
+bool write_all(int fd, const std::string &message) {
+    return write_all(fd, message.data(), message.size());
+}
+
+#endif
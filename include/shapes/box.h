@@ -3,85 +3,208 @@
 
 #include <array>
 #include "base/hittable.h"
+#include "math/transform.h"
 #include "shapes/parallelogram.h"
-#include "base/scene.h"
 
-/* `Box` is an abstraction over a 3D box - a rectangular prism - in 3D space. */
+/* `Box` is an abstraction over a 3D box - a rectangular prism - in 3D space. A `Box` is either
+axis-aligned, or is an axis-aligned box that has been placed into the scene by a `Transform` (for
+instance, to rotate it). */
 class Box : public Hittable {
-    /* `faces` holds the six faces of this `Box`. */
-    Scene faces;
+    /* `local_bounds` = This `Box` itself, as an axis-aligned box in the local coordinates of this
+    `Box`. If this `Box` has no `transform`, then its local coordinates are world coordinates.
+    A `Box` with zero thickness along an axis (such as a flat panel) is padded along it, as with
+    `AABB::pad_thin_axes()`; otherwise, the slab test in `hit_by()` would enter and exit that
+    slab at the same time, and never report a hit, so the `Box` would vanish. */
+    AABB local_bounds;
+    /* `transform`, if present, maps the local coordinates of this `Box` to world coordinates. */
+    std::optional<Transform> transform;
     /* `material`: The material for the surface of this `Box`. */
     std::shared_ptr<Material> material;
+    /* `aabb` = The AABB (Axis-Aligned Bounding Box) for this `Box`, in world coordinates. */
+    AABB aabb;
 
-public:
+    /* A transformed `Box` whose world-space `AABB` has more than `SPLIT_VOLUME_RATIO` times the
+    volume of the `Box` itself fits its `AABB` loosely enough that it is split into its six faces
+    when building a `BVH`; see `append_primitive_components()`. */
+    static constexpr double SPLIT_VOLUME_RATIO = 2;
+
+    /* Returns the edge vectors of this `Box` along its local x-, y-, and z- axes, in world
+    coordinates. */
+    auto world_edges() const {
+        std::array<Vec3D, 3> edges{
+            Vec3D{local_bounds[0].size(), 0, 0},
+            Vec3D{0, local_bounds[1].size(), 0},
+            Vec3D{0, 0, local_bounds[2].size()}
+        };
+        if (transform) {
+            for (auto &edge : edges) {
+                edge = transform->apply_to_vector(edge);
+            }
+        }
+        return edges;
+    }
 
-    /* A `Box` is practically identical to a `Scene`, so the abstract functions inherited from
-    `Hittable` can just be implemented in terms of the same functions for `Scene`. */
+    /* Returns `true` if this `Box` should be split into its six faces when building a `BVH`. */
+    bool is_worth_splitting() const {
+        /* For an axis-aligned `Box`, the `AABB` is exactly the `Box`, so there is nothing to gain.
+        Otherwise, the volume of the `Box` is the absolute value of the scalar triple product of
+        its (world-space) edges. */
+        if (!transform) {
+            return false;
+        }
+        auto [edge_x, edge_y, edge_z] = world_edges();
+        return aabb.volume() > SPLIT_VOLUME_RATIO * std::fabs(dot(edge_x, cross(edge_y, edge_z)));
+    }
+
+public:
 
     /* Returns a `hit_info` representing the earliest (minimum hit-time) intersection of the ray
-    `ray` with this `Box` in the time itnerval `ray_times`. If no such intersection exists, then
+    `ray` with this `Box` in the time interval `ray_times`. If no such intersection exists, then
     an empty `std::optional<hit_info>` is returned. */
     std::optional<hit_info> hit_by(const Ray3D &ray, const Interval &ray_times) const override {
-        /* Simply just delegate this to the `Scene`; this returns the earliest intersection of
-        `ray` in the time interval `ray_times` with the six faces of the box, as desired. */
-        return faces.hit_by(ray, ray_times);
+        /* A transformed `Box` is intersected in its local coordinates, where it is axis-aligned.
+        Because `Transform`s are affine, hit times in local coordinates are hit times for `ray`. */
+        auto local_ray = (transform ? transform->inverse_apply_to_ray(ray) : ray);
+
+        /* Use a single slab test, exactly like in `AABB::is_hit_by()`, except that we also keep
+        track of which slab the ray enters last (`enter_axis`) and which slab the ray exits first
+        (`exit_axis`). The ray enters the box through a face lying on the boundary of the slab
+        `enter_axis`, and exits through a face on the boundary of the slab `exit_axis`; that gives
+        us the surface normal for free. (t_enter, t_exit) is the time interval in which the ray is
+        inside all three slabs simultaneously; that is, inside the box. */
+        auto t_enter = -Interval::DOUBLE_INF, t_exit = Interval::DOUBLE_INF;
+        size_t enter_axis = 0, exit_axis = 0;
+        for (size_t axis = 0; axis < 3; ++axis) {
+            auto inverse_ray_dir = 1 / local_ray.dir[axis];
+            auto t0 = (local_bounds[axis].min - local_ray.origin[axis]) * inverse_ray_dir;
+            auto t1 = (local_bounds[axis].max - local_ray.origin[axis]) * inverse_ray_dir;
+            if (inverse_ray_dir < 0) {std::swap(t0, t1);}
+            if (t0 > t_enter) {t_enter = t0; enter_axis = axis;}
+            if (t1 < t_exit) {t_exit = t1; exit_axis = axis;}
+        }
+        if (t_exit <= t_enter) {
+            return {};
+        }
+
+        /* The earliest intersection is where the ray enters the box, unless that is not in
+        `ray_times` (for instance, when the ray starts inside the box), in which case it is where
+        the ray exits the box, if that is in `ray_times`. The outward normal of the entry face
+        points against the ray's direction along `enter_axis`, and the outward normal of the exit
+        face points along the ray's direction along `exit_axis`. */
+        auto hit_time = t_enter;
+        auto hit_axis = enter_axis;
+        auto along_ray = false;
+        if (!ray_times.contains_exclusive(hit_time)) {
+            hit_time = t_exit;
+            hit_axis = exit_axis;
+            along_ray = true;
+            if (!ray_times.contains_exclusive(hit_time)) {
+                return {};
+            }
+        }
+
+        auto outward_normal = Vec3D::zero();
+        outward_normal[hit_axis] = ((local_ray.dir[hit_axis] < 0) == along_ray ? -1 : 1);
+        if (transform) {
+            outward_normal = transform->apply_to_normal(outward_normal).unit_vector();
+        }
+
+        /* Every face has its own texture coordinates: the local coordinates of the hit point
+        along the other two axes (in cyclic order after `hit_axis`), scaled to [0, 1] across the
+        face. For a scaled `Box`, the `uv_scale` (in local units) is only approximate. */
+        auto local_hit_point = local_ray(hit_time);
+        auto axis_u = (hit_axis + 1) % 3, axis_v = (hit_axis + 2) % 3;
+        const auto &bounds_u = local_bounds[axis_u], &bounds_v = local_bounds[axis_v];
+        return hit_info(hit_time, ray(hit_time), outward_normal, ray, material,
+                        (local_hit_point[axis_u] - bounds_u.min) / bounds_u.size(),
+                        (local_hit_point[axis_v] - bounds_v.min) / bounds_v.size(),
+                        std::sqrt(bounds_u.size() * bounds_v.size()));
     }
 
-    /* Returns the primitive components of this `Box`; namely, its six `Parallelogram`
-    faces, which contributes to the construction of more efficient and complete
-    `BVH`s. See the comments in `Hittable::get_primitive_components()` for a more
-    detailed explanation. */
-    std::vector<std::shared_ptr<Hittable>> get_primitive_components() const override {
-        return faces.get_primitive_components();
+    /* Returns the number of primitive components of this `Box`; see
+    `append_primitive_components()`. */
+    size_t num_primitive_components() const override {
+        return (is_worth_splitting() ? 6 : 1);
+    }
+
+    /* A `Box` is normally a single primitive; its slab test costs about as much as one ray-AABB
+    test, which is much cheaper than testing six faces. However, a transformed (say, rotated) `Box`
+    can fill only a small fraction of its `AABB`, which makes the `BVH` test it against many rays
+    that miss it. In that case only, this appends the six `Parallelogram` faces of this `Box` to
+    `out` instead, since their own `AABB`s fit them much more tightly. See the comments in
+    `Hittable::num_primitive_components()` for a more detailed explanation. */
+    bool append_primitive_components(std::vector<std::shared_ptr<Hittable>> &out) const override {
+        if (!is_worth_splitting()) {
+            return false;
+        }
+
+        /* `min_corner` and `max_corner` each lie on three of the faces of this `Box`. */
+        auto min_corner = Point3D{local_bounds[0].min, local_bounds[1].min, local_bounds[2].min};
+        auto max_corner = Point3D{local_bounds[0].max, local_bounds[1].max, local_bounds[2].max};
+        if (transform) {
+            min_corner = transform->apply_to_point(min_corner);
+            max_corner = transform->apply_to_point(max_corner);
+        }
+        auto [side_x, side_y, side_z] = world_edges();
+
+        out.push_back(std::make_shared<Parallelogram>(min_corner, side_x, side_y, material));
+        out.push_back(std::make_shared<Parallelogram>(min_corner, side_x, side_z, material));
+        out.push_back(std::make_shared<Parallelogram>(min_corner, side_y, side_z, material));
+
+        out.push_back(std::make_shared<Parallelogram>(max_corner, -side_x, -side_y, material));
+        out.push_back(std::make_shared<Parallelogram>(max_corner, -side_x, -side_z, material));
+        out.push_back(std::make_shared<Parallelogram>(max_corner, -side_y, -side_z, material));
+        return true;
+    }
+
+    /* Appends the material of this `Box` to `out` (see `Hittable::append_materials()`). */
+    void append_materials(std::vector<Material*> &out) const override {
+        out.push_back(material.get());
+    }
+
+    /* Counts the memory used by this `Box` and its material in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        if (report.add_shared_object(MemoryCategory::PRIMITIVES, this, sizeof(*this))) {
+            material->report_memory(report);
+        }
     }
 
     /* Prints this `Box` to the `std::ostream` specified by `os`. */
     void print_to(std::ostream &os) const override {
-        os << "Box {faces: " << faces << "} " << std::flush;
+        os << "Box {bounds: " << local_bounds;
+        if (transform) {
+            os << ", transform: " << *transform;
+        }
+        os << "} " << std::flush;
     }
 
     /* Returns the `AABB` for this `Box`. */
     AABB get_aabb() const override {
-        /* Once more, we delegate this to the `Scene` field. */
-        return faces.get_aabb();
+        return aabb;
     }
 
     /* --- CONSTRUCTORS --- */
 
-    /* Constructs a `Box` with opposite vertices `vertex` and `opposite_vertex`, as well as
-    material specified by `material_`. */
+    /* Constructs an axis-aligned `Box` with opposite vertices `vertex` and `opposite_vertex`, as
+    well as material specified by `material_`. */
     Box(const Point3D &vertex, const Point3D &opposite_vertex,
         std::shared_ptr<Material> material_)
-        : material{std::move(material_)}
-    {
-
-        /* Compute `min_coordinates` and `max_coordinates`, which respectively are the points with
-        all minimal and all maximal x-, y-, and z- coordinates from the given points `vertex` and
-        `opposite_vertex`. Observe that `min_coordinates` and `max_coordinates` are both vertices
-        of the box; in fact, they are opposite vertices of the box. */
-        Point3D min_coordinates, max_coordinates;
-        for (int i = 0; i < 3; ++i) {
-            min_coordinates[i] = std::fmin(vertex[i], opposite_vertex[i]);
-            max_coordinates[i] = std::fmax(vertex[i], opposite_vertex[i]);
-        }
+        : local_bounds{AABB::from_points({vertex, opposite_vertex}).pad_thin_axes()},
+          material{std::move(material_)},
+          aabb{local_bounds}
+    {}
 
-        /* Precompute the edge vectors of the box; namely, the x-, y-, and z- displacement vectors
-        from `min_coordinates` to `max_coordinates`. */
-        auto side_x = Vec3D{max_coordinates.x - min_coordinates.x, 0, 0};
-        auto side_y = Vec3D{0, max_coordinates.y - min_coordinates.y, 0};
-        auto side_z = Vec3D{0, 0, max_coordinates.z - min_coordinates.z};
-
-        /* A `Box` is represented by 6 parallelogram (specifcially, rectangular) faces.
-        `min_coordinates` and `max_coordinates` eachlie on three of those faces. We add
-        the 6 faces to `faces`. */
-        faces.add(std::make_shared<Parallelogram>(min_coordinates, side_x, side_y, material));
-        faces.add(std::make_shared<Parallelogram>(min_coordinates, side_x, side_z, material));
-        faces.add(std::make_shared<Parallelogram>(min_coordinates, side_y, side_z, material));
-
-        faces.add(std::make_shared<Parallelogram>(max_coordinates, -side_x, -side_y, material));
-        faces.add(std::make_shared<Parallelogram>(max_coordinates, -side_x, -side_z, material));
-        faces.add(std::make_shared<Parallelogram>(max_coordinates, -side_y, -side_z, material));
-    }
+    /* Constructs the `Box` obtained by applying `transform_` to the axis-aligned box with opposite
+    vertices `vertex` and `opposite_vertex`, with material specified by `material_`. For instance,
+    `Transform::translation_by(p) * Transform::rotation(axis, degrees)` rotates the box about the
+    origin and then moves it by `p`. */
+    Box(const Point3D &vertex, const Point3D &opposite_vertex, const Transform &transform_,
+        std::shared_ptr<Material> material_)
+        : local_bounds{AABB::from_points({vertex, opposite_vertex}).pad_thin_axes()},
+          transform{transform_},
+          material{std::move(material_)},
+          aabb{transform_.apply_to_aabb(local_bounds)}
+    {}
 };
 
-#endif
\ No newline at end of file
+#endif
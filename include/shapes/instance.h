@@ -0,0 +1,123 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "base/hittable.h"
+#include "math/transform.h"
+
+/* `Instance` places a `Hittable` object into the scene with a `Transform`, which may itself move
+over scene time (see `Ray3D::time`): the transform is given at scene times 0 and 1 ("keyframes"),
+and is linearly interpolated (see `Transform::lerp()`) in between. This is how arbitrary objects
+are translated, rotated, and scaled; and, with two different keyframes, how they are animated for
+motion blur.
+
+An `Instance` is a single primitive as far as a `BVH` is concerned, because its object's primitives
+are only in the right place after being transformed. To instance a large object efficiently, build
+a `BVH` over it, and instance that `BVH`. */
+class Instance : public Hittable {
+    /* `object` = The instanced object, in its own local coordinates. */
+    std::shared_ptr<Hittable> object;
+    /* `transform0` and `transform1` map the local coordinates of `object` to world coordinates at
+    scene times 0 and 1, respectively. */
+    Transform transform0, transform1;
+    /* `moving` = Whether this `Instance` was given two keyframes (so `transform0` and `transform1`
+    may differ). */
+    bool moving;
+    /* `aabb` = The AABB (Axis-Aligned Bounding Box) for this `Instance`, over all of its motion. */
+    AABB aabb;
+
+    /* Returns the `Transform` from the local coordinates of `object` to world coordinates at the
+    scene time `time`. */
+    Transform transform_at(double time) const {
+        return (moving ? Transform::lerp(transform0, transform1, time) : transform0);
+    }
+
+public:
+
+    /* Returns a `hit_info` representing the earliest intersection of the ray `ray` with this
+    `Instance` in the time interval `ray_times`, if any. */
+    std::optional<hit_info> hit_by(const Ray3D &ray, const Interval &ray_times) const override {
+        /* Intersect the object with the ray transformed into its local coordinates (at the time
+        the ray exists). Because the transformation is affine, hit times are unchanged, so only
+        the hit point and the surface normal need to be transformed back to world coordinates.
+        Transforming the normal preserves the sign of its dot product with the ray's direction,
+        so the `hit_from_outside` determined in local coordinates remains correct. */
+        auto transform = transform_at(ray.time);
+        auto info = object->hit_by(transform.inverse_apply_to_ray(ray), ray_times);
+        if (info) {
+            info->hit_point = transform.apply_to_point(info->hit_point);
+            info->unit_surface_normal
+                = transform.apply_to_normal(info->unit_surface_normal).unit_vector();
+        }
+        return info;
+    }
+
+    /* Returns the transmittance of the object along the ray `ray` transformed into its local
+    coordinates, as `hit_by()` does, so that an instanced medium still gives the estimate of its
+    own `transmittance()` rather than all or nothing. Hit times are unchanged by the (affine)
+    transformation, so `ray_times` applies as is. */
+    double transmittance(const Ray3D &ray, const Interval &ray_times) const override {
+        return object->transmittance(transform_at(ray.time).inverse_apply_to_ray(ray), ray_times);
+    }
+
+    /* Returns the AABB for this `Instance`, over all of its motion. */
+    AABB get_aabb() const override {
+        return aabb;
+    }
+
+    /* Returns `true` if this `Instance` (or the object it instances) moves. */
+    bool is_moving() const override {
+        return moving || object->is_moving();
+    }
+
+    /* Returns the AABB for this `Instance` at the scene time `time`. This transforms the bounds of
+    `object` over all of its own motion; the image of a fixed `AABB` under the interpolated
+    transform is contained in the interpolation of its images under `transform0` and `transform1`
+    (every corner moves linearly), as `Hittable::get_aabb_at_time()` requires. */
+    AABB get_aabb_at_time(double time) const override {
+        return transform_at(time).apply_to_aabb(object->get_aabb());
+    }
+
+    /* Appends the materials of the object this `Instance` places to `out` (see
+    `Hittable::append_materials()`). */
+    void append_materials(std::vector<Material*> &out) const override {
+        object->append_materials(out);
+    }
+
+    /* Counts the memory used by this `Instance` and the object it places in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        if (report.add_shared_object(MemoryCategory::PRIMITIVES, this, sizeof(*this))) {
+            object->report_memory(report);
+        }
+    }
+
+    /* Prints this `Instance` to the `std::ostream` specified by `os`. */
+    void print_to(std::ostream &os) const override {
+        os << "Instance {transform: " << transform0;
+        if (moving) {
+            os << ", transform at time 1: " << transform1;
+        }
+        os << ", object: " << *object << "} " << std::flush;
+    }
+
+    /* --- CONSTRUCTORS --- */
+
+    /* Constructs the `Instance` of `object_` placed into the scene with the `Transform`
+    `transform_`, at all times. */
+    Instance(std::shared_ptr<Hittable> object_, const Transform &transform_)
+        : object{std::move(object_)}, transform0{transform_}, transform1{transform_},
+          moving{false}, aabb{transform_.apply_to_aabb(object->get_aabb())}
+    {}
+
+    /* Constructs the `Instance` of `object_` placed into the scene with the `Transform`
+    `transform0_` at scene time 0, `transform1_` at scene time 1, and their linear interpolation
+    in between. */
+    Instance(std::shared_ptr<Hittable> object_, const Transform &transform0_,
+             const Transform &transform1_)
+        : object{std::move(object_)}, transform0{transform0_}, transform1{transform1_},
+          moving{true}
+    {
+        aabb = AABB::merge(get_aabb_at_time(0), get_aabb_at_time(1));
+    }
+};
+
+#endif
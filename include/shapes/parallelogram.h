@@ -1,12 +1,18 @@
 #ifndef PARALLELOGRAM_H
 #define PARALLELOGRAM_H
 
+#include <array>
+#include <vector>
+#include <algorithm>  /* For `std::min` */
 #include "math/vec3d.h"
 #include "base/hittable.h"
 #include "base/material.h"
 
 /* `Parallelogram` is an abstraction over a 2D parallelogram in 3D space. */
 class Parallelogram : public Hittable {
+    /* `ParallelogramBatch` stores copies of the precomputed fields of `Parallelogram`s. */
+    friend class ParallelogramBatch;
+
     /* A 2D parallelogram in 3D space is represented by a given vertex, and two vectors
     corresponding to the two sides of the parallelogram. */
 
@@ -40,10 +46,16 @@ class Parallelogram : public Hittable {
     `hit_from_outside` field of all `hit_info`s returned from `Parallelogram::hit_by()` will be
     flipped. */
     Vec3D unit_plane_normal;
-    /* `scaled_plane_normal` = n / dot(n, n), where `n = cross(side1, side2)`, a normal vector
-    to the plane containing this `Parallelogram`. We precompute this quantity to be used in
-    `Parallelogram::hit_by()`. */
-    Vec3D scaled_plane_normal;
+    /* `alpha_dual` and `beta_dual` are the vectors whose dot products with a vector `v` in the
+    plane of this `Parallelogram` give the coordinates of `v` in the basis {`side1`, `side2`}; that
+    is, `v = dot(alpha_dual, v) * side1 + dot(beta_dual, v) * side2`. Together, they are the
+    inverse of the 2x2 basis {`side1`, `side2`} of the plane, and we precompute them so that
+    `Parallelogram::hit_by()` only needs two dot products (and no cross products) to find the
+    basis coordinates of the hit point. See the comments above `Parallelogram::hit_by()`. */
+    Vec3D alpha_dual, beta_dual;
+    /* `uv_scale` = The geometric mean of the lengths of `side1` and `side2`: about how long a
+    distance on this `Parallelogram` one unit of its texture coordinates spans (see `hit_info`). */
+    double uv_scale;
     /* `aabb` = The AABB (Axis-Aligned Bounding Box) for this `Parallelogram`. */
     AABB aabb;
 
@@ -152,11 +164,14 @@ public:
     This yields
     `alpha = dot(n / dot(n, n), cross(hit_point - vertex, side2))`.
 
-    We will precompute `n / dot(n, n)` (we save this in `scaled_plane_normal`; it is equal to
-    `n / |n|^2`, not sure if there's a better name for this) to increase performance. Finally,
-    it suffices to check that `0 <= alpha, beta <= 1` to see if the hit point is inside the
-    parallelogram itself. This completes the final step, and we are done. Now, check out the
-    implementation below.
+    Finally, by the cyclic property of the scalar triple product (dot(a, cross(b, c)) =
+    dot(b, cross(c, a))), we can rewrite these as `alpha = dot(hit_point - vertex, cross(side2,
+    n / dot(n, n)))` and `beta = dot(hit_point - vertex, cross(n / dot(n, n), side1))`. The
+    second vector in each dot product does not depend on the ray at all, so we precompute them
+    (in `alpha_dual` and `beta_dual` respectively); this leaves just two dot products per ray,
+    instead of two cross products and two dot products. Finally, it suffices to check that
+    `0 <= alpha, beta <= 1` to see if the hit point is inside the parallelogram itself. This
+    completes the final step, and we are done. Now, check out the implementation below.
 
     (*) We would not be allowed to divide both sides of the equation by dot(n, cross(side1, side2))
     if it was equal to 0. However, because `n` is the normal to the plane, it in fact is EQUAL to
@@ -190,7 +205,7 @@ public:
         often than it should) or too large (which could lead to floating-point inaccuracies in
         the computation of `dot(kn, ray.dir)`). When I initially used `kn = scaled_plane_normal
         = n / |n|^2`, parallelograms with coordinates on the order of 1e6 started rejecting all
-        rays, resulting in them not rendering at all. From my testing,`unit_plane_normal` does
+        rays, resulting in them not rendering at all. From my testing, `unit_plane_normal` does
         not have the same issue.
         
         In summary, if the ray is parallel or very close to parallel to the parallelogram-containing
@@ -222,16 +237,18 @@ public:
 
         /* Compute the basis coordinates (using the basis {`side1`, `side2`}) of `hit_point`
         in this plane, again, using `vertex` as the origin of this plane. */
-        auto alpha = dot(scaled_plane_normal, cross(planar_hitpoint_vector, side2));
-        auto beta = dot(scaled_plane_normal, cross(side1, planar_hitpoint_vector));
+        auto alpha = dot(alpha_dual, planar_hitpoint_vector);
+        auto beta = dot(beta_dual, planar_hitpoint_vector);
 
         /* The ray's hitpoint on the parallelogram-containing plane is in the parallelogram itself,
         iff `0 <= alpha, beta <= 1`. */
         if (auto i = Interval(0, 1); i.contains_inclusive(alpha) && i.contains_inclusive(beta)) {
             /* We just pass in `unit_plane_normal`, which we precomputed, as the
             `outward_unit_surface_normal`. See the comments above the definition of
-            `unit_plane_normal` for more explanation on why we do this.*/
-            return hit_info(hit_time, hit_point, unit_plane_normal, ray, material);
+            `unit_plane_normal` for more explanation on why we do this. The basis coordinates are
+            also the texture coordinates: (0, 0) at `vertex`, and (1, 1) at the opposite vertex. */
+            return hit_info(hit_time, hit_point, unit_plane_normal, ray, material, alpha, beta,
+                            uv_scale);
         }
 
         /* The ray hit the parallelogram-containing plane, but it did not hit the parallelogram
@@ -244,6 +261,19 @@ public:
         return aabb;
     }
 
+    /* Appends the material of this `Parallelogram` to `out` (see
+    `Hittable::append_materials()`). */
+    void append_materials(std::vector<Material*> &out) const override {
+        out.push_back(material.get());
+    }
+
+    /* Counts the memory used by this `Parallelogram` and its material in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        if (report.add_shared_object(MemoryCategory::PRIMITIVES, this, sizeof(*this))) {
+            material->report_memory(report);
+        }
+    }
+
     /* Prints this `Parallelogram` to the `std::ostream` specified by `os`. */
     void print_to(std::ostream &os) const override {
         os << "Parallelogram {vertex: " << vertex << ", side 1 vector: " << side1
@@ -270,12 +300,15 @@ public:
                   std::shared_ptr<Material> material_)
         : vertex{vertex_}, side1{side1_}, side2{side2_}, material{std::move(material_)}
     {
-        /* Precompute `unit_plane_normal` and `scaled_plane_normal`; see the comments above
+        /* Precompute `unit_plane_normal`, `alpha_dual`, and `beta_dual`; see the comments above
         their respective definitions. */
         auto plane_normal = cross(side1, side2);  /* This is `n` in those comments */
         unit_plane_normal = plane_normal.unit_vector();
         /* Note that dot(n, n) = |n|^2, so `scaled_plane_normal` = n / dot(n, n) = n / |n|^2. */
-        scaled_plane_normal = plane_normal / plane_normal.mag_squared();
+        auto scaled_plane_normal = plane_normal / plane_normal.mag_squared();
+        alpha_dual = cross(side2, scaled_plane_normal);
+        beta_dual = cross(scaled_plane_normal, side1);
+        uv_scale = std::sqrt(side1.mag() * side2.mag());
 
         /* The `AABB` for a `Parallelogram` is simply the minimum-size `AABB` that contains all the
         vertices of the parallelogram; that is, the `AABB` containing `vertex`, `vertex + side1`,
@@ -285,14 +318,141 @@ public:
 
         Then, because parallelograms are 2D, the resulting AABB may have zero thickness in one
         of its dimensions (when it is parallel to one of the xy-/xz-/yz-planes), which can result
-        in numerical issues. To avoid this, we pad every axis interval of the AABB; specifically,
-        we ensure that every axis interval has length at least some small constant (1e-4 here). */
+        in numerical issues. To avoid this, we pad every such thin axis interval of the AABB by
+        an amount relative to the scale of this parallelogram's coordinates (rather than by an
+        absolute constant, which would be too large for tiny scenes and below the precision of
+        a `double` for huge ones); see `AABB::pad_thin_axes()`. */
         aabb = AABB::from_points({
             vertex,                  /* The given vertex of this parallelogram */
             vertex + side1,          /* The vertex opposite to `vertex` along the first side */
             vertex + side2,          /* The vertex opposite to `vertex` along the second side */
             vertex + side1 + side2   /* The vertex opposite to `vertex` in this  parallelogram */
-        }).ensure_min_axis_length(1e-4);  /* Make sure each axis of the AABB has length >= 1e-4 */
+        }).pad_thin_axes();
+    }
+};
+
+/* `ParallelogramBatch` stores the geometry of many `Parallelogram`s in structure-of-arrays (SoA)
+layout, so that a ray can be tested against a contiguous range of them with vectorized (SIMD)
+arithmetic. This is used by `BVH` for leaf nodes which contain only `Parallelogram`s, which is
+common in scenes made of many flat tiles (see `raining_on_the_dance_floor()` in main.cpp).
+
+The intersection test is exactly the one in `Parallelogram::hit_by()`, performed on every
+`Parallelogram` in the range at once; so `ParallelogramBatch::hit_by()` returns the same result
+as calling `Parallelogram::hit_by()` on each of them in order and keeping the earliest hit. */
+class ParallelogramBatch {
+    /* `NUM_LANES` = The number of `Parallelogram`s that are tested at once, in a single pass
+    of the vectorized loop in `hit_by()`. */
+    static constexpr size_t NUM_LANES = 16;
+
+    /* The components of the `vertex`, `unit_plane_normal`, `alpha_dual`, and `beta_dual` fields
+    of every `Parallelogram` in this batch, one array per component. */
+    std::vector<double> vertex_x, vertex_y, vertex_z;
+    std::vector<double> normal_x, normal_y, normal_z;
+    std::vector<double> alpha_x, alpha_y, alpha_z;
+    std::vector<double> beta_x, beta_y, beta_z;
+    /* `sources[i]` = The `Parallelogram` that the `i`th entry of this batch was copied from. It
+    is only used to create the `hit_info` for the earliest hit, so it is kept out of the way. */
+    std::vector<const Parallelogram*> sources;
+
+public:
+
+    /* Returns the number of `Parallelogram`s in this batch. */
+    auto size() const {return sources.size();}
+
+    /* Returns the number of bytes used by the arrays of this batch. */
+    size_t memory_bytes() const {
+        size_t ret = sources.capacity() * sizeof(const Parallelogram*);
+        for (const auto *array : {&vertex_x, &vertex_y, &vertex_z, &normal_x, &normal_y, &normal_z,
+                                  &alpha_x, &alpha_y, &alpha_z, &beta_x, &beta_y, &beta_z}) {
+            ret += array->capacity() * sizeof(double);
+        }
+        return ret;
+    }
+
+    /* Appends (a copy of the geometry of) the `Parallelogram` `p` to this batch. `p` must outlive
+    this batch. Returns the index of `p` within this batch. */
+    size_t add(const Parallelogram &p) {
+        vertex_x.push_back(p.vertex.x);
+        vertex_y.push_back(p.vertex.y);
+        vertex_z.push_back(p.vertex.z);
+        normal_x.push_back(p.unit_plane_normal.x);
+        normal_y.push_back(p.unit_plane_normal.y);
+        normal_z.push_back(p.unit_plane_normal.z);
+        alpha_x.push_back(p.alpha_dual.x);
+        alpha_y.push_back(p.alpha_dual.y);
+        alpha_z.push_back(p.alpha_dual.z);
+        beta_x.push_back(p.beta_dual.x);
+        beta_y.push_back(p.beta_dual.y);
+        beta_z.push_back(p.beta_dual.z);
+        sources.push_back(&p);
+        return sources.size() - 1;
+    }
+
+    /* Returns a `hit_info` representing the earliest intersection of the ray `ray` with the
+    `Parallelogram`s at indices `first_index` through `first_index + count - 1` in this batch, in
+    the time interval `ray_times`. If there is no such intersection, an empty `std::optional` is
+    returned. */
+    std::optional<hit_info> hit_by(size_t first_index, size_t count, const Ray3D &ray,
+                                   const Interval &ray_times) const {
+        auto min_hit_time = ray_times.max;
+        auto min_hit_index = first_index + count;  /* Past-the-end means "no hit" */
+
+        /* Copy everything the vectorized loop reads into local variables, so that the compiler
+        knows they cannot change during the loop (otherwise, it would have to assume that the
+        `double`s of `ray` may alias the `double`s in the arrays). */
+        auto [ox, oy, oz] = std::array{ray.origin.x, ray.origin.y, ray.origin.z};
+        auto [dx, dy, dz] = std::array{ray.dir.x, ray.dir.y, ray.dir.z};
+        auto t_min = ray_times.min, t_max = ray_times.max;
+        const auto *vx = vertex_x.data(), *vy = vertex_y.data(), *vz = vertex_z.data();
+        const auto *nx = normal_x.data(), *ny = normal_y.data(), *nz = normal_z.data();
+        const auto *ax = alpha_x.data(), *ay = alpha_y.data(), *az = alpha_z.data();
+        const auto *bx = beta_x.data(), *by = beta_y.data(), *bz = beta_z.data();
+
+        for (size_t start = first_index; start < first_index + count; start += NUM_LANES) {
+            auto num_lanes = std::min(NUM_LANES, first_index + count - start);
+
+            /* First, compute the hit time with each `Parallelogram` (or infinity if there is no
+            hit) in a branch-free loop, so that the compiler can vectorize it; this is why the
+            conditions are combined with `&` rather than `&&`. Every step is the same as in
+            `Parallelogram::hit_by()`; see the comments there. */
+            std::array<double, NUM_LANES> hit_times;
+            #pragma omp simd
+            for (size_t lane = 0; lane < num_lanes; ++lane) {
+                auto i = start + lane;
+                auto denominator = nx[i] * dx + ny[i] * dy + nz[i] * dz;
+                auto t = (nx[i] * (vx[i] - ox) + ny[i] * (vy[i] - oy) + nz[i] * (vz[i] - oz))
+                         / denominator;
+                auto px = (ox + t * dx) - vx[i];
+                auto py = (oy + t * dy) - vy[i];
+                auto pz = (oz + t * dz) - vz[i];
+                auto alpha = ax[i] * px + ay[i] * py + az[i] * pz;
+                auto beta = bx[i] * px + by[i] * py + bz[i] * pz;
+                auto is_hit = (std::fabs(denominator) >= 1e-9) & (t_min < t) & (t < t_max)
+                            & (0 <= alpha) & (alpha <= 1) & (0 <= beta) & (beta <= 1);
+                hit_times[lane] = (is_hit ? t : Interval::DOUBLE_INF);
+            }
+
+            /* Then, find the earliest hit. Using `<` keeps the first of several equally-early
+            hits, just like the loop over primitives in `BVH::hit_by()` does. */
+            for (size_t lane = 0; lane < num_lanes; ++lane) {
+                if (hit_times[lane] < min_hit_time) {
+                    min_hit_time = hit_times[lane];
+                    min_hit_index = start + lane;
+                }
+            }
+        }
+
+        if (min_hit_index == first_index + count) {
+            return {};
+        }
+        /* Only the earliest hit needs its basis (texture) coordinates, so they are recomputed here
+        rather than kept for every lane */
+        const auto &p = *sources[min_hit_index];
+        auto hit_point = ray(min_hit_time);
+        auto planar_hitpoint_vector = hit_point - p.vertex;
+        return hit_info(min_hit_time, hit_point, p.unit_plane_normal, ray, p.material,
+                        dot(p.alpha_dual, planar_hitpoint_vector),
+                        dot(p.beta_dual, planar_hitpoint_vector), p.uv_scale);
     }
 };
 
@@ -2,7 +2,9 @@
 #define SHAPES_H
 
 #include "shapes/box.h"
+#include "shapes/instance.h"
 #include "shapes/parallelogram.h"
 #include "shapes/sphere.h"
+#include "shapes/tiled_plane.h"
 
 #endif
\ No newline at end of file
@@ -1,24 +1,32 @@
 #ifndef SPHERE_H
 #define SPHERE_H
 
-#include <iostream>
+#include <cmath>
 #include <memory>
+#include <numbers>
+#include <iostream>
+#include <algorithm>  /* For `std::clamp` */
 #include "base/hittable.h"
 #include "math/vec3d.h"
 #include "math/ray3d.h"
 #include "base/material.h"
 
-/* `Sphere` is an abstraction over a sphere in 3D space. */
+/* `Sphere` is an abstraction over a sphere in 3D space, which may move linearly over scene time
+(see `Ray3D::time`). */
 struct Sphere : public Hittable {
     /* A sphere in 3D space is represented by its `center` and its `radius`. */
 
-    /* `center`: The center of this `Sphere`. */
+    /* `center`: The center of this `Sphere` at scene time 0. */
     Point3D center;
+    /* `velocity`: The displacement of the center of this `Sphere` from scene time 0 to scene
+    time 1; so, its center at scene time `t` is `center + t * velocity`. The zero vector for
+    stationary `Sphere`s. */
+    Vec3D velocity = Vec3D::zero();
     /* `radius`: The radius of this `Sphere`. */
     double radius;
     /* `material`: The material of this `Sphere`. */
     std::shared_ptr<Material> material;
-    /* `aabb` = The AABB (Axis-Aligned Bounding Box) for this `Sphere`. */
+    /* `aabb` = The AABB (Axis-Aligned Bounding Box) for this `Sphere`, over all of its motion. */
     AABB aabb;
 
     /* A ray hits a sphere iff it intersects its surface. Now, a sphere with radius R centered at
@@ -44,8 +52,10 @@ struct Sphere : public Hittable {
     is returned. */
     std::optional<hit_info> hit_by(const Ray3D &ray, const Interval &ray_times) const override {    
 
-        /* Set up quadratic formula calculation */
-        auto center_to_origin = ray.origin - center;
+        /* Set up quadratic formula calculation, using the center of this `Sphere` at the time
+        the ray exists */
+        auto current_center = center_at(ray.time);
+        auto center_to_origin = ray.origin - current_center;
         auto a = dot(ray.dir, ray.dir);
         auto b_half = dot(ray.dir, center_to_origin);
         auto c = dot(center_to_origin, center_to_origin) - radius * radius;
@@ -91,20 +101,62 @@ struct Sphere : public Hittable {
         is parallel to p - sphere_center. Furthermore, p - sphere_center has magnitude equal to
         the sphere's radius, so we can simply divide by `radius` to find the unit vector of the
         outward surface normal.  */
-        auto outward_unit_normal = (hit_point - center) / radius;
-        return hit_info(root, hit_point, outward_unit_normal, ray, material);
+        auto outward_unit_normal = (hit_point - current_center) / radius;
+
+        /* The texture coordinates are the longitude `u` (0 at -x, increasing counterclockwise
+        when seen from +y) and the latitude `v` (0 at the bottom, -y, and 1 at the top, +y), each
+        scaled to [0, 1]. Half a circumference spans one unit of `v` (and half a unit of `u`). */
+        auto u = (std::atan2(-outward_unit_normal.z, outward_unit_normal.x) + std::numbers::pi)
+               / (2 * std::numbers::pi);
+        auto v = std::acos(std::clamp(-outward_unit_normal.y, -1., 1.)) / std::numbers::pi;
+        return hit_info(root, hit_point, outward_unit_normal, ray, material, u, v,
+                        std::numbers::pi * radius);
     }
 
-    /* Returns the AABB (Axis-Aligned Bounding Box) for this `Sphere`. */
+    /* Returns the center of this `Sphere` at the scene time `time`. */
+    Point3D center_at(double time) const {
+        return center + time * velocity;
+    }
+
+    /* Returns the AABB (Axis-Aligned Bounding Box) for this `Sphere`, over all of its motion. */
     AABB get_aabb() const override {
         return aabb;
     }
 
+    /* Returns `true` if this `Sphere` moves. */
+    bool is_moving() const override {
+        return velocity.x != 0 || velocity.y != 0 || velocity.z != 0;
+    }
+
+    /* Returns the AABB for this `Sphere` at the scene time `time`. The bounds of a linearly
+    moving `Sphere` themselves move linearly, so these are exactly the `AABB`s at times 0 and 1
+    linearly interpolated, as required by `Hittable::get_aabb_at_time()`. */
+    AABB get_aabb_at_time(double time) const override {
+        auto radius_vector = Vec3D{radius, radius, radius};
+        auto current_center = center_at(time);
+        return AABB::from_points({current_center - radius_vector, current_center + radius_vector});
+    }
+
+    /* Appends the material of this `Sphere` to `out` (see `Hittable::append_materials()`). */
+    void append_materials(std::vector<Material*> &out) const override {
+        out.push_back(material.get());
+    }
+
+    /* Counts the memory used by this `Sphere` and its material in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        if (report.add_shared_object(MemoryCategory::PRIMITIVES, this, sizeof(*this))) {
+            material->report_memory(report);
+        }
+    }
+
     /* Prints this `Sphere` to the `std::ostream` specified by `os`. */
     void print_to(std::ostream &os) const override {
         /* Desmos format is "sphere((x, y, z), radius)" */
-        os << "Sphere {center: " << center << ", radius: " << radius << ", material: " << *material
-           << "} " << std::flush;
+        os << "Sphere {center: " << center;
+        if (is_moving()) {
+            os << ", center at time 1: " << center_at(1);
+        }
+        os << ", radius: " << radius << ", material: " << *material << "} " << std::flush;
     }
 
     /* Constructs a Sphere with center `center_`, radius `radius_`, and material
@@ -120,6 +172,17 @@ struct Sphere : public Hittable {
         auto radius_vector = Vec3D{radius, radius, radius};
         aabb = AABB::from_points({center - radius_vector, center + radius_vector});
     }
+
+    /* Constructs a Sphere with radius `radius_` and material specified by `material_`, which
+    moves linearly from center `center0` at scene time 0 to center `center1` at scene time 1. */
+    Sphere(const Point3D &center0, const Point3D &center1, double radius_,
+           std::shared_ptr<Material> material_)
+        : Sphere(center0, radius_, std::move(material_))
+    {
+        velocity = center1 - center0;
+        /* The AABB over the whole motion bounds the `Sphere` at both ends of its motion */
+        aabb.merge_with(get_aabb_at_time(1));
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,197 @@
+#ifndef TILED_PLANE_H
+#define TILED_PLANE_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>  /* For `std::min` */
+#include "math/vec3d.h"
+#include "base/hittable.h"
+#include "base/material.h"
+
+/* `TiledPlane` is an abstraction over a regular, planar grid of identical parallelogram tiles (such
+as the floor tiles of `raining_on_the_dance_floor()` in main.cpp), each with its own material.
+
+Representing such a grid with one `Parallelogram` per tile costs a `Parallelogram`, a `Material`,
+and a share of the `BVH` nodes per tile; for millions of tiles, that is hundreds of megabytes, and
+a deep `BVH` to traverse. A `TiledPlane` instead stores the grid itself, a (small) palette of
+materials, and a 2-byte material index per tile, and is a single primitive whose intersection test
+takes O(1) time regardless of the number of tiles: a single ray-plane intersection, followed by
+looking up which cell of the grid the hit point is in. */
+class TiledPlane : public Hittable {
+    /* The grid consists of `num_cells1 * num_cells2` cells. The cell with indices (i, j) is the
+    parallelogram with vertex `corner + i * cell_side1 + j * cell_side2` and sides `cell_side1` and
+    `cell_side2`. The tile in each cell is the part of the cell that remains after removing a
+    margin of `tile_margin` (as a fraction of the cell's sides) along each of its four edges;
+    the margins are the gaps between the tiles. */
+
+    /* `corner` = The vertex of the cell with indices (0, 0) that is also a vertex of the grid. */
+    Point3D corner;
+    /* `cell_side1` and `cell_side2` = The two sides of every cell of the grid. */
+    Vec3D cell_side1, cell_side2;
+    /* `num_cells1` and `num_cells2` = The number of cells along `cell_side1` and `cell_side2`. */
+    size_t num_cells1, num_cells2;
+    /* `tile_margin` = The fraction of each cell's sides, on every edge, that is not part of the
+    cell's tile. Must be in the range [0, 0.5). */
+    double tile_margin;
+    /* `palette` = The distinct materials of the tiles. */
+    std::vector<std::shared_ptr<Material>> palette;
+    /* `material_indices[i * num_cells2 + j]` = The index in `palette` of the material of the tile
+    in the cell with indices (i, j). */
+    std::vector<uint16_t> material_indices;
+
+    /* `unit_plane_normal`, `alpha_dual`, and `beta_dual` are exactly as in `Parallelogram`, for the
+    basis {`cell_side1`, `cell_side2`}. Thus, the coordinates of a point in the plane with respect
+    to this basis (and with `corner` as the origin) are measured in cells, so their integer parts
+    are the indices of the cell the point is in. */
+    Vec3D unit_plane_normal, alpha_dual, beta_dual;
+    /* `uv_scale` = The geometric mean of the lengths of `cell_side1` and `cell_side2` (see
+    `Parallelogram::uv_scale`) */
+    double uv_scale;
+    /* `aabb` = The AABB (Axis-Aligned Bounding Box) for this `TiledPlane`. */
+    AABB aabb;
+
+public:
+
+    /* Returns a `hit_info` representing the intersection of the ray `ray` with a tile of this
+    `TiledPlane` in the time interval `ray_times`, if any. */
+    std::optional<hit_info> hit_by(const Ray3D &ray, const Interval &ray_times) const override {
+        /* Find the intersection of `ray` with the plane of the grid, exactly as in
+        `Parallelogram::hit_by()`; see the comments there. */
+        auto hit_time_denominator = dot(unit_plane_normal, ray.dir);
+        if (std::fabs(hit_time_denominator) < 1e-9) {
+            return {};
+        }
+        auto hit_time = dot(unit_plane_normal, corner - ray.origin) / hit_time_denominator;
+        if (!ray_times.contains_exclusive(hit_time)) {
+            return {};
+        }
+        auto hit_point = ray(hit_time);
+        auto planar_hitpoint_vector = hit_point - corner;
+
+        /* `alpha` and `beta` are the coordinates of `hit_point`, measured in cells. The hit point
+        is on the grid iff 0 <= `alpha` <= `num_cells1` and 0 <= `beta` <= `num_cells2`. */
+        auto alpha = dot(alpha_dual, planar_hitpoint_vector);
+        auto beta = dot(beta_dual, planar_hitpoint_vector);
+        if (!(0 <= alpha && alpha <= static_cast<double>(num_cells1)
+              && 0 <= beta && beta <= static_cast<double>(num_cells2)))
+        {
+            return {};
+        }
+
+        /* Find the cell containing the hit point; the points on the far edges of the grid belong
+        to the last cells. Then, the hit point is on that cell's tile iff its coordinates within
+        the cell are not in the margins. */
+        auto cell1 = std::min(static_cast<size_t>(alpha), num_cells1 - 1);
+        auto cell2 = std::min(static_cast<size_t>(beta), num_cells2 - 1);
+        auto in_cell_alpha = alpha - static_cast<double>(cell1);
+        auto in_cell_beta = beta - static_cast<double>(cell2);
+        if (auto tile = Interval(tile_margin, 1 - tile_margin);
+            !tile.contains_inclusive(in_cell_alpha) || !tile.contains_inclusive(in_cell_beta))
+        {
+            return {};
+        }
+
+        /* Every tile has its own texture coordinates: (0, 0) and (1, 1) at its opposite corners */
+        const auto &material = palette[material_indices[cell1 * num_cells2 + cell2]];
+        auto tile_size = 1 - 2 * tile_margin;
+        return hit_info(hit_time, hit_point, unit_plane_normal, ray, material,
+                        (in_cell_alpha - tile_margin) / tile_size,
+                        (in_cell_beta - tile_margin) / tile_size, tile_size * uv_scale);
+    }
+
+    /* Returns the AABB (Axis-Aligned Bounding Box) for this `TiledPlane`. */
+    AABB get_aabb() const override {
+        return aabb;
+    }
+
+    /* Appends the materials of the palette of this `TiledPlane` to `out`, in order (see
+    `Hittable::append_materials()`). */
+    void append_materials(std::vector<Material*> &out) const override {
+        for (const auto &material : palette) {
+            out.push_back(material.get());
+        }
+    }
+
+    /* Counts the memory used by this `TiledPlane` (including its material indices) and its
+    materials in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        if (report.add_shared_object(MemoryCategory::PRIMITIVES, this, sizeof(*this))) {
+            report.add_vector(MemoryCategory::PRIMITIVES, palette);
+            report.add_vector(MemoryCategory::PRIMITIVES, material_indices);
+            for (const auto &material : palette) {
+                material->report_memory(report);
+            }
+        }
+    }
+
+    /* Prints this `TiledPlane` to the `std::ostream` specified by `os`. */
+    void print_to(std::ostream &os) const override {
+        os << "TiledPlane {corner: " << corner << ", cell side 1 vector: " << cell_side1
+           << ", cell side 2 vector: " << cell_side2 << ", cells: " << num_cells1 << " x "
+           << num_cells2 << ", tile margin: " << tile_margin << ", materials: "
+           << palette.size() << "} " << std::flush;
+    }
+
+    /* --- CONSTRUCTORS --- */
+
+    /* @brief Constructs a grid of `num_cells1_` by `num_cells2_` tiles.
+
+    @param `corner_`: A vertex of the grid; the vertex of its cell with indices (0, 0).
+    @param `cell_side1_`, `cell_side2_`: The two sides of every cell of the grid. The cell with
+    indices (i, j) has vertex `corner_ + i * cell_side1_ + j * cell_side2_`.
+    @param `num_cells1_`, `num_cells2_`: The number of cells along `cell_side1_` and `cell_side2_`.
+    @param `tile_margin_`: The fraction (in [0, 0.5)) of each cell's sides, on each of its edges,
+    that is left empty between the tiles. 0 makes the tiles cover the grid completely.
+    @param `palette_`: The distinct materials of the tiles (at most 65536 of them).
+    @param `material_indices_`: `material_indices_[i * num_cells2_ + j]` is the index in `palette_`
+    of the material of the tile in the cell with indices (i, j). */
+    TiledPlane(const Point3D &corner_, const Vec3D &cell_side1_, const Vec3D &cell_side2_,
+               size_t num_cells1_, size_t num_cells2_, double tile_margin_,
+               std::vector<std::shared_ptr<Material>> palette_,
+               std::vector<uint16_t> material_indices_)
+        : corner{corner_}, cell_side1{cell_side1_}, cell_side2{cell_side2_},
+          num_cells1{num_cells1_}, num_cells2{num_cells2_}, tile_margin{tile_margin_},
+          palette{std::move(palette_)}, material_indices{std::move(material_indices_)}
+    {
+        /* Validate the grid before it is ever intersected with, so that `hit_by()` never needs
+        to check anything */
+        if (num_cells1 == 0 || num_cells2 == 0 || !(0 <= tile_margin && tile_margin < 0.5)) {
+            std::cout << "Error: TiledPlane with " << num_cells1 << " x " << num_cells2
+                      << " cells and tile margin " << tile_margin << " is invalid (there must be"
+                      << " at least one cell, and the margin must be in [0, 0.5))" << std::endl;
+            std::exit(-1);
+        }
+        if (material_indices.size() != num_cells1 * num_cells2) {
+            std::cout << "Error: TiledPlane with " << num_cells1 << " x " << num_cells2
+                      << " cells was given " << material_indices.size() << " material indices"
+                      << std::endl;
+            std::exit(-1);
+        }
+        for (auto index : material_indices) {
+            if (index >= palette.size()) {
+                std::cout << "Error: TiledPlane material index " << index << " is out of range"
+                          << " for its palette of " << palette.size() << " materials"
+                          << std::endl;
+                std::exit(-1);
+            }
+        }
+
+        /* Precompute `unit_plane_normal`, `alpha_dual`, and `beta_dual`, just like in the
+        constructor of `Parallelogram`. */
+        auto plane_normal = cross(cell_side1, cell_side2);
+        unit_plane_normal = plane_normal.unit_vector();
+        auto scaled_plane_normal = plane_normal / plane_normal.mag_squared();
+        alpha_dual = cross(cell_side2, scaled_plane_normal);
+        beta_dual = cross(scaled_plane_normal, cell_side1);
+        uv_scale = std::sqrt(cell_side1.mag() * cell_side2.mag());
+
+        /* The `AABB` of the whole grid; this is planar, so pad it just like a `Parallelogram`'s */
+        auto grid_side1 = static_cast<double>(num_cells1) * cell_side1;
+        auto grid_side2 = static_cast<double>(num_cells2) * cell_side2;
+        aabb = AABB::from_points({
+            corner, corner + grid_side1, corner + grid_side2, corner + grid_side1 + grid_side2
+        }).pad_thin_axes();
+    }
+};
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef IMAGE_TEXTURE_H
+#define IMAGE_TEXTURE_H
+
+#include <array>
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <string>
+#include <algorithm>  /* For `std::clamp`, `std::max`, and `std::min` */
+#include "util/image.h"
+#include "textures/texture.h"
+
+/* `MipmappedImage` stores an image for texture lookups: the image itself, and a chain of ever
+smaller copies (its mipmaps), each half the width and height of the previous one (rounded up),
+down to 1 x 1. Each copy is a box-filtered (averaged) version of the previous one, so sampling a
+small copy gives the average color over a large region of the image; this is how distant textures
+are sampled without aliasing (see `sample()`).
+
+Each copy is stored in square tiles of `TILE_SIZE` x `TILE_SIZE` texels, tile after tile, instead of
+row after row. Nearby texels (which consecutive lookups, such as the four of a bilinear lookup, and
+the lookups of neighboring rays, tend to hit) are then in the same few cache lines, whereas in a
+row-major image, texels one row apart are a whole row of the image apart in memory. The texels are
+linear-space `float`s. */
+class MipmappedImage {
+    /* `TILE_SIZE` = The side length (in texels) of the tiles. 8 x 8 texels of 3 `float`s is 768
+    bytes: 12 cache lines. */
+    static constexpr size_t TILE_SIZE = 8;
+
+    /* `Level` = One copy of the image: its width and height, and its texels, in tiles */
+    struct Level {
+        size_t w, h, tiles_per_row;
+        std::vector<std::array<float, 3>> texels;
+
+        /* Returns the index in `texels` of the texel at (row `y`, column `x`) */
+        size_t index(size_t x, size_t y) const {
+            return ((y / TILE_SIZE) * tiles_per_row + x / TILE_SIZE) * TILE_SIZE * TILE_SIZE
+                 + (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE;
+        }
+        auto& at(size_t x, size_t y) {return texels[index(x, y)];}
+        const auto& at(size_t x, size_t y) const {return texels[index(x, y)];}
+
+        /* Creates a `Level` of `w_` by `h_` black texels */
+        Level(size_t w_, size_t h_) : w{w_}, h{h_}, tiles_per_row{(w_ + TILE_SIZE - 1) / TILE_SIZE},
+            texels(tiles_per_row * ((h_ + TILE_SIZE - 1) / TILE_SIZE) * TILE_SIZE * TILE_SIZE,
+                   std::array<float, 3>{0, 0, 0}) {}
+    };
+
+    /* `levels[0]` is the image itself; `levels[i + 1]` is half the size of `levels[i]` */
+    std::vector<Level> levels;
+
+    /* Returns the bilinearly-interpolated color of the level `level` at the texture coordinates
+    (`u`, `v`), which wrap around (so the texture repeats). */
+    std::array<float, 3> bilinear(size_t level, double u, double v) const {
+        const auto &l = levels[level];
+
+        /* The texel centers are at half-integer coordinates; `v` runs from the bottom row up */
+        auto x = (u - std::floor(u)) * static_cast<double>(l.w) - 0.5;
+        auto y = (1 - (v - std::floor(v))) * static_cast<double>(l.h) - 0.5;
+        auto fx = std::floor(x), fy = std::floor(y);
+        auto tx = static_cast<float>(x - fx), ty = static_cast<float>(y - fy);
+        auto wrap = [](double coordinate, size_t size) {
+            auto i = static_cast<long long>(coordinate) % static_cast<long long>(size);
+            return static_cast<size_t>(i < 0 ? i + static_cast<long long>(size) : i);
+        };
+        auto x0 = wrap(fx, l.w), x1 = wrap(fx + 1, l.w), y0 = wrap(fy, l.h), y1 = wrap(fy + 1, l.h);
+
+        const auto &c00 = l.at(x0, y0), &c10 = l.at(x1, y0), &c01 = l.at(x0, y1),
+                   &c11 = l.at(x1, y1);
+        std::array<float, 3> ret;
+        for (size_t c = 0; c < 3; ++c) {
+            ret[c] = (1 - ty) * ((1 - tx) * c00[c] + tx * c10[c])
+                   + ty * ((1 - tx) * c01[c] + tx * c11[c]);
+        }
+        return ret;
+    }
+
+public:
+
+    /* Returns the number of bytes used by the texels of every level. */
+    size_t memory_bytes() const {
+        size_t ret = levels.capacity() * sizeof(Level);
+        for (const auto &level : levels) {
+            ret += level.texels.capacity() * sizeof(level.texels[0]);
+        }
+        return ret;
+    }
+
+    auto width() const {return levels[0].w;}
+    auto height() const {return levels[0].h;}
+    auto num_levels() const {return levels.size();}
+
+    /* Returns the color of this image at the texture coordinates (`u`, `v`) ((0, 0) is the
+    bottom-left corner and (1, 1) the top-right corner; outside of that, the image repeats),
+    averaged over a region about `footprint` units of texture coordinates wide. The mipmap level
+    whose texels are about `footprint` wide is chosen, and the bilinear lookups in the two nearest
+    levels are blended (trilinear filtering). A `footprint` of 0 samples the full-resolution image
+    bilinearly. */
+    RGB sample(double u, double v, double footprint = 0) const {
+        auto max_level = static_cast<double>(levels.size() - 1);
+        auto lod = (footprint > 0
+                    ? std::clamp(std::log2(footprint * static_cast<double>(std::max(width(),
+                                                                                    height()))),
+                                 0., max_level)
+                    : 0.);
+        auto level = static_cast<size_t>(lod);
+        auto color = bilinear(level, u, v);
+        if (auto t = static_cast<float>(lod - static_cast<double>(level)); t > 0) {
+            auto next = bilinear(level + 1, u, v);
+            for (size_t c = 0; c < 3; ++c) {
+                color[c] += t * (next[c] - color[c]);
+            }
+        }
+        return RGB::from_mag(color[0], color[1], color[2]);
+    }
+
+    /* Constructs the `MipmappedImage` of `img`, whose colors are taken to be linear (as rendered
+    by a `Camera`, before gamma correction). */
+    MipmappedImage(const Image &img) {
+        levels.emplace_back(img.width(), img.height());
+        for (size_t y = 0; y < img.height(); ++y) {
+            for (size_t x = 0; x < img.width(); ++x) {
+                const auto &p = img[y][x];
+                levels[0].at(x, y) = {static_cast<float>(p.r), static_cast<float>(p.g),
+                                      static_cast<float>(p.b)};
+            }
+        }
+
+        /* Each texel of the next level averages (up to) 2 x 2 texels of the previous level */
+        while (levels.back().w > 1 || levels.back().h > 1) {
+            const auto &prev = levels.back();
+            Level next((prev.w + 1) / 2, (prev.h + 1) / 2);
+            for (size_t y = 0; y < next.h; ++y) {
+                for (size_t x = 0; x < next.w; ++x) {
+                    std::array<float, 3> sum{0, 0, 0};
+                    float count = 0;
+                    for (size_t py = 2 * y; py < std::min(2 * y + 2, prev.h); ++py) {
+                        for (size_t px = 2 * x; px < std::min(2 * x + 2, prev.w); ++px) {
+                            for (size_t c = 0; c < 3; ++c) {sum[c] += prev.at(px, py)[c];}
+                            ++count;
+                        }
+                    }
+                    for (size_t c = 0; c < 3; ++c) {next.at(x, y)[c] = sum[c] / count;}
+                }
+            }
+            levels.push_back(std::move(next));
+        }
+    }
+
+    /* Creates the `MipmappedImage` of the PPM file with name `file_name`. PPM files store
+    gamma-corrected colors, so they are converted back to linear colors with the gamma `gamma` (2
+    by default, which is what `Image::send_as_ppm()` writes). */
+    static auto from_ppm_file(const std::string &file_name, double gamma = 2) {
+        auto img = Image::from_ppm_file(file_name);
+        for (size_t row = 0; row < img.height(); ++row) {
+            for (auto &p : img[row]) {
+                p = RGB::from_mag(std::pow(p.r, gamma), std::pow(p.g, gamma), std::pow(p.b, gamma));
+            }
+        }
+        return MipmappedImage(img);
+    }
+};
+
+/* `ImageTexture` is a surface texture that maps an image onto a surface by its texture coordinates
+(see `hit_info::u` and `hit_info::v`), filtered according to how much of the surface the ray sees
+(see `MipmappedImage::sample()`). */
+class ImageTexture : public Texture {
+    std::shared_ptr<const MipmappedImage> image;
+    /* `repeats` = How many times the image repeats across each unit of texture coordinates */
+    double repeats;
+
+public:
+
+    RGB value(const hit_info &info) const override {
+        return image->sample(repeats * info.u, repeats * info.v, repeats * info.uv_footprint);
+    }
+
+    /* Counts the memory used by this `ImageTexture`, and by its texels (which may be shared with
+    other `ImageTexture`s), in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        if (report.add_shared_object(MemoryCategory::MATERIALS, this, sizeof(*this))) {
+            if (report.first_visit(image.get())) {
+                report.add(MemoryCategory::IMAGES, image->memory_bytes());
+            }
+        }
+    }
+
+    /* Prints this `ImageTexture` to the `std::ostream` specified by `os`. */
+    void print_to(std::ostream &os) const override {
+        os << "ImageTexture {" << image->width() << " x " << image->height() << " image, "
+           << image->num_levels() << " mipmap levels, repeats: " << repeats << "} " << std::flush;
+    }
+
+    /* Constructs an `ImageTexture` of the image `image_` (which may be shared among several
+    textures), repeated `repeats_` times across each unit of texture coordinates (1 by default). */
+    ImageTexture(std::shared_ptr<const MipmappedImage> image_, double repeats_ = 1)
+        : image{std::move(image_)}, repeats{repeats_} {}
+};
+
+#endif
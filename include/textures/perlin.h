@@ -0,0 +1,157 @@
+#ifndef PERLIN_H
+#define PERLIN_H
+
+#include <array>
+#include <cmath>
+#include <numeric>  /* For `std::iota` */
+#include <cstdint>
+#include "util/rand_util.h"
+#include "textures/texture.h"
+
+/* `PerlinNoise` generates Perlin (gradient) noise: a smooth, random-looking function of 3D space,
+which varies on the scale of 1 unit. A random unit gradient is attached to every point of the
+integer lattice; the noise at a point blends the dot products of the gradients at the 8 corners of
+its lattice cell with the offsets from those corners, weighted by a smooth (Hermite) function of
+the distance to each corner. See "Ray Tracing: The Next Week", and "Improving Noise" (Perlin 2002).
+
+The noise is evaluated in batches by `noise()`, in a loop over the points that the compiler can
+vectorize: every step is branch-free arithmetic or a table lookup, and the tables are small enough
+to stay in L1 cache. `turbulence()` sums several octaves of noise, which are evaluated as a single
+batch. */
+class PerlinNoise {
+    static constexpr size_t NUM_POINTS = 256;
+    /* `gradient_x/y/z[i]` = The components of the `i`th random unit gradient (planar arrays, so
+    that the batched lookups vectorize) */
+    std::array<double, NUM_POINTS> gradient_x, gradient_y, gradient_z;
+    /* `perm_x/y/z` = Random permutations of [0, `NUM_POINTS`), which hash the integer lattice
+    coordinates to the index of a gradient */
+    std::array<uint8_t, NUM_POINTS> perm_x, perm_y, perm_z;
+
+public:
+
+    /* `MAX_BATCH` = The most points `noise()` evaluates at once; `turbulence()` can sum at most
+    this many octaves. */
+    static constexpr size_t MAX_BATCH = 16;
+
+    /* Evaluates the noise at the `n` (at most `MAX_BATCH`) points (`xs[i]`, `ys[i]`, `zs[i]`), and
+    writes the results (each within [-1, 1]) to `out[i]`. */
+    void noise(const double *xs, const double *ys, const double *zs, double *out, size_t n) const {
+        #pragma omp simd
+        for (size_t lane = 0; lane < n; ++lane) {
+            auto fx = std::floor(xs[lane]), fy = std::floor(ys[lane]), fz = std::floor(zs[lane]);
+            auto u = xs[lane] - fx, v = ys[lane] - fy, w = zs[lane] - fz;
+            auto i = static_cast<int64_t>(fx), j = static_cast<int64_t>(fy),
+                 k = static_cast<int64_t>(fz);
+
+            /* Hermite smoothing of the offsets within the cell, for smooth blending */
+            auto uu = u * u * (3 - 2 * u), vv = v * v * (3 - 2 * v), ww = w * w * (3 - 2 * w);
+
+            double sum = 0;
+            for (int64_t di = 0; di < 2; ++di) {
+                for (int64_t dj = 0; dj < 2; ++dj) {
+                    for (int64_t dk = 0; dk < 2; ++dk) {
+                        auto index = perm_x[static_cast<size_t>((i + di) & 255)]
+                                   ^ perm_y[static_cast<size_t>((j + dj) & 255)]
+                                   ^ perm_z[static_cast<size_t>((k + dk) & 255)];
+                        auto ox = u - static_cast<double>(di), oy = v - static_cast<double>(dj),
+                             oz = w - static_cast<double>(dk);
+                        auto weight = (di ? uu : 1 - uu) * (dj ? vv : 1 - vv)
+                                    * (dk ? ww : 1 - ww);
+                        sum += weight * (gradient_x[index] * ox + gradient_y[index] * oy
+                                         + gradient_z[index] * oz);
+                    }
+                }
+            }
+            out[lane] = sum;
+        }
+    }
+
+    /* Returns the noise at the point `p`. */
+    double noise(const Point3D &p) const {
+        double out;
+        noise(&p.x, &p.y, &p.z, &out, 1);
+        return out;
+    }
+
+    /* Returns the turbulence at the point `p`: the absolute value of the sum of `octaves` (at most
+    `MAX_BATCH`) octaves of noise, where each octave has twice the frequency and half the amplitude
+    of the previous one. */
+    double turbulence(const Point3D &p, size_t octaves = 7) const {
+        std::array<double, MAX_BATCH> xs, ys, zs, out;
+        octaves = std::min(octaves, MAX_BATCH);
+        double frequency = 1;
+        for (size_t i = 0; i < octaves; ++i) {
+            xs[i] = frequency * p.x;
+            ys[i] = frequency * p.y;
+            zs[i] = frequency * p.z;
+            frequency *= 2;
+        }
+        noise(xs.data(), ys.data(), zs.data(), out.data(), octaves);
+
+        double sum = 0, amplitude = 1;
+        for (size_t i = 0; i < octaves; ++i) {
+            sum += amplitude * out[i];
+            amplitude /= 2;
+        }
+        return std::fabs(sum);
+    }
+
+    /* Constructs `PerlinNoise` whose gradients and permutations are drawn from the counter-based
+    random stream `seed`, so that the same seed always gives the same noise. */
+    PerlinNoise(uint64_t seed) {
+        CounterRNG rng(seed, 0);
+        for (size_t i = 0; i < NUM_POINTS; ++i) {
+            /* Rejection-sample a direction uniformly from the unit sphere */
+            Vec3D g;
+            do {
+                g = Vec3D{rng.rand_double(-1, 1), rng.rand_double(-1, 1), rng.rand_double(-1, 1)};
+            } while (g.mag_squared() > 1 || g.mag_squared() < 1e-6);
+            g = g.unit_vector();
+            gradient_x[i] = g.x;
+            gradient_y[i] = g.y;
+            gradient_z[i] = g.z;
+        }
+        for (auto *perm : {&perm_x, &perm_y, &perm_z}) {
+            std::iota(perm->begin(), perm->end(), uint8_t{0});
+            for (size_t i = NUM_POINTS - 1; i > 0; --i) {  /* Fisher-Yates shuffle */
+                std::swap((*perm)[i], (*perm)[static_cast<size_t>(
+                    rng.rand_int(0, static_cast<int>(i))
+                )]);
+            }
+        }
+    }
+};
+
+/* `NoiseTexture` is a spatial (solid) marble-like texture: `color` modulated by stripes along the
+z-axis (`scale` stripes per 2 pi units), which are distorted by turbulence. See `PerlinNoise`. */
+class NoiseTexture : public Texture {
+    PerlinNoise noise;
+    double scale;
+    RGB color;
+
+public:
+
+    RGB value(const hit_info &info) const override {
+        const auto &p = info.hit_point;
+        auto stripes = 0.5 * (1 + std::sin(scale * p.z + 10 * noise.turbulence(p)));
+        return stripes * color;
+    }
+
+    /* Counts the memory used by this `NoiseTexture` (including its noise tables) in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        report.add_shared_object(MemoryCategory::MATERIALS, this, sizeof(*this));
+    }
+
+    /* Prints this `NoiseTexture` to the `std::ostream` specified by `os`. */
+    void print_to(std::ostream &os) const override {
+        os << "NoiseTexture {scale: " << scale << ", color: " << color.as_string(", ", "()")
+           << "} " << std::flush;
+    }
+
+    /* Constructs a `NoiseTexture` with stripes of frequency `scale_` and color `color_`, whose
+    noise is generated from the seed `seed`. */
+    NoiseTexture(double scale_, const RGB &color_ = RGB::from_mag(1), uint64_t seed = 0)
+        : noise(seed), scale{scale_}, color{color_} {}
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <cmath>
+#include <memory>
+#include <iostream>
+#include "util/rgb.h"
+#include "base/hittable.h"
+
+/* `Texture` is the interface for colors that vary over a surface (such as the intrinsic color of
+a `Lambertian`; see `Lambertian(std::shared_ptr<Texture>)`). Surface textures look the color up
+by the texture coordinates (`hit_info::u` and `hit_info::v`) of the hit point, and spatial
+(solid) textures by the hit point itself. */
+struct Texture {
+    /* Returns the color of this `Texture` at the hit described by `info`. */
+    virtual RGB value(const hit_info &info) const = 0;
+
+    /* Counts the memory used by this `Texture` in `report` (see `MemoryReport`). Every `Texture`
+    type overrides this; this default counts just the base class. */
+    virtual void report_memory(MemoryReport &report) const {
+        report.add_shared_object(MemoryCategory::MATERIALS, this, sizeof(*this));
+    }
+
+    /* Prints this `Texture` to the `std::ostream` specified by `os`. */
+    virtual void print_to(std::ostream &os) const = 0;
+
+    virtual ~Texture() = default;
+};
+
+/* Overload `operator<<` for `Texture` to allow printing it to output streams */
+std::ostream& operator<< (std::ostream &os, const Texture &texture) {
+    texture.print_to(os);
+    return os;
+}
+
+/* `ConstantTexture` is the same color everywhere. (A `Lambertian` with a constant color does not
+need one; it is for composing textures, like the squares of a `CheckerTexture`.) */
+class ConstantTexture : public Texture {
+    RGB color;
+
+public:
+
+    RGB value(const hit_info &) const override {
+        return color;
+    }
+
+    /* Counts the memory used by this `ConstantTexture` in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        report.add_shared_object(MemoryCategory::MATERIALS, this, sizeof(*this));
+    }
+
+    /* Prints this `ConstantTexture` to the `std::ostream` specified by `os`. */
+    void print_to(std::ostream &os) const override {
+        os << "ConstantTexture {color: " << color.as_string(", ", "()") << "} " << std::flush;
+    }
+
+    /* Constructs a `ConstantTexture` of the color `color_`. */
+    ConstantTexture(const RGB &color_) : color{color_} {}
+};
+
+/* `CheckerTexture` is a spatial (solid) texture: space is divided into cubes of side length
+`scale`, which alternate between two textures like the squares of a 3D checkerboard. Because it
+only depends on the hit point, it needs no texture coordinates, and it lines up seamlessly across
+objects. */
+class CheckerTexture : public Texture {
+    /* `inverse_scale` = 1 / the side length of the cubes */
+    double inverse_scale;
+    std::shared_ptr<Texture> even, odd;
+
+public:
+
+    RGB value(const hit_info &info) const override {
+        auto x = static_cast<long long>(std::floor(inverse_scale * info.hit_point.x));
+        auto y = static_cast<long long>(std::floor(inverse_scale * info.hit_point.y));
+        auto z = static_cast<long long>(std::floor(inverse_scale * info.hit_point.z));
+        return ((x + y + z) % 2 == 0 ? even : odd)->value(info);
+    }
+
+    /* Counts the memory used by this `CheckerTexture` and its two textures in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        if (report.add_shared_object(MemoryCategory::MATERIALS, this, sizeof(*this))) {
+            even->report_memory(report);
+            odd->report_memory(report);
+        }
+    }
+
+    /* Prints this `CheckerTexture` to the `std::ostream` specified by `os`. */
+    void print_to(std::ostream &os) const override {
+        os << "CheckerTexture {scale: " << 1 / inverse_scale << ", even: " << *even << ", odd: "
+           << *odd << "} " << std::flush;
+    }
+
+    /* Constructs a `CheckerTexture` of cubes with side length `scale`, alternating between the
+    textures `even_` and `odd_`. */
+    CheckerTexture(double scale, std::shared_ptr<Texture> even_, std::shared_ptr<Texture> odd_)
+        : inverse_scale{1 / scale}, even{std::move(even_)}, odd{std::move(odd_)} {}
+
+    /* Constructs a `CheckerTexture` of cubes with side length `scale`, alternating between the
+    colors `even_` and `odd_`. */
+    CheckerTexture(double scale, const RGB &even_, const RGB &odd_)
+        : CheckerTexture(scale, std::make_shared<ConstantTexture>(even_),
+                         std::make_shared<ConstantTexture>(odd_)) {}
+};
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef AOV_BUFFERS_H
+#define AOV_BUFFERS_H
+
+#include <array>
+#include <algorithm>  /* For `std::max` */
+#include <cmath>
+#include <vector>
+#include <string>
+#include "util/rgb.h"
+#include "util/pfm.h"
+#include "math/vec3d.h"
+
+/* `AOV` = An arbitrary output variable: a per-pixel quantity, other than the final color, that is
+recorded while rendering. Combine them with `|` to choose which ones `AOVBuffers` saves. */
+enum class AOV : unsigned {
+    /* `ALBEDO` = The albedo (see `Material::albedo()`) of the first surface each sample hits, or
+    the background color for samples that hit nothing; averaged over the samples of the pixel. */
+    ALBEDO = 1,
+    /* `NORMAL` = The unit surface normal (facing the camera ray) at the first surface each sample
+    hits, averaged over the samples of the pixel that hit something and normalized again; (0, 0, 0)
+    if no sample hits anything. */
+    NORMAL = 2,
+    /* `DEPTH` = The distance from the camera to the first surface each sample hits, averaged over
+    the samples of the pixel that hit something; 0 if no sample hits anything. */
+    DEPTH = 4,
+    /* `MATERIAL_ID` = The id (see `Material::id`) of the material of the first surface hit by the
+    first sample of the pixel that hits anything; -1 if no sample hits anything. */
+    MATERIAL_ID = 8,
+    /* `SAMPLE_COUNT` = The number of samples taken of the pixel. */
+    SAMPLE_COUNT = 16,
+    /* `VARIANCE` = The variance of the pixel's color estimate (the mean of its samples), measured
+    in luminance: the sample variance of the luminances of its samples, divided by their number.
+    This tells a denoiser how noisy each pixel is. */
+    VARIANCE = 32,
+    ALL = 63
+};
+
+/* Combines the sets of AOVs `a` and `b` */
+constexpr auto operator| (AOV a, AOV b) {
+    return static_cast<AOV>(static_cast<unsigned>(a) | static_cast<unsigned>(b));
+}
+
+/* Returns whether the set of AOVs `a` includes any of the AOVs `b` */
+constexpr auto operator& (AOV a, AOV b) {
+    return (static_cast<unsigned>(a) & static_cast<unsigned>(b)) != 0;
+}
+
+/* `AOVSample` = What one camera ray hit first: the AOVs of one sample. Filled in by
+`Camera::ray_color()` when requested. */
+struct AOVSample {
+    /* `hit` = Whether the ray hit anything. The other members (except `albedo`, which is then the
+    background color) are only meaningful if it did. */
+    bool hit = false;
+    RGB albedo = RGB::zero();
+    Vec3D normal = Vec3D::zero();
+    double distance = 0;
+    size_t material_id = 0;
+    /* `luminance` = The luminance of the color of the sample (filled in by the `Camera` once the
+    whole path has been traced) */
+    double luminance = 0;
+};
+
+/* `AOVBuffers` stores the AOVs of every pixel of a render (see `Camera::render(world, aovs)`),
+accumulated in the same pass as the colors of the pixels, and saves the chosen ones as PFM files.
+All AOVs are accumulated regardless of which are chosen, because that costs little next to tracing
+the rays; the choice only determines which files `save_as_pfm()` writes. */
+class AOVBuffers {
+    /* `Pixel` = The running sums of the AOVs of one pixel's samples, and then (after `average()`)
+    their averages. */
+    struct Pixel {
+        RGB albedo = RGB::zero();
+        Vec3D normal;
+        double depth = 0;
+        double material_id = -1;
+        /* The sum of the luminances of the samples and of their squares; after `average()`,
+        `variance` is the variance of the mean and `luminance_squared` is unused */
+        double luminance = 0, luminance_squared = 0, variance = 0;
+        size_t hits = 0, samples = 0;
+    };
+
+    AOV chosen;
+    size_t w = 0, h = 0;
+    std::vector<Pixel> pixels;
+
+    /* Writes the AOV of every pixel given by `get` (which returns `CHANNELS` floats for a `Pixel`)
+    to the PFM file with name `file_name`. */
+    template <size_t CHANNELS, typename Getter>
+    void save_channel(const std::string &file_name, Getter get) const {
+        std::vector<float> data;
+        data.reserve(pixels.size() * CHANNELS);
+        for (const auto &pixel : pixels) {
+            auto values = get(pixel);
+            data.insert(data.end(), values.begin(), values.end());
+        }
+        write_pfm(file_name, w, h, CHANNELS, data);
+    }
+
+public:
+
+    auto width() const {return w;}
+    auto height() const {return h;}
+    auto aovs() const {return chosen;}
+
+    /* Returns the albedo, normal, depth, material id, sample count, and variance of the pixel at
+    (row `row`, column `col`). These are only averages after `average()` has been called. */
+    auto albedo(size_t row, size_t col) const {return pixels[row * w + col].albedo;}
+    auto normal(size_t row, size_t col) const {return pixels[row * w + col].normal;}
+    auto depth(size_t row, size_t col) const {return pixels[row * w + col].depth;}
+    auto material_id(size_t row, size_t col) const {return pixels[row * w + col].material_id;}
+    auto sample_count(size_t row, size_t col) const {return pixels[row * w + col].samples;}
+    auto variance(size_t row, size_t col) const {return pixels[row * w + col].variance;}
+
+    /* Clears the buffers, and resizes them to `width` by `height` pixels. Called by the `Camera`
+    before rendering into these buffers. */
+    void reset(size_t width, size_t height) {
+        w = width;
+        h = height;
+        pixels.assign(w * h, Pixel{});
+    }
+
+    /* Adds the AOVs `sample` of one sample to the pixel at (row `row`, column `col`). Different
+    pixels may be added to concurrently, but the samples of each pixel must be added in order. */
+    void add_sample(size_t row, size_t col, const AOVSample &sample) {
+        auto &pixel = pixels[row * w + col];
+        pixel.albedo += sample.albedo;
+        pixel.luminance += sample.luminance;
+        pixel.luminance_squared += sample.luminance * sample.luminance;
+        ++pixel.samples;
+        if (sample.hit) {
+            pixel.normal += sample.normal;
+            pixel.depth += sample.distance;
+            if (pixel.hits++ == 0) {
+                pixel.material_id = static_cast<double>(sample.material_id);
+            }
+        }
+    }
+
+    /* Turns the sums of the AOVs of every pixel into their averages. Called by the `Camera` after
+    all samples have been added. */
+    void average() {
+        for (auto &pixel : pixels) {
+            if (pixel.samples > 0) {
+                auto n = static_cast<double>(pixel.samples);
+                pixel.albedo /= n;
+                /* The unbiased sample variance, divided by `n` again for the variance of the mean;
+                with a single sample there is no estimate, so assume the worst */
+                auto mean = pixel.luminance / n;
+                pixel.variance = (pixel.samples > 1
+                    ? std::max(0., pixel.luminance_squared - n * mean * mean) / ((n - 1) * n)
+                    : mean * mean);
+            }
+            if (pixel.hits > 0) {
+                pixel.depth /= static_cast<double>(pixel.hits);
+                if (auto mag = pixel.normal.mag(); mag > 0) {
+                    pixel.normal /= mag;
+                }
+            }
+        }
+    }
+
+    /* Saves each chosen AOV to its own PFM file, named `prefix` followed by "_albedo.pfm",
+    "_normal.pfm", "_depth.pfm", "_material_id.pfm", "_sample_count.pfm", or "_variance.pfm". The
+    albedo and normal files have 3 channels (the normals' x, y, and z components in world space);
+    the others have 1. */
+    void save_as_pfm(const std::string &prefix) const {
+        auto f = [](double d) {return static_cast<float>(d);};
+        if (chosen & AOV::ALBEDO) {
+            save_channel<3>(prefix + "_albedo.pfm", [&](const Pixel &p) {
+                return std::array{f(p.albedo.r), f(p.albedo.g), f(p.albedo.b)};
+            });
+        }
+        if (chosen & AOV::NORMAL) {
+            save_channel<3>(prefix + "_normal.pfm", [&](const Pixel &p) {
+                return std::array{f(p.normal.x), f(p.normal.y), f(p.normal.z)};
+            });
+        }
+        if (chosen & AOV::DEPTH) {
+            save_channel<1>(prefix + "_depth.pfm", [&](const Pixel &p) {
+                return std::array{f(p.depth)};
+            });
+        }
+        if (chosen & AOV::MATERIAL_ID) {
+            save_channel<1>(prefix + "_material_id.pfm", [&](const Pixel &p) {
+                return std::array{f(p.material_id)};
+            });
+        }
+        if (chosen & AOV::SAMPLE_COUNT) {
+            save_channel<1>(prefix + "_sample_count.pfm", [&](const Pixel &p) {
+                return std::array{f(static_cast<double>(p.samples))};
+            });
+        }
+        if (chosen & AOV::VARIANCE) {
+            save_channel<1>(prefix + "_variance.pfm", [&](const Pixel &p) {
+                return std::array{f(p.variance)};
+            });
+        }
+    }
+
+    /* Constructs empty `AOVBuffers`, which will save the AOVs `chosen_` (all by default). */
+    AOVBuffers(AOV chosen_ = AOV::ALL) : chosen{chosen_} {}
+};
+
+#endif
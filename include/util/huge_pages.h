@@ -0,0 +1,149 @@
+#ifndef HUGE_PAGES_H
+#define HUGE_PAGES_H
+
+#include <new>      /* For `std::align_val_t` */
+#include <atomic>
+#include <string>
+#include <limits>
+#include <cstdint>
+#include <fstream>
+#include <cstddef>
+#include <type_traits>  /* For `std::true_type` and `std::false_type` */
+#ifdef __linux__
+#include <sys/mman.h>  /* For `madvise()` */
+#endif
+
+/* `HugePages` allocates large arrays (such as the nodes of a `BVH`, and the blocks of a
+`SceneArena`) from 2 MiB transparent huge pages, when enabled with `HugePages::set_enabled()`.
+
+A traversal of a large `BVH` reads nodes all over hundreds of megabytes of memory in random order,
+so with ordinary 4 KiB pages almost every node read misses the TLB (the processor's cache of the
+page table, which only covers a few megabytes of 4 KiB pages), and pays for a walk of the page
+table. A 2 MiB page covers 512 times as much memory with a single TLB entry.
+
+On Linux, memory allocated with `allocate()` is aligned to 2 MiB, rounded up to a multiple of
+2 MiB, and marked with `madvise(MADV_HUGEPAGE)` before it is first touched, so that the kernel
+backs it with huge pages when it is touched (if transparent huge pages are set to "always" or
+"madvise" in `/sys/kernel/mm/transparent_hugepage/enabled`). Wherever that is not possible (on
+other platforms, if huge pages are disabled, or if the kernel has no free huge pages), the memory
+is simply backed by ordinary pages, so nothing else changes. Allocations smaller than a huge page
+always use ordinary pages. */
+class HugePages {
+    static auto& enabled_flag() {
+        static std::atomic<bool> flag{false};
+        return flag;
+    }
+
+    /* Marks the whole huge pages within the `bytes` bytes at `p` with `MADV_HUGEPAGE`. */
+    static void advise_always([[maybe_unused]] void *p, [[maybe_unused]] size_t bytes) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        auto first = round_up(reinterpret_cast<uintptr_t>(p));
+        auto last = (reinterpret_cast<uintptr_t>(p) + bytes) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        if (first < last) {
+            /* A failure (such as when huge pages are not supported) just leaves ordinary pages */
+            madvise(reinterpret_cast<void*>(first), last - first, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+public:
+
+    /* `HUGE_PAGE_SIZE` = The size of a transparent huge page on x86-64 (and most ARM64) Linux */
+    static constexpr size_t HUGE_PAGE_SIZE = size_t{2} << 20;
+
+    /* Returns `bytes` rounded up to a multiple of `HUGE_PAGE_SIZE`. */
+    static size_t round_up(size_t bytes) {
+        return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    }
+
+    /* Returns whether large arrays allocated from now on are backed by huge pages. */
+    static bool enabled() {return enabled_flag().load(std::memory_order_relaxed);}
+    /* Sets whether large arrays allocated from now on are backed by huge pages (off by default).
+    Arrays that are already allocated keep their pages. */
+    static void set_enabled(bool enabled_) {enabled_flag().store(enabled_);}
+
+    /* Returns whether `allocate(bytes, alignment, huge)` backs its memory with huge pages. */
+    static bool backs_with_huge_pages(size_t bytes, bool huge) {
+        return huge && bytes >= HUGE_PAGE_SIZE;
+    }
+
+    /* Returns `bytes` bytes of memory aligned to `alignment`, which are backed by huge pages if
+    `huge` is true (usually `enabled()`) and `bytes` is at least `HUGE_PAGE_SIZE`. The memory must
+    be freed by `deallocate()` with the same arguments. */
+    static void* allocate(size_t bytes, size_t alignment, bool huge) {
+        if (!backs_with_huge_pages(bytes, huge)) {
+            return ::operator new(bytes, std::align_val_t{alignment});
+        }
+        auto ret = ::operator new(round_up(bytes), std::align_val_t{HUGE_PAGE_SIZE});
+        advise_always(ret, round_up(bytes));
+        return ret;
+    }
+    static void deallocate(void *p, size_t bytes, size_t alignment, bool huge) {
+        if (!backs_with_huge_pages(bytes, huge)) {
+            ::operator delete(p, std::align_val_t{alignment});
+            return;
+        }
+        ::operator delete(p, std::align_val_t{HUGE_PAGE_SIZE});
+    }
+
+    /* Asks the kernel to back the whole huge pages within the `bytes` bytes at `p` with huge
+    pages, if huge pages are enabled (see `set_enabled()`). This is for arrays that were not
+    allocated by `allocate()`; it is most effective before the memory is first touched (later,
+    the kernel may only gather the memory into huge pages in the background). */
+    static void advise(void *p, size_t bytes) {
+        if (enabled()) {
+            advise_always(p, bytes);
+        }
+    }
+
+    /* Returns the number of bytes of this process that are backed by transparent huge pages right
+    now (0 if unknown). */
+    static size_t resident_bytes() {
+        std::ifstream fin("/proc/self/smaps_rollup");
+        for (std::string field; fin >> field;) {
+            if (field == "AnonHugePages:") {
+                size_t kilobytes = 0;
+                fin >> kilobytes;
+                return kilobytes * 1024;
+            }
+            fin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+        return 0;
+    }
+};
+
+/* `HugePageAllocator<T>` = The allocator (in the sense of the standard library) that allocates
+arrays of `T` with `HugePages::allocate()`, for `std::vector`s that can grow large, such as
+`BVH::linear_bvh_nodes`. Whether it uses huge pages is decided when it is constructed (by
+`HugePages::enabled()`), and is kept by its copies, such as in a copy of its `std::vector`. */
+template <typename T>
+class HugePageAllocator {
+    template <typename U>
+    friend class HugePageAllocator;
+
+    bool huge = HugePages::enabled();
+
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(HugePages::allocate(n * sizeof(T), alignof(T), huge));
+    }
+    void deallocate(T *p, size_t n) {
+        HugePages::deallocate(p, n * sizeof(T), alignof(T), huge);
+    }
+
+    template <typename U>
+    bool operator== (const HugePageAllocator<U> &other) const {return huge == other.huge;}
+
+    HugePageAllocator() = default;
+
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U> &other) : huge{other.huge} {}
+};
+
+#endif
@@ -7,7 +7,9 @@
 #include <vector>
 #include <string>
 #include <cstdlib>  /* For std::exit() */
+#include <algorithm>  /* For `std::copy` */
 #include "util/rgb.h"
+#include "util/pfm.h"
 #include "util/progressbar.h"
 
 /* The `Image` type encapsulates a 2D image as a 2D array of `RGB` pixels. It is appropriate for
@@ -26,6 +28,20 @@ class Image {
     Image(const std::vector<std::vector<RGB>> &pixels_) : w{pixels_[0].size()}, h{pixels_.size()},
                                                           pixels{pixels_} {}
 
+    /* Exits with an error if a `width` by `height` region does not fit in this `Image` with its
+    top-left pixel at (row `row`, column `col`). `caller` is the name of the function to blame in
+    the error message. */
+    void check_region_fits(size_t col, size_t row, size_t width, size_t height,
+                           const std::string &caller) const {
+        if (width == 0 || height == 0 || col + width > w || row + height > h) {
+            std::cout << "Error: In Image::" << caller << "(), the " << width << " x "
+                      << height << " region with top-left pixel (row " << row << ", column "
+                      << col << ") is empty or does not fit in the " << w << " x " << h
+                      << " image" << std::endl;
+            std::exit(-1);
+        }
+    }
+
 public:
     auto width() const {return w;}
     auto height() const {return h;}
@@ -34,25 +50,74 @@ public:
 
     auto aspect_ratio() const {return static_cast<double>(w) / static_cast<double>(h);}
 
-    /* Prints this `Image` in PPM format to the file with name specified by `destination`. */
+    /* Allocates the row `row` of this `Image` (created by `with_unallocated_rows()`), with every
+    pixel black, from the calling thread. */
+    void allocate_row(size_t row) {
+        pixels[row].assign(w, RGB::zero());
+    }
+
+    /* Returns the number of bytes used by the pixels of this `Image` (see `MemoryReport`). */
+    size_t memory_bytes() const {
+        size_t ret = sizeof(*this) + pixels.capacity() * sizeof(pixels[0]);
+        for (const auto &row : pixels) {
+            ret += row.capacity() * sizeof(RGB);
+        }
+        return ret;
+    }
+
+    /* Prints this `Image` in PPM format to the file with name specified by `destination`. If
+    `QUIET` is true, nothing is printed to `std::cout` (except errors), which is useful when the
+    image is saved in the background while something else reports its own progress. */
+    template <bool QUIET = false>
     void send_as_ppm(const std::string &destination) const {
-        if (std::ofstream fout(destination); !fout.is_open()) {
-            std::cout << "Error: In Image::print_as_ppm(), could not open the file \""
+        if (!try_send_as_ppm<QUIET>(destination)) {
+            std::cout << "Error: In Image::print_as_ppm(), could not write the file \""
                       << destination << "\"" << std::endl;
             std::exit(-1);
-        } else {
-            /* See https://en.wikipedia.org/wiki/Netpbm#PPM_example */
-            fout << "P3\n" << w << " " << h << "\n255\n";
-            ProgressBar pb(h, "Storing PPM image to " + destination);
-            for (size_t row = 0; row < h; ++row) {
-                for (size_t col = 0; col < w; ++col) {
-                    fout << pixels[row][col].as_string() << '\n';
-                }
-                pb.complete_iteration();
+        }
+    }
+
+    /* Like `send_as_ppm()`, but returns `false` (printing nothing) if the file `destination`
+    could not be opened or written, instead of exiting; for long-running processes, such as a
+    `RenderServer`, that must survive a bad output path. Returns `true` on success. */
+    template <bool QUIET = false>
+    bool try_send_as_ppm(const std::string &destination) const {
+        std::ofstream fout(destination);
+        if (!fout.is_open()) {
+            return false;
+        }
+        /* See https://en.wikipedia.org/wiki/Netpbm#PPM_example */
+        fout << "P3\n" << w << " " << h << "\n255\n";
+        ProgressBar<QUIET> pb(h, "Storing PPM image to " + destination);
+        for (size_t row = 0; row < h; ++row) {
+            for (size_t col = 0; col < w; ++col) {
+                fout << pixels[row][col].as_string() << '\n';
             }
+            pb.complete_iteration();
+        }
+        if (!fout.flush()) {
+            return false;
+        }
 
+        if constexpr (!QUIET) {
             std::cout << "Image successfully saved to \"" << destination << "\"" << std::endl;
         }
+        return true;
+    }
+
+    /* Saves this `Image` to the PFM file with name `destination`. Unlike `send_as_ppm()`, this
+    keeps the exact linear colors (no clamping, tone mapping, or gamma correction), as 32-bit
+    floats; use it for images that are processed further, such as by a denoiser. */
+    void send_as_pfm(const std::string &destination) const {
+        std::vector<float> data;
+        data.reserve(w * h * 3);
+        for (const auto &row : pixels) {
+            for (const auto &pixel : row) {
+                data.insert(data.end(), {static_cast<float>(pixel.r), static_cast<float>(pixel.g),
+                                         static_cast<float>(pixel.b)});
+            }
+        }
+        write_pfm(destination, w, h, 3, data);
     }
 
     auto& outline_border() {
@@ -67,6 +132,45 @@ public:
         return *this;
     }
 
+    /* Copies the pixels of `region` into this `Image`, with the top-left pixel of `region` going
+    to (row `row`, column `col`). `region` must fit in this `Image` at that position. Useful for
+    merging the result of rendering a crop window (see `Camera::set_crop_window()`) back into the
+    full image; for instance, to re-render a problem area with more samples. */
+    auto& paste(const Image &region, size_t col, size_t row) {
+        check_region_fits(col, row, region.w, region.h, "paste");
+        for (size_t r = 0; r < region.h; ++r) {
+            std::copy(region.pixels[r].begin(), region.pixels[r].end(),
+                      pixels[row + r].begin() + static_cast<std::ptrdiff_t>(col));
+        }
+        return *this;
+    }
+
+    /* Adds the pixels of `region` to the pixels of this `Image`, with the top-left pixel of
+    `region` being added to (row `row`, column `col`). `region` must fit in this `Image` at that
+    position. Useful for accumulating sums of samples (see `Camera::render_sample_sums()`) that
+    were rendered separately. */
+    auto& add_region(const Image &region, size_t col, size_t row) {
+        check_region_fits(col, row, region.w, region.h, "add_region");
+        for (size_t r = 0; r < region.h; ++r) {
+            for (size_t c = 0; c < region.w; ++c) {
+                pixels[row + r][col + c] += region.pixels[r][c];
+            }
+        }
+        return *this;
+    }
+
+    /* Returns a copy of the `width` by `height` rectangle of this `Image` with top-left pixel (row
+    `row`, column `col`). The rectangle must fit in this `Image`. */
+    auto cropped(size_t col, size_t row, size_t width, size_t height) const {
+        check_region_fits(col, row, width, height, "cropped");
+        std::vector<std::vector<RGB>> region(height);
+        for (size_t r = 0; r < height; ++r) {
+            auto begin = pixels[row + r].begin() + static_cast<std::ptrdiff_t>(col);
+            region[r].assign(begin, begin + static_cast<std::ptrdiff_t>(width));
+        }
+        return Image(region);
+    }
+
     /* --- NAMED CONSTRUCTORS --- */
 
     /* Creates an image with width `width` and height `height` */
@@ -74,6 +178,17 @@ public:
         return Image(width, height);
     }
 
+    /* Creates an image with width `width` and height `height`, none of whose rows are allocated
+    yet: every row must be allocated with `allocate_row()` before it is used. This lets each row
+    be allocated (and so placed in memory, under the "first touch" policy of NUMA machines) by the
+    thread that renders it; see `NumaTopology`. */
+    static auto with_unallocated_rows(size_t width, size_t height) {
+        Image ret(width, 0);
+        ret.h = height;
+        ret.pixels.resize(height);
+        return ret;
+    }
+
     /* Creates an image with width `w` and width-to-height ratio `aspect_ratio` */
     static auto with_width_and_aspect_ratio(size_t width, double aspect_ratio) {
         auto height = static_cast<size_t>(std::round(static_cast<double>(width) / aspect_ratio));
@@ -96,6 +211,22 @@ public:
         return Image(img);
     }
 
+    /* Creates an image corresponding to the PFM file with name `file_name`, whose colors are kept
+    exactly as stored (linear, and unclamped, as for high dynamic range images). The channel of
+    grayscale PFM files is copied to all three colors. */
+    static auto from_pfm_file(const std::string &file_name) {
+        auto pfm = read_pfm(file_name);
+        std::vector img(pfm.height, std::vector<RGB>(pfm.width, RGB::zero()));  /* CTAD */
+        for (size_t row = 0; row < pfm.height; ++row) {
+            for (size_t col = 0; col < pfm.width; ++col) {
+                const auto *p = pfm.data.data() + (row * pfm.width + col) * pfm.channels;
+                img[row][col] = (pfm.channels == 3 ? RGB::from_mag(p[0], p[1], p[2])
+                                                   : RGB::from_mag(p[0]));
+            }
+        }
+        return from_data(img);
+    }
+
     /* Creates an image corresponding to the PPM file with name `file_name`. */
     static auto from_ppm_file(const std::string &file_name) {
 
@@ -165,6 +296,37 @@ public:
     }
 };
 
+/* Returns the mean (over all pixels and color channels) squared difference between the images `a`
+and `b`, which must have the same dimensions. The colors are first clamped to [0, 1], so that this
+measures the difference between the images as they are displayed (apart from gamma correction),
+rather than being dominated by a few very bright pixels such as lights. */
+double mean_squared_error(const Image &a, const Image &b) {
+    if (a.width() != b.width() || a.height() != b.height()) {
+        std::cout << "Error: In mean_squared_error(), the images have different dimensions ("
+                  << a.width() << " x " << a.height() << " and " << b.width() << " x "
+                  << b.height() << ")" << std::endl;
+        std::exit(-1);
+    }
+    auto clamped = [](double d) {return std::clamp(d, 0., 1.);};
+    double sum = 0;
+    for (size_t row = 0; row < a.height(); ++row) {
+        for (size_t col = 0; col < a.width(); ++col) {
+            const auto &p = a[row][col], &q = b[row][col];
+            for (auto d : {clamped(p.r) - clamped(q.r), clamped(p.g) - clamped(q.g),
+                           clamped(p.b) - clamped(q.b)}) {
+                sum += d * d;
+            }
+        }
+    }
+    return sum / static_cast<double>(3 * a.width() * a.height());
+}
+
+/* Returns the peak signal-to-noise ratio (in decibels) of the image `a` relative to the reference
+image `b`; higher is closer, and identical images give infinity. Uses `mean_squared_error()`. */
+double peak_signal_to_noise_ratio(const Image &a, const Image &b) {
+    return -10 * std::log10(mean_squared_error(a, b));
+}
+
 /* `ImagePPMStream` progressively takes in the `RGB` pixels of an image with a specified width and
 height, in the order of top to bottom then left to right, and prints those pixels to a specified
 file. Unlike `Image`, it does not allow access to the pixels of the image, because it does not store
@@ -0,0 +1,172 @@
+#ifndef MEMORY_REPORT_H
+#define MEMORY_REPORT_H
+
+#include <map>
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <sstream>
+#include <iomanip>  /* For `std::setw` and `std::setprecision` */
+#include <iostream>
+#include <iterator>  /* For `std::prev` */
+#include <unordered_set>
+
+/* `MemoryCategory` = What a block of memory counted by a `MemoryReport` is used for. */
+enum class MemoryCategory : size_t {
+    /* `PRIMITIVES` = The `Hittable` objects themselves (including their cached `AABB`s and the
+    `std::shared_ptr`s they hold), the control blocks of the `std::shared_ptr`s that own them, and
+    any geometry they own (such as the voxels of a `GridMedium`) */
+    PRIMITIVES,
+    /* `MATERIALS` = The `Material`s and `Texture`s (but not the texels of image textures) */
+    MATERIALS,
+    /* `SCENE_ARENAS` = The whole blocks of `SceneArena`s: the primitives, materials and textures
+    in them (which are then not counted in their own categories), their control blocks, and the
+    unused ends of the blocks */
+    SCENE_ARENAS,
+    /* `OBJECT_LISTS` = The arrays of `std::shared_ptr`s that list objects: `Scene::objects`, and
+    the copy of the primitives in `BVH::primitives` */
+    OBJECT_LISTS,
+    /* `BVH_NODES` = The nodes of `BVH`s, and the `Parallelogram` packets stored next to them */
+    BVH_NODES,
+    /* `IMAGES` = Image buffers: rendered images, AOVs, environment maps, and image textures */
+    IMAGES,
+    NUM_CATEGORIES
+};
+
+/* `MemoryReport` adds up the memory used by a scene (and its `BVH`, and the images rendered from
+it), by category, to predict whether a job fits in memory, and to measure what a change of data
+layout saves. A `Scene` hides most of its memory: every `Sphere` is a separate allocation, along
+with the control block of the `std::shared_ptr` that owns it, the `std::shared_ptr` to it in
+`Scene::objects`, another in `BVH::primitives`, and its own `std::shared_ptr` to its material.
+
+Objects report themselves, visitor-style: `Hittable::report_memory()`, `Material::report_memory()`
+and `Texture::report_memory()` each count what they own, and then visit the objects they point to.
+Objects that are shared (a material used by a million spheres, or a primitive that is in both a
+`Scene` and its `BVH`) are counted only once, the first time they are visited. Objects made in a
+`SceneArena` are counted with the whole blocks of the arena instead (see `add_arena_block()`).
+
+The counts are of the memory the objects ask for; the allocator rounds every allocation up, and
+adds some bookkeeping of its own, which `peak_rss_bytes()` (the most memory the process has ever
+actually held; see util/peak_rss.h) includes. */
+class MemoryReport {
+    std::array<size_t, static_cast<size_t>(MemoryCategory::NUM_CATEGORIES)> bytes{};
+    /* `num_objects[c]` = The number of distinct objects counted in the category `c` */
+    std::array<size_t, static_cast<size_t>(MemoryCategory::NUM_CATEGORIES)> num_objects{};
+    /* `visited` = The addresses of every object counted so far */
+    std::unordered_set<const void*> visited;
+    /* `arena_blocks[begin]` = The end of the block of a `SceneArena` that starts at `begin` */
+    std::map<const std::byte*, const std::byte*> arena_blocks;
+
+    /* Returns `true` if `object` is in one of the blocks of `SceneArena`s counted so far. */
+    bool in_arena_block(const void *object) const {
+        auto p = static_cast<const std::byte*>(object);
+        auto it = arena_blocks.upper_bound(p);
+        return it != arena_blocks.begin() && p < std::prev(it)->second;
+    }
+
+    /* Returns the name of the category `category`, for printing. */
+    static std::string name_of(MemoryCategory category) {
+        switch (category) {
+            case MemoryCategory::PRIMITIVES: return "Primitives";
+            case MemoryCategory::MATERIALS: return "Materials and textures";
+            case MemoryCategory::SCENE_ARENAS: return "Scene arenas";
+            case MemoryCategory::OBJECT_LISTS: return "Object lists";
+            case MemoryCategory::BVH_NODES: return "BVH nodes";
+            case MemoryCategory::IMAGES: return "Image buffers";
+            default: return "Unknown";
+        }
+    }
+
+    /* Returns `num_bytes` as a human-readable string, such as "12.34 MiB". */
+    static std::string readable(size_t num_bytes) {
+        constexpr std::array<const char*, 5> UNITS{"B", "KiB", "MiB", "GiB", "TiB"};
+        auto value = static_cast<double>(num_bytes);
+        size_t unit = 0;
+        for (; value >= 1024 && unit + 1 < UNITS.size(); ++unit) {
+            value /= 1024;
+        }
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(unit == 0 ? 0 : 2) << value << " " << UNITS[unit];
+        return ss.str();
+    }
+
+public:
+
+    /* `SHARED_PTR_CONTROL_BLOCK_SIZE` = The size of the control block that `std::make_shared`
+    allocates together with every object: a virtual table pointer, and the strong and weak
+    reference counts (as in libstdc++ and libc++ on 64-bit platforms). Objects made in a
+    `SceneArena` have larger control blocks, which are counted with the blocks of the arena. */
+    static constexpr size_t SHARED_PTR_CONTROL_BLOCK_SIZE = sizeof(void*) + 2 * sizeof(int32_t);
+
+    /* Adds `num_bytes` to the category `category`. */
+    void add(MemoryCategory category, size_t num_bytes) {
+        bytes[static_cast<size_t>(category)] += num_bytes;
+    }
+
+    /* Returns `true` if `object` has not been visited before (and marks it as visited), and
+    `false` if it has. */
+    bool first_visit(const void *object) {
+        return visited.insert(object).second;
+    }
+
+    /* Counts the object at `object`, of size `size` (usually `sizeof(*this)`), which is owned by
+    a `std::shared_ptr` (made with `std::make_shared`), in the category `category`, unless it was
+    already counted. If the object is in a block of a `SceneArena` that was already counted (see
+    `add_arena_block()`), its bytes are not added again; only the object itself is counted in
+    `category`. Returns `true` if it was counted now; the object should then go on to report the
+    objects it points to. */
+    bool add_shared_object(MemoryCategory category, const void *object, size_t size) {
+        if (!first_visit(object)) {return false;}
+        if (!in_arena_block(object)) {
+            add(category, size + SHARED_PTR_CONTROL_BLOCK_SIZE);
+        }
+        ++num_objects[static_cast<size_t>(category)];
+        return true;
+    }
+
+    /* Counts the `num_bytes` bytes at `block`, a block of a `SceneArena`, in the category
+    `MemoryCategory::SCENE_ARENAS`. The objects in the block must be visited after this. */
+    void add_arena_block(const void *block, size_t num_bytes) {
+        auto begin = static_cast<const std::byte*>(block);
+        arena_blocks.emplace(begin, begin + num_bytes);
+        add(MemoryCategory::SCENE_ARENAS, num_bytes);
+    }
+
+    /* Adds the memory held by the `std::vector` `v` (its capacity, not just its size) to the
+    category `category`. */
+    template <typename T, typename Allocator>
+    void add_vector(MemoryCategory category, const std::vector<T, Allocator> &v) {
+        add(category, v.capacity() * sizeof(T));
+    }
+
+    /* Returns the number of bytes counted in the category `category`. */
+    size_t bytes_in(MemoryCategory category) const {
+        return bytes[static_cast<size_t>(category)];
+    }
+
+    /* Returns the number of bytes counted in all categories. */
+    size_t total_bytes() const {
+        size_t ret = 0;
+        for (auto b : bytes) {ret += b;}
+        return ret;
+    }
+
+    /* Prints this `MemoryReport`, titled `title`, to the `std::ostream` specified by `os`. */
+    void print_to(std::ostream &os, const std::string &title = "Memory report") const {
+        os << title << ":\n";
+        for (size_t c = 0; c < bytes.size(); ++c) {
+            os << "  " << std::left << std::setw(24) << name_of(static_cast<MemoryCategory>(c))
+               << std::right << std::setw(12) << readable(bytes[c]);
+            if (num_objects[c] > 0) {
+                os << "  (" << num_objects[c] << " objects)";
+            }
+            os << '\n';
+        }
+        os << "  " << std::left << std::setw(24) << "Total" << std::right << std::setw(12)
+           << readable(total_bytes()) << std::endl;
+    }
+};
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <utility>  /* For `std::pair` */
+#include <thread>   /* For `std::thread::hardware_concurrency` */
+#include <algorithm>  /* For `std::find` and `std::max` */
+#ifdef _OPENMP
+#include <omp.h>  /* For `omp_get_max_threads()` and `omp_get_thread_num()` */
+#endif
+#ifdef __linux__
+#include <sched.h>  /* For `sched_getaffinity()` and `sched_setaffinity()` */
+#endif
+
+/* `ThreadPlacement` = How the render threads of a `Camera` are placed on the CPUs of a machine
+with several NUMA (Non-Uniform Memory Access) nodes, such as a dual-socket machine, where each
+socket reaches its own memory faster than that of the other socket (see `NumaTopology`) */
+enum class ThreadPlacement {
+    /* `UNPINNED` = Threads are not pinned, and the operating system moves them as it likes */
+    UNPINNED,
+    /* `COMPACT` = Thread `i` is pinned to the `i`th CPU, filling all CPUs of the first node
+    before moving on to the next node; best when there are fewer threads than CPUs on one node */
+    COMPACT,
+    /* `SPREAD` = Threads are pinned round-robin across the nodes (thread 0 to the first CPU of
+    node 0, thread 1 to the first CPU of node 1, and so on), so that every node gets an equal
+    share of the threads, and of the memory bandwidth */
+    SPREAD
+};
+
+/* `NumaTopology` is the set of CPUs of each NUMA node of this machine that this process may run
+on, read once from `/sys/devices/system/node` (on Linux). On machines with a single node, or where
+the topology cannot be read, it is a single node with all CPUs. It also pins threads to CPUs.
+
+On a multi-socket machine, memory is placed on the node of the thread that first writes to it
+(the "first touch" policy of Linux), so an array built by one thread, such as the nodes of a `BVH`,
+lives entirely on one node, and the threads on every other node pay remote-memory latency for
+every access to it. `Camera::set_thread_placement()` pins the render threads, and can replicate
+the (read-only) `BVH` on every node, so every thread reads a copy on its own node. */
+class NumaTopology {
+    /* `node_cpus[i]` = The CPUs of the `i`th node (that this process may run on), in increasing
+    order. Nodes without such CPUs (such as memory-only nodes) are left out. */
+    std::vector<std::vector<int>> node_cpus;
+
+    /* Returns the CPUs in the Linux CPU list `list`, such as "0-3,8-11". */
+    static std::vector<int> parse_cpu_list(const std::string &list) {
+        std::vector<int> ret;
+        std::stringstream ss(list);
+        for (std::string range; std::getline(ss, range, ',');) {
+            if (range.empty() || range == "\n") {continue;}
+            auto dash = range.find('-');
+            auto first = std::stoi(range.substr(0, dash));
+            auto last = (dash == std::string::npos ? first : std::stoi(range.substr(dash + 1)));
+            for (auto cpu = first; cpu <= last; ++cpu) {
+                ret.push_back(cpu);
+            }
+        }
+        return ret;
+    }
+
+    /* Reads the topology of this machine. */
+    NumaTopology() {
+        auto allowed = current_thread_cpus();
+        std::ifstream online_file("/sys/devices/system/node/online");
+        std::string online;
+        std::getline(online_file, online);
+        for (auto node : parse_cpu_list(online)) {
+            std::ifstream cpulist_file("/sys/devices/system/node/node" + std::to_string(node)
+                                       + "/cpulist");
+            std::string cpulist;
+            std::getline(cpulist_file, cpulist);
+            std::vector<int> cpus;
+            for (auto cpu : parse_cpu_list(cpulist)) {
+                if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+                    cpus.push_back(cpu);
+                }
+            }
+            if (!cpus.empty()) {node_cpus.push_back(std::move(cpus));}
+        }
+        if (node_cpus.empty()) {
+            node_cpus.push_back(std::move(allowed));
+        }
+    }
+
+public:
+
+    /* Returns the topology of this machine, which is read the first time this is called. */
+    static const NumaTopology& get() {
+        static const NumaTopology topology;
+        return topology;
+    }
+
+    auto num_nodes() const {return node_cpus.size();}
+    const auto& cpus_of(size_t node) const {return node_cpus[node];}
+
+    /* Returns the CPU that the `i`th thread is pinned to under the placement `placement` (which
+    must not be `UNPINNED`), along with the node of that CPU. Threads wrap around to the first CPU
+    when there are more threads than CPUs. */
+    std::pair<int, size_t> cpu_of_thread(size_t i, ThreadPlacement placement) const {
+        size_t num_cpus = 0;
+        for (const auto &cpus : node_cpus) {num_cpus += cpus.size();}
+        i %= num_cpus;
+        if (placement == ThreadPlacement::COMPACT) {
+            for (size_t node = 0;; ++node) {
+                if (i < node_cpus[node].size()) {return {node_cpus[node][i], node};}
+                i -= node_cpus[node].size();
+            }
+        }
+        /* Deal the CPUs out to the nodes round-robin, skipping nodes that have run out */
+        for (size_t round = 0;; ++round) {
+            for (size_t node = 0; node < node_cpus.size(); ++node) {
+                if (round >= node_cpus[node].size()) {continue;}
+                if (i == 0) {return {node_cpus[node][round], node};}
+                --i;
+            }
+        }
+    }
+
+    /* Returns the CPUs that the calling thread may run on now. */
+    static std::vector<int> current_thread_cpus() {
+        std::vector<int> ret;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &set)) {ret.push_back(cpu);}
+            }
+            return ret;
+        }
+#endif
+        for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+            ret.push_back(static_cast<int>(cpu));
+        }
+        return ret;
+    }
+
+    /* Pins the calling thread to the CPUs `cpus` (so that it only ever runs on them). Returns
+    `false` if that is not possible on this platform, or fails. */
+    static bool pin_current_thread(const std::vector<int> &cpus) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu : cpus) {CPU_SET(cpu, &set);}
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+        return false;
+#endif
+    }
+
+    /* Returns the number of threads that OpenMP parallel regions use by default (1 without
+    OpenMP), and the index of the calling thread within its parallel region (0 outside of one). */
+    static size_t max_threads() {
+#ifdef _OPENMP
+        return static_cast<size_t>(omp_get_max_threads());
+#else
+        return 1;
+#endif
+    }
+    static size_t thread_num() {
+#ifdef _OPENMP
+        return static_cast<size_t>(omp_get_thread_num());
+#else
+        return 0;
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef PEAK_RSS_H
+#define PEAK_RSS_H
+
+#include <cstddef>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>  /* For `getrusage()` */
+#endif
+
+/* Returns the peak resident set size of this process (the most physical memory it has held at
+once, so far), in bytes; or 0 if it is unknown (including on platforms without `getrusage()`). It
+includes the rounding and bookkeeping of the allocator, which a `MemoryReport` does not count. */
+inline size_t peak_rss_bytes() {
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {return 0;}
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);  /* Already in bytes on macOS */
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;  /* In kilobytes on Linux */
+#endif
+#else
+    return 0;
+#endif
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef PFM_H
+#define PFM_H
+
+#include <bit>  /* For `std::endian` and `std::bit_cast` */
+#include <vector>
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <cstdlib>  /* For std::exit() */
+
+/* Helpers for PFM (Portable Float Map) files, which store images as raw 32-bit floats, without the
+clamping and gamma correction of PPM files; so they keep the exact linear values, which is what
+denoisers and compositing tools want. A PFM file is a text header ("PF" for 3 channels or "Pf" for
+1 channel, then the width and height, then a scale whose sign gives the byte order: negative for
+little-endian), followed by the floats of the rows from the BOTTOM row to the top row. See
+https://www.pauldebevec.com/Research/HDR/PFM/. */
+
+/* Writes the `width` by `height` image with `channels` (1 or 3) channels per pixel, whose floats
+are given in `data` row by row from the TOP row down (as everywhere else in this raytracer), to the
+PFM file with name `file_name`. */
+void write_pfm(const std::string &file_name, size_t width, size_t height, size_t channels,
+               const std::vector<float> &data) {
+    if (channels != 1 && channels != 3) {
+        std::cout << "Error: In write_pfm(\"" << file_name << "\"), PFM files have 1 or 3 "
+                  << "channels, not " << channels << std::endl;
+        std::exit(-1);
+    }
+    std::ofstream fout(file_name, std::ios::binary);
+    if (!fout.is_open()) {
+        std::cout << "Error: In write_pfm(), could not open the file \"" << file_name << "\""
+                  << std::endl;
+        std::exit(-1);
+    }
+
+    /* The floats are written in this machine's byte order, which the sign of the scale records */
+    fout << (channels == 3 ? "PF" : "Pf") << '\n' << width << ' ' << height << '\n'
+         << (std::endian::native == std::endian::little ? "-1.0" : "1.0") << '\n';
+    auto row_size = width * channels;
+    for (size_t row = height; row-- > 0;) {
+        fout.write(reinterpret_cast<const char*>(data.data() + row * row_size),
+                   static_cast<std::streamsize>(row_size * sizeof(float)));
+    }
+}
+
+/* `PFMData` = The contents of a PFM file: its dimensions, its number of channels (1 or 3), and its
+floats, row by row from the TOP row down. */
+struct PFMData {
+    size_t width, height, channels;
+    std::vector<float> data;
+};
+
+/* Reads the PFM file with name `file_name`, in either byte order. */
+PFMData read_pfm(const std::string &file_name) {
+    std::ifstream fin(file_name, std::ios::binary);
+    if (!fin.is_open()) {
+        std::cout << "Error: In read_pfm(), could not open the file \"" << file_name << "\""
+                  << std::endl;
+        std::exit(-1);
+    }
+
+    std::string type;
+    PFMData ret;
+    double scale;
+    if (!(fin >> type >> ret.width >> ret.height >> scale) || (type != "PF" && type != "Pf")
+        || ret.width == 0 || ret.height == 0 || scale == 0) {
+        std::cout << "Error: In read_pfm(\"" << file_name << "\"), the header is not that of a PFM "
+                  << "file (\"PF\" or \"Pf\", the width and height, and a nonzero scale)"
+                  << std::endl;
+        std::exit(-1);
+    }
+    fin.get();  /* The single whitespace character after the scale */
+    ret.channels = (type == "PF" ? 3 : 1);
+
+    auto row_size = ret.width * ret.channels;
+    ret.data.resize(ret.height * row_size);
+    for (size_t row = ret.height; row-- > 0;) {
+        fin.read(reinterpret_cast<char*>(ret.data.data() + row * row_size),
+                 static_cast<std::streamsize>(row_size * sizeof(float)));
+    }
+    if (!fin) {
+        std::cout << "Error: In read_pfm(\"" << file_name << "\"), the file ends before all "
+                  << ret.width << " x " << ret.height << " pixels" << std::endl;
+        std::exit(-1);
+    }
+
+    /* A negative scale means little-endian floats; swap their bytes if this machine differs */
+    if ((scale < 0) != (std::endian::native == std::endian::little)) {
+        for (auto &f : ret.data) {
+            auto bits = std::bit_cast<uint32_t>(f);
+            bits = (bits >> 24) | ((bits >> 8) & 0xFF00) | ((bits << 8) & 0xFF0000) | (bits << 24);
+            f = std::bit_cast<float>(bits);
+        }
+    }
+    return ret;
+}
+
+#endif
@@ -5,6 +5,9 @@
 #include <random>
 #include <optional>
 #include <mutex>
+#include <limits>
+#include <cstdint>
+#include <type_traits>  /* For `std::remove_reference_t` */
 
 /* `SeedSeqGenerator` is a singleton class whose sole instance generates the sequence of random
 seeds which supplies random seeds to the `thread_local` RNGs used in the `rand_double` function. */
@@ -79,12 +82,19 @@ public:
     }
 };
 
-/* Generates an uniformly-random `double` in the range [`min`, `max`]
-(by default [0, 1]). Now trades quality for speed; we no longer use `<random>`
-in favor of a Linear Congruential Generator. */
-auto rand_double(double min = 0, double max = 1) {
-    /* I use a Linear Congruential Generator to generates random integers, which I will then
-    use to generate the random `double`s in the range [min, max].
+/* Returns (a mutable reference to) the state of this thread's Linear Congruential Generator, which
+`rand_double()` and `rand_int()` draw from. It starts at the next seed from the `SeedSeqGenerator`,
+and can be reseeded with `seed_rand_double()`. */
+auto& rand_double_state() {
+    thread_local auto state = SeedSeqGenerator::get_instance().next_seed();
+    return state;
+}
+
+/* Advances this thread's Linear Congruential Generator, and returns its new state: an
+uniformly-random unsigned integer. Both `rand_double()` and `rand_int()` draw from it. */
+auto rand_lcg_next() {
+    /* I use a Linear Congruential Generator to generates random integers, which `rand_double()`
+    and `rand_int()` then turn into random `double`s and `int`s.
     
     The LCG is defined by the recurrence relation X_{n + 1} = (A * X_n + C) % MOD, where X is the
     sequence of pseudorandom integers, X_0 is equal to the seed generated by the `SeedSeqGenerator`
@@ -102,28 +112,117 @@ auto rand_double(double min = 0, double max = 1) {
     integers are awesome). This is a common trick, and is a big reason why many LCGs use a modulo
     which equals the word size (according to the Wikipedia page linked above). */
 
-    /* Generate a new seed for this thread's LCG */
-    thread_local auto seed = SeedSeqGenerator::get_instance().next_seed();
+    auto &seed = rand_double_state();
     seed = 1'664'525 * seed + 1'013'904'223;  /* The first random integer used is X_1, not X_0. */
+    return seed;
+}
+
+/* Generates an uniformly-random `double` in the range [`min`, `max`]
+(by default [0, 1]). Now trades quality for speed; we no longer use `<random>`
+in favor of a Linear Congruential Generator (see `rand_lcg_next()`). */
+auto rand_double(double min = 0, double max = 1) {
+    auto seed = rand_lcg_next();
     /* The LCG generates uniformly random INTEGERS from 0 to (MOD - 1), inclusive, where
     MOD = (1 << 32) here. To generate uniformly random `double`s in the range [min, max],
     it suffices to normalize the generated integer to the range [0, 1] (by dividing it by
     (MOD - 1)), and then using that as the linear interpolation parameter between `min`
     and `max` (so we will be returning min + (max - min) * (seed / (MOD - 1)). */
     constexpr auto SCALE = 1 / static_cast<double>(
-        std::numeric_limits<decltype(seed)>::max() - 1  /* To handle different `seed_type`s */
+        /* To handle different `seed_type`s */
+        std::numeric_limits<std::remove_reference_t<decltype(seed)>>::max() - 1
     );
     return min + (max - min) * static_cast<double>(seed) * SCALE;
 }
 
-/* Generates an uniformly-random `int` in the range [`min`, `max`] ([0, 1] by default). */
+/* Returns an uniformly-random integer in [0, `range`), where 0 < `range` <= 2^32, drawing
+uniformly-random 32-bit integers from `next()`. This is Lemire's "nearly divisionless" method
+("Fast Random Integer Generation in an Interval", 2019): the 64-bit product of a random 32-bit
+integer and `range` has its high 32 bits in [0, `range`), and they are exactly uniform once the
+few products whose low 32 bits fall below 2^32 % `range` are rejected. That threshold (the only
+division) is needed only when the low bits are below `range`, which is rare for small ranges; so
+almost every call takes a single multiplication, unlike the two divisions of `x % range`. */
+template <typename Next>
+uint64_t bounded_rand(uint64_t range, Next &&next) {
+    if (range > std::numeric_limits<uint32_t>::max()) {return next();}
+    auto r = static_cast<uint32_t>(range);
+    auto product = static_cast<uint64_t>(next()) * r;
+    if (static_cast<uint32_t>(product) < r) {
+        auto threshold = static_cast<uint32_t>(-r) % r;  /* = 2^32 % `r` */
+        while (static_cast<uint32_t>(product) < threshold) {
+            product = static_cast<uint64_t>(next()) * r;
+        }
+    }
+    return product >> 32;
+}
+
+/* Generates an uniformly-random `int` in the range [`min`, `max`] ([0, 1] by default), from the
+same Linear Congruential Generator as `rand_double()`. */
 auto rand_int(int min = 0, int max = 1) {
-    /* Is just use a `std::mt19937` for now. If performance becomes an issue I'll switch to
-    a LCG like I did with `rand_double()`. */
-    thread_local std::mt19937 generator{SeedSeqGenerator::get_instance().next_seed()};
-    thread_local std::uniform_int_distribution<> dist;
-    dist.param(std::uniform_int_distribution<>::param_type{min, max});
-    return dist(generator);
+    auto range = static_cast<uint64_t>(static_cast<int64_t>(max) - min + 1);
+    auto offset = bounded_rand(range, [] {return static_cast<uint32_t>(rand_lcg_next());});
+    return static_cast<int>(min + static_cast<int64_t>(offset));
+}
+
+/* `CounterRNG` is a counter-based random number generator. Unlike the `thread_local` LCGs used by
+`rand_double` (whose outputs depend on which thread happens to call them, and in what order), the
+`n`th number drawn from a `CounterRNG` is a pure function of its `seed`, its `stream`, and `n`.
+
+This is what makes parallel procedural scene generation reproducible: if the object with index
+`i` is always generated from `CounterRNG(seed, i)`, then the generated scene is identical no matter
+how many threads are used, or how the indices are distributed among them. */
+class CounterRNG {
+    /* `key` = The hash of this generator's seed and stream; it identifies the random sequence. */
+    uint64_t key;
+    /* `counter` = The number of random integers drawn from this generator so far. */
+    uint64_t counter = 0;
+
+    /* Returns a well-mixed 64-bit hash of `z`. This is the finalizer of SplitMix64 (see
+    https://prng.di.unimi.it/splitmix64.c); every input bit affects every output bit, so even
+    consecutive counters and streams yield statistically independent outputs. */
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        return z ^ (z >> 31);
+    }
+
+public:
+
+    /* Returns the next uniformly-random 64-bit unsigned integer from this generator. */
+    uint64_t next_uint64() {
+        /* SplitMix64 itself; the golden-ratio increment spaces out consecutive counters */
+        return mix(key + (++counter) * 0x9E3779B97F4A7C15);
+    }
+
+    /* Generates an uniformly-random `double` in the range [`min`, `max`) (by default [0, 1)). */
+    double rand_double(double min = 0, double max = 1) {
+        /* Use the top 53 bits, which is exactly the precision of a `double`'s significand */
+        constexpr auto SCALE = 1 / static_cast<double>(uint64_t{1} << 53);
+        return min + (max - min) * static_cast<double>(next_uint64() >> 11) * SCALE;
+    }
+
+    /* Generates an uniformly-random `int` in the range [`min`, `max`] ([0, 1] by default). */
+    int rand_int(int min = 0, int max = 1) {
+        /* The 32 high bits of each draw are the better-mixed ones */
+        auto range = static_cast<uint64_t>(static_cast<int64_t>(max) - min + 1);
+        auto offset = bounded_rand(range, [this] {
+            return static_cast<uint32_t>(next_uint64() >> 32);
+        });
+        return static_cast<int>(min + static_cast<int64_t>(offset));
+    }
+
+    /* Constructs the counter-based generator for the random stream `stream` under the seed
+    `seed`. Typically, `stream` is the index of the object being generated. */
+    CounterRNG(uint64_t seed, uint64_t stream) : key{mix(mix(seed) ^ stream)} {}
+};
+
+/* Reseeds this thread's generator for `rand_double()` (see `rand_double_state()`) with the random
+stream `stream` under the seed `seed`, in the same way as `CounterRNG(seed, stream)`. The numbers
+`rand_double()` draws on this thread afterwards then depend only on `seed` and `stream`, and not on
+which thread draws them or what it drew before; this is what makes a render reproducible no matter
+how its pixels and samples are divided among threads (or processes). */
+void seed_rand_double(uint64_t seed, uint64_t stream) {
+    using state_type = std::remove_reference_t<decltype(rand_double_state())>;
+    rand_double_state() = static_cast<state_type>(CounterRNG(seed, stream).next_uint64() >> 32);
 }
 
 #endif
\ No newline at end of file
@@ -65,6 +65,13 @@ public:
         return from_mag(rand_double(min, max), rand_double(min, max), rand_double(min, max));
     }
 
+    /* Creates a RGB with random red, green, and blue components drawn from the counter-based
+    generator `rng`, each a real number in the range [`min`, `max`] (by default [0, 1]). */
+    static RGB random(CounterRNG &rng, double min = 0, double max = 1) {
+        auto red = rng.rand_double(min, max), green = rng.rand_double(min, max);
+        return from_mag(red, green, rng.rand_double(min, max));  /* Fixed evaluation order */
+    }
+
     /* Mathematical operators (since anti-aliasing requires finding the average of
     multiple colors, so we need += and /=) */
 
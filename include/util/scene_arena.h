@@ -0,0 +1,161 @@
+#ifndef SCENE_ARENA_H
+#define SCENE_ARENA_H
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <typeinfo>
+#include <typeindex>  /* For `std::type_index` */
+#include <algorithm>  /* For `std::min` and `std::max` */
+#include <unordered_map>
+#include "util/huge_pages.h"
+#include "util/memory_report.h"
+
+/* `SceneArena` allocates the objects of a `Scene` (its primitives and their materials) from
+monotonic per-type pools, instead of one at a time from the global heap. `std::make_shared` gives
+every one of a million spheres its own heap allocation, which scatters them all over the heap
+(interleaved with their materials and with whatever else was allocated at the time), and adds the
+heap's own bookkeeping to every one of them. Instead, the pool of each type hands out consecutive
+slots of large blocks, so objects of the same type that are made one after another are contiguous
+in memory, in the order they were made; the `BVH` then usually finds the primitives of nearby
+leaves close together in memory too.
+
+The pools are monotonic: the memory of an object is not reused when it is destroyed, and is only
+freed (all at once, a block at a time) when the pools themselves are destroyed. The pools live as
+long as the last object made from them: every object's `std::shared_ptr` control block holds (a
+`std::shared_ptr` to) them, through its `ArenaAllocator`, so objects made from a `SceneArena` are
+safe to keep after their `Scene` (and the `SceneArena`) is gone. Do not use a `SceneArena` for
+objects that are made and destroyed over and over, since their memory is never reused.
+
+`SceneArena` is thread-safe, so `Scene::add_generated()` can make objects from it in parallel;
+threads take a lock only long enough to bump a pointer. Blocks of at least 2 MiB are backed by huge
+pages when those are enabled (see `HugePages`). */
+class SceneArena {
+
+    /* `Pool` = The blocks that the objects of one type are allocated from, and how much of the
+    last block is used */
+    struct Pool {
+        /* `Block` = A block of memory from `HugePages::allocate()`, aligned to the alignment of
+        the pool's type (which `BlockDeleter` frees with the same arguments) */
+        struct BlockDeleter {
+            size_t bytes, alignment;
+            bool huge;
+            void operator() (std::byte *block) const {
+                HugePages::deallocate(block, bytes, alignment, huge);
+            }
+        };
+        using Block = std::unique_ptr<std::byte[], BlockDeleter>;
+
+        std::vector<Block> blocks;
+        /* `next` = The first free byte of the last block; `end` = The end of the last block */
+        std::byte *next = nullptr, *end = nullptr;
+        /* `block_bytes` = The size of the last block */
+        size_t block_bytes = 0;
+    };
+
+    /* `FIRST_BLOCK_OBJECTS` = The number of objects that fit in the first block of each pool. Each
+    further block is twice as large as the last, until `MAX_BLOCK_BYTES` */
+    static constexpr size_t FIRST_BLOCK_OBJECTS = 64;
+    static constexpr size_t MAX_BLOCK_BYTES = size_t{4} << 20;
+
+    /* `Storage` = The pools of every type, which every `ArenaAllocator` shares */
+    struct Storage {
+        std::mutex mtx;
+        std::unordered_map<std::type_index, Pool> pools;
+        /* `reserved` = The total size of all blocks of all pools, in bytes */
+        size_t reserved = 0;
+
+        /* Returns memory for `n` contiguous objects of type `type`, with size `size` and alignment
+        `alignment`, from the pool of `type`. */
+        void* allocate(std::type_index type, size_t n, size_t size, size_t alignment) {
+            /* Objects are placed back to back, so each must start at a multiple of its alignment */
+            auto stride = (size + alignment - 1) / alignment * alignment;
+            auto bytes = n * stride;
+
+            std::lock_guard lock(mtx);
+            auto &pool = pools[type];
+            if (static_cast<size_t>(pool.end - pool.next) < bytes) {
+                pool.block_bytes = std::max(pool.blocks.empty()
+                                            ? FIRST_BLOCK_OBJECTS * stride
+                                            : std::min(2 * pool.block_bytes, MAX_BLOCK_BYTES),
+                                            bytes);
+                /* With huge pages, use all of the last huge page of the block */
+                auto huge = HugePages::enabled();
+                if (HugePages::backs_with_huge_pages(pool.block_bytes, huge)) {
+                    pool.block_bytes = HugePages::round_up(pool.block_bytes);
+                }
+                pool.blocks.emplace_back(
+                    static_cast<std::byte*>(HugePages::allocate(pool.block_bytes, alignment, huge)),
+                    Pool::BlockDeleter{pool.block_bytes, alignment, huge});
+                pool.next = pool.blocks.back().get();
+                pool.end = pool.next + pool.block_bytes;
+                reserved += pool.block_bytes;
+            }
+            auto ret = pool.next;
+            pool.next += bytes;
+            return ret;
+        }
+    };
+
+    std::shared_ptr<Storage> storage = std::make_shared<Storage>();
+
+public:
+
+    /* `ArenaAllocator<T>` = The allocator (in the sense of the standard library) that allocates
+    objects of type `T` from the pool of `T` of a `SceneArena`. Its `deallocate()` does nothing;
+    the memory is freed when the pools are destroyed. */
+    template <typename T>
+    class ArenaAllocator {
+        template <typename U>
+        friend class ArenaAllocator;
+
+        std::shared_ptr<Storage> storage;
+
+    public:
+        using value_type = T;
+
+        T* allocate(size_t n) {
+            return static_cast<T*>(storage->allocate(std::type_index(typeid(T)), n, sizeof(T),
+                                                     alignof(T)));
+        }
+        void deallocate(T*, size_t) {}
+
+        template <typename U>
+        bool operator== (const ArenaAllocator<U> &other) const {return storage == other.storage;}
+
+        explicit ArenaAllocator(std::shared_ptr<Storage> storage_) : storage{std::move(storage_)} {}
+
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U> &other) : storage{other.storage} {}
+    };
+
+    /* Makes an object of type `T` from `args` in this `SceneArena`, like `std::make_shared`. */
+    template <typename T, typename... Args>
+    std::shared_ptr<T> make(Args&&... args) const {
+        return std::allocate_shared<T>(ArenaAllocator<T>(storage), std::forward<Args>(args)...);
+    }
+
+    /* Returns the total size of all blocks of all pools of this `SceneArena` so far, in bytes. */
+    size_t reserved_bytes() const {
+        std::lock_guard lock(storage->mtx);
+        return storage->reserved;
+    }
+
+    /* Counts all blocks of all pools of this `SceneArena` in `report` (see
+    `MemoryReport::add_arena_block()`), unless they were already counted. The objects in them have
+    larger control blocks than those of `std::make_shared` (each also holds its `ArenaAllocator`),
+    and the last block of each pool is usually only partly used, so the blocks are counted as a
+    whole rather than object by object. This must be called before the objects are visited. */
+    void report_memory(MemoryReport &report) const {
+        if (!report.first_visit(storage.get())) {return;}
+        std::lock_guard lock(storage->mtx);
+        for (const auto &[type, pool] : storage->pools) {
+            for (const auto &block : pool.blocks) {
+                report.add_arena_block(block.get(), block.get_deleter().bytes);
+            }
+        }
+    }
+};
+
+#endif
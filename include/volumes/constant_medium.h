@@ -0,0 +1,124 @@
+#ifndef CONSTANT_MEDIUM_H
+#define CONSTANT_MEDIUM_H
+
+#include <cmath>
+#include <memory>
+#include <iostream>
+#include <algorithm>  /* For `std::max` */
+#include "base/hittable.h"
+#include "base/material.h"
+#include "util/rand_util.h"
+
+/* `ConstantMedium` is a participating medium of constant density (such as smoke or fog) filling
+the inside of another `Hittable`, its `boundary`. A ray passing through the medium scatters at a
+random distance along it: the probability of scattering within any short distance dt is
+`density * dt`, so the distance travelled before scattering is exponentially distributed, with mean
+1 / `density`. If that distance is beyond where the ray leaves the `boundary`, then the ray passes
+through the medium untouched. Where it scatters, it does so in a uniformly random direction (see
+`Isotropic`). See "Ray Tracing: The Next Week".
+
+The `boundary` must be closed and convex (a `Sphere` or a `Box`, for instance), since the ray is
+assumed to be inside it between the first two times it hits it. */
+class ConstantMedium : public Hittable {
+    std::shared_ptr<Hittable> boundary;
+    /* `density` = The probability of scattering per unit of distance travelled in the medium */
+    double density;
+    /* `phase_function` = The `Isotropic` material that scatters the rays */
+    std::shared_ptr<Material> phase_function;
+
+    /* Returns the range of hit times, within `ray_times`, during which `ray` is inside the
+    `boundary`; or an empty `std::optional` if there is none. */
+    std::optional<Interval> times_inside(const Ray3D &ray, const Interval &ray_times) const {
+        /* Find where the ray's line enters and exits the boundary, whether or not that is within
+        `ray_times` (the ray may start inside the medium) */
+        auto enter = boundary->hit_by(ray, Interval::universe());
+        if (!enter) {return {};}
+        auto exit = boundary->hit_by(ray, Interval::with_min(enter->hit_time + 0.0001));
+        if (!exit) {return {};}
+
+        auto t_enter = std::max(enter->hit_time, ray_times.min);
+        auto t_exit = std::min(exit->hit_time, ray_times.max);
+        if (t_enter >= t_exit) {return {};}
+        return Interval(t_enter, t_exit);
+    }
+
+public:
+
+    /* Returns a `hit_info` for the point where `ray` scatters in this medium, within the time
+    range `ray_times`, if it does. Because the scattering is isotropic, the normal in the
+    `hit_info` is arbitrary. */
+    std::optional<hit_info> hit_by(const Ray3D &ray, const Interval &ray_times) const override {
+        auto inside = times_inside(ray, ray_times);
+        if (!inside) {return {};}
+
+        /* Sample the distance to the scattering point, and convert it to a hit time */
+        auto ray_speed = ray.dir.mag();
+        auto distance_inside = inside->size() * ray_speed;
+        auto scatter_distance = -std::log(std::max(rand_double(), 1e-300)) / density;
+        if (scatter_distance > distance_inside) {return {};}
+
+        auto hit_time = inside->min + scatter_distance / ray_speed;
+        auto arbitrary_normal = Vec3D{1, 0, 0};
+        return hit_info(hit_time, ray(hit_time), arbitrary_normal, ray, phase_function);
+    }
+
+    /* Returns the exact transmittance of this medium along `ray` in the time range `ray_times`:
+    e^(-density * the distance that `ray` travels inside it). */
+    double transmittance(const Ray3D &ray, const Interval &ray_times) const override {
+        auto inside = times_inside(ray, ray_times);
+        return (inside ? std::exp(-density * inside->size() * ray.dir.mag()) : 1);
+    }
+
+    /* Returns the `AABB` of the `boundary` of this medium. */
+    AABB get_aabb() const override {
+        return boundary->get_aabb();
+    }
+
+    /* A `ConstantMedium` moves exactly when its `boundary` does. */
+    bool is_moving() const override {
+        return boundary->is_moving();
+    }
+
+    /* Returns the `AABB` of the `boundary` of this medium at the scene time `time`. */
+    AABB get_aabb_at_time(double time) const override {
+        return boundary->get_aabb_at_time(time);
+    }
+
+    /* Appends the phase function of this `ConstantMedium` to `out`, which is the material of all
+    of its hits (see `Hittable::append_materials()`). */
+    void append_materials(std::vector<Material*> &out) const override {
+        out.push_back(phase_function.get());
+    }
+
+    /* Counts the memory used by this `ConstantMedium`, its boundary, and its phase function in
+    `report`. */
+    void report_memory(MemoryReport &report) const override {
+        if (report.add_shared_object(MemoryCategory::PRIMITIVES, this, sizeof(*this))) {
+            boundary->report_memory(report);
+            phase_function->report_memory(report);
+        }
+    }
+
+    /* Prints this `ConstantMedium` to the `std::ostream` specified by `os`. */
+    void print_to(std::ostream &os) const override {
+        os << "ConstantMedium {density: " << density << ", boundary: " << *boundary
+           << ", phase function: " << *phase_function << "} " << std::flush;
+    }
+
+    /* --- CONSTRUCTORS --- */
+
+    /* Constructs a `ConstantMedium` with density `density_` filling `boundary_`, which scatters a
+    fraction `color` of the light of each color (see `Isotropic`). */
+    ConstantMedium(std::shared_ptr<Hittable> boundary_, double density_, const RGB &color)
+        : boundary{std::move(boundary_)}, density{density_},
+          phase_function{std::make_shared<Isotropic>(color)} {}
+
+    /* Constructs a `ConstantMedium` with density `density_` filling `boundary_`, whose color at
+    every scattering point is given by the texture `texture` (see `Isotropic`). */
+    ConstantMedium(std::shared_ptr<Hittable> boundary_, double density_,
+                   std::shared_ptr<Texture> texture)
+        : boundary{std::move(boundary_)}, density{density_},
+          phase_function{std::make_shared<Isotropic>(std::move(texture))} {}
+};
+
+#endif
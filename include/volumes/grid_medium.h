@@ -0,0 +1,285 @@
+#ifndef GRID_MEDIUM_H
+#define GRID_MEDIUM_H
+
+#include <array>
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <optional>
+#include <algorithm>  /* For `std::clamp`, `std::max`, and `std::min` */
+#include "base/hittable.h"
+#include "base/material.h"
+#include "acceleration/aabb.h"
+#include "util/rand_util.h"
+#include "volumes/sparse_volume.h"
+
+/* `GridMedium` is a heterogeneous participating medium (such as a cloud): its density varies over
+an axis-aligned box, `bounds`, divided into `nx` x `ny` x `nz` voxels, each storing the density at
+its center. The density between voxel centers is interpolated trilinearly. The voxels are stored
+sparsely, in a `SparseVolume`, which may be shared among several media. As in a
+`ConstantMedium`, the density is the probability of scattering per unit of distance travelled, and
+rays scatter isotropically (see `Isotropic`).
+
+Because the density varies along the ray, the distance to the scattering point cannot be sampled
+directly. Instead, it is sampled by delta tracking ("Woodcock tracking"): tentative collisions are
+sampled as if the medium had a constant density `majorant` that is at least the true density, and
+each is accepted as a real collision with probability `density / majorant` (otherwise, it is a
+"null" collision, and the ray carries on). This is unbiased for any majorant, but the closer the
+majorant is to the true density, the fewer null collisions there are. So, the bricks of the
+`SparseVolume` (blocks of 8^3 voxels), each with its own majorant, form a coarse majorant grid, and
+the ray is walked through it brick by brick with a 3D DDA ("A Fast Voxel Traversal Algorithm for Ray
+Tracing", Amanatides and Woo, 1987), restarting the tracking in every cell with its own majorant
+(which is allowed because exponential distances are memoryless). Cells whose majorant is 0 (empty
+bricks, and their neighbors) are skipped without sampling anything at all, so that mostly-empty
+volumes stay cheap.
+
+`transmittance()` estimates the fraction of light that gets through the medium along a segment of
+a ray (such as a shadow ray towards an `EnvironmentLight`) in the same way, by ratio tracking
+("Residual Ratio Tracking for Estimating Attenuation in Participating Media", Novak et al., 2014),
+which is far less noisy than whether a single shadow ray scatters. */
+class GridMedium : public Hittable {
+    AABB bounds;
+    /* `volume` = The (unscaled) density of every voxel */
+    std::shared_ptr<const SparseVolume> volume;
+    /* `voxel_size` = The side lengths of each voxel */
+    Vec3D voxel_size;
+    /* `density_scale` = The factor that every density in `volume` is multiplied by */
+    double density_scale;
+    /* `phase_function` = The `Isotropic` material that scatters the rays */
+    std::shared_ptr<Material> phase_function;
+
+    /* Returns the (unscaled) density at the point `p`, interpolated trilinearly between the
+    centers of the 8 nearest voxels (and clamped to the outermost voxels near the `bounds`). */
+    double density_at(const Point3D &p) const {
+        return volume->trilinear((p.x - bounds[0].min) / voxel_size.x,
+                                 (p.y - bounds[1].min) / voxel_size.y,
+                                 (p.z - bounds[2].min) / voxel_size.z);
+    }
+
+    /* Walks `ray` through the majorant grid from the hit time `t_start` to the hit time `t_end`
+    (both inside `bounds`), calling `visit(t0, t1, majorant)` for every cell in order, with the
+    hit times `t0` and `t1` where the ray enters and leaves it, and its (unscaled) majorant.
+    Stops early if `visit` returns `true`. */
+    template <typename Visitor>
+    void traverse_majorants(const Ray3D &ray, double t_start, double t_end, Visitor visit) const {
+        std::array<long long, 3> cell, step, last;
+        std::array<double, 3> t_next, t_delta;
+        auto start = ray(t_start);
+        const auto &num_cells = volume->brick_counts();
+        for (size_t axis = 0; axis < 3; ++axis) {
+            auto cell_size = voxel_size[axis] * static_cast<double>(SparseVolume::BRICK_SIZE);
+            last[axis] = static_cast<long long>(num_cells[axis]) - 1;
+            cell[axis] = std::clamp(
+                static_cast<long long>(std::floor((start[axis] - bounds[axis].min) / cell_size)),
+                0LL, last[axis]
+            );
+            auto cell_min = bounds[axis].min + static_cast<double>(cell[axis]) * cell_size;
+            if (ray.dir[axis] > 0) {
+                step[axis] = 1;
+                t_next[axis] = (cell_min + cell_size - ray.origin[axis]) / ray.dir[axis];
+                t_delta[axis] = cell_size / ray.dir[axis];
+            } else if (ray.dir[axis] < 0) {
+                step[axis] = -1;
+                t_next[axis] = (cell_min - ray.origin[axis]) / ray.dir[axis];
+                t_delta[axis] = -cell_size / ray.dir[axis];
+            } else {
+                step[axis] = 0;
+                t_next[axis] = t_delta[axis] = Interval::DOUBLE_INF;
+            }
+        }
+
+        auto t = t_start;
+        while (t < t_end) {
+            /* The ray leaves the current cell through the slab it reaches first */
+            size_t exit_axis = (t_next[0] < t_next[1] ? 0 : 1);
+            if (t_next[2] < t_next[exit_axis]) {exit_axis = 2;}
+            auto t_cell_end = std::min(t_next[exit_axis], t_end);
+
+            auto majorant = volume->majorant(static_cast<size_t>(cell[0]),
+                                             static_cast<size_t>(cell[1]),
+                                             static_cast<size_t>(cell[2]));
+            if (visit(t, t_cell_end, majorant)) {return;}
+
+            t = t_cell_end;
+            cell[exit_axis] += step[exit_axis];
+            if (cell[exit_axis] < 0 || cell[exit_axis] > last[exit_axis]) {return;}
+            t_next[exit_axis] += t_delta[exit_axis];
+        }
+    }
+
+    /* Returns the range of hit times, within `ray_times`, during which `ray` is inside `bounds`;
+    or an empty `std::optional` if there is none. */
+    std::optional<Interval> times_inside(const Ray3D &ray, const Interval &ray_times) const {
+        auto t_enter = ray_times.min, t_exit = ray_times.max;
+        for (size_t axis = 0; axis < 3; ++axis) {
+            auto inverse_ray_dir = 1 / ray.dir[axis];
+            auto t0 = (bounds[axis].min - ray.origin[axis]) * inverse_ray_dir;
+            auto t1 = (bounds[axis].max - ray.origin[axis]) * inverse_ray_dir;
+            if (inverse_ray_dir < 0) {std::swap(t0, t1);}
+            t_enter = std::max(t_enter, t0);
+            t_exit = std::min(t_exit, t1);
+        }
+        if (t_exit <= t_enter) {return {};}
+        return Interval(t_enter, t_exit);
+    }
+
+    /* Returns `densities`, after checking that they are all non-negative. */
+    static const auto& check_densities(const std::vector<float> &densities) {
+        for (auto d : densities) {
+            if (!(d >= 0)) {
+                std::cout << "Error: In GridMedium(), densities must be non-negative, but "
+                          << d << " was given" << std::endl;
+                std::exit(-1);
+            }
+        }
+        return densities;
+    }
+
+    /* Returns an exponentially-distributed random distance (in hit time) to the next tentative
+    collision along a ray, with `rate` tentative collisions per unit of hit time on average. */
+    static double sample_free_flight(double rate) {
+        return -std::log(std::max(rand_double(), 1e-300)) / rate;
+    }
+
+public:
+
+    /* Returns a `hit_info` for the point where `ray` scatters in this medium, within the time
+    range `ray_times`, if it does, sampled by delta tracking through the majorant grid. Because
+    the scattering is isotropic, the normal in the `hit_info` is arbitrary. */
+    std::optional<hit_info> hit_by(const Ray3D &ray, const Interval &ray_times) const override {
+        auto inside = times_inside(ray, ray_times);
+        if (!inside) {return {};}
+
+        /* Densities are per unit of distance; the ray covers `ray_speed` units per unit time */
+        auto ray_speed = ray.dir.mag();
+        std::optional<double> hit_time;
+        traverse_majorants(ray, inside->min, inside->max, [&](double t0, double t1, float m) {
+            if (m <= 0) {return false;}  /* Empty space: nothing to sample */
+            auto rate = static_cast<double>(m) * density_scale * ray_speed;
+            for (auto t = t0 + sample_free_flight(rate); t < t1; t += sample_free_flight(rate)) {
+                if (rand_double() * static_cast<double>(m) < density_at(ray(t))) {
+                    hit_time = t;
+                    return true;
+                }
+            }
+            return false;
+        });
+
+        if (!hit_time) {return {};}
+        auto arbitrary_normal = Vec3D{1, 0, 0};
+        return hit_info(*hit_time, ray(*hit_time), arbitrary_normal, ray, phase_function);
+    }
+
+    /* Returns an unbiased estimate, by ratio tracking, of the transmittance of this medium along
+    `ray` in the time range `ray_times`: the fraction of light that travels that far without
+    scattering. Every tentative collision multiplies the estimate by the probability that it is a
+    null collision, rather than ending the walk at the first real collision like `hit_by()`, so the
+    estimate is much less noisy than whether a single ray gets through. */
+    double transmittance(const Ray3D &ray, const Interval &ray_times) const override {
+        auto inside = times_inside(ray, ray_times);
+        if (!inside) {return 1;}
+
+        auto ray_speed = ray.dir.mag();
+        double ret = 1;
+        traverse_majorants(ray, inside->min, inside->max, [&](double c0, double c1, float m) {
+            if (m <= 0) {return false;}
+            auto rate = static_cast<double>(m) * density_scale * ray_speed;
+            for (auto t = c0 + sample_free_flight(rate); t < c1; t += sample_free_flight(rate)) {
+                ret *= 1 - density_at(ray(t)) / static_cast<double>(m);
+            }
+            /* Once the light is nearly all gone, the rest of the walk barely matters */
+            return ret < 1e-4;
+        });
+        return ret;
+    }
+
+    /* Returns the (scaled) density of this medium at the point `p` (0 outside of `bounds`). */
+    double density(const Point3D &p) const {
+        for (size_t axis = 0; axis < 3; ++axis) {
+            if (!bounds[axis].contains_inclusive(p[axis])) {return 0;}
+        }
+        return density_scale * density_at(p);
+    }
+
+    /* Returns the (unscaled) densities of this medium. */
+    const auto& get_volume() const {return volume;}
+
+    /* Returns the `AABB` of this medium, which is its `bounds`. */
+    AABB get_aabb() const override {
+        return bounds;
+    }
+
+    /* Appends the phase function of this `GridMedium` to `out`, which is the material of all of its
+    hits (see `Hittable::append_materials()`). */
+    void append_materials(std::vector<Material*> &out) const override {
+        out.push_back(phase_function.get());
+    }
+
+    /* Counts the memory used by this `GridMedium` (including its voxels, which may be shared with
+    other `GridMedium`s) and its phase function in `report`. */
+    void report_memory(MemoryReport &report) const override {
+        if (report.add_shared_object(MemoryCategory::PRIMITIVES, this, sizeof(*this))) {
+            if (report.first_visit(volume.get())) {
+                report.add(MemoryCategory::PRIMITIVES, volume->memory_bytes());
+            }
+            phase_function->report_memory(report);
+        }
+    }
+
+    /* Prints this `GridMedium` to the `std::ostream` specified by `os`. */
+    void print_to(std::ostream &os) const override {
+        const auto &num_bricks = volume->brick_counts();
+        os << "GridMedium {bounds: " << bounds << ", " << volume->width() << " x "
+           << volume->height() << " x " << volume->depth() << " voxels, "
+           << volume->num_occupied_bricks() << " of "
+           << num_bricks[0] * num_bricks[1] * num_bricks[2] << " bricks occupied, density scale: "
+           << density_scale << ", phase function: " << *phase_function << "} " << std::flush;
+    }
+
+    /* --- CONSTRUCTORS --- */
+
+    /* Constructs a `GridMedium` filling the axis-aligned box `bounds_`, divided into voxels with
+    the densities stored in `volume_`, each multiplied by `density_scale_`; it scatters a fraction
+    `color` of the light of each color. */
+    GridMedium(const AABB &bounds_, std::shared_ptr<const SparseVolume> volume_,
+               double density_scale_, const RGB &color)
+        : bounds{bounds_}, volume{std::move(volume_)},
+          voxel_size{bounds_[0].size() / static_cast<double>(volume->width()),
+                     bounds_[1].size() / static_cast<double>(volume->height()),
+                     bounds_[2].size() / static_cast<double>(volume->depth())},
+          density_scale{density_scale_}, phase_function{std::make_shared<Isotropic>(color)} {}
+
+    /* Constructs a `GridMedium` filling the axis-aligned box `bounds_`, divided into `nx` x `ny` x
+    `nz` voxels with the densities `densities` (x varies fastest, then y, then z), each multiplied
+    by `density_scale_`; it scatters a fraction `color` of the light of each color. */
+    GridMedium(const AABB &bounds_, size_t nx, size_t ny, size_t nz,
+               const std::vector<float> &densities, double density_scale_, const RGB &color)
+        : GridMedium(bounds_, std::make_shared<const SparseVolume>(
+                         SparseVolume::from_dense(nx, ny, nz, check_densities(densities))
+                     ), density_scale_, color) {}
+
+    /* Creates the `GridMedium` filling `bounds_`, divided into `nx` x `ny` x `nz` voxels, whose
+    density at the center of each voxel is `density_scale_ * density_function(center)` (the
+    function is evaluated in parallel, so it must be thread-safe). The densities are stored
+    sparsely as they are computed, so the dense grid is never stored. */
+    template <typename DensityFunction>
+    static auto from_function(const AABB &bounds_, size_t nx, size_t ny, size_t nz,
+                              DensityFunction density_function, double density_scale_,
+                              const RGB &color) {
+        auto size = Vec3D{bounds_[0].size() / static_cast<double>(nx),
+                          bounds_[1].size() / static_cast<double>(ny),
+                          bounds_[2].size() / static_cast<double>(nz)};
+        auto volume_ = SparseVolume::from_function(nx, ny, nz, [&](size_t x, size_t y, size_t z) {
+            return density_function(Point3D{
+                bounds_[0].min + (static_cast<double>(x) + 0.5) * size.x,
+                bounds_[1].min + (static_cast<double>(y) + 0.5) * size.y,
+                bounds_[2].min + (static_cast<double>(z) + 0.5) * size.z
+            });
+        });
+        return GridMedium(bounds_, std::make_shared<const SparseVolume>(std::move(volume_)),
+                          density_scale_, color);
+    }
+};
+
+#endif
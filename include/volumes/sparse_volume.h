@@ -0,0 +1,390 @@
+#ifndef SPARSE_VOLUME_H
+#define SPARSE_VOLUME_H
+
+#include <array>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cstring>    /* For `std::memcmp` */
+#include <fstream>
+#include <iostream>
+#include <algorithm>  /* For `std::clamp`, `std::max`, and `std::min` */
+
+/* `SparseVolume` stores a 3D grid of `nx` x `ny` x `nz` non-negative values (such as the densities
+of a `GridMedium`) in little memory when most of the grid is empty or smooth, as is typical of
+smoke, fog, and clouds. Like OpenVDB ("VDB: High-Resolution Sparse Volumes with Dynamic Topology",
+Museth, 2013), it is a shallow hierarchy:
+- The grid is divided into bricks of `BRICK_SIZE`^3 voxels. The top level is a dense table with one
+  entry per brick (4 bytes per 512 voxels), pointing to that brick's record, or marking the brick
+  as empty (all 0), in which case nothing else is stored for it.
+- Each brick record stores the minimum and maximum value over the brick. A brick whose values are
+  all the same (a "tile") stores nothing else.
+- Every other brick stores its voxels quantized to 8 bits between its minimum and maximum, so
+  512 bytes per brick instead of the 2048 of dense `float`s, and with an error of at most 1/510 of
+  the range of values in the brick.
+
+Each brick also gets a majorant: an upper bound on the trilinearly-interpolated value anywhere in
+the brick (which can depend on the voxels bordering it, too). A `GridMedium` uses the bricks as the
+cells of its majorant grid, skipping empty bricks and delta tracking through the others with their
+own majorants.
+
+`SparseVolume`s can be saved to and loaded from a simple binary file (see `save()`). */
+class SparseVolume {
+public:
+
+    /* `BRICK_SIZE` = The side length, in voxels, of each brick */
+    static constexpr size_t BRICK_SIZE = 8;
+    static constexpr size_t VOXELS_PER_BRICK = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+private:
+
+    /* `EMPTY` = The top-level entry for bricks that are all 0; `NO_VOXELS` = The `voxels` offset
+    of bricks that are all the same value (tiles) */
+    static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t NO_VOXELS = std::numeric_limits<uint32_t>::max();
+
+    /* `FILE_MAGIC` and `FILE_VERSION` identify the binary file format (see `save()`) */
+    static constexpr char FILE_MAGIC[4] = {'S', 'V', 'O', 'L'};
+    static constexpr uint32_t FILE_VERSION = 1;
+
+    /* `Brick` = The record of a non-empty brick: its minimum and maximum values, the step between
+    its quantization levels, and the offset of its voxels in `voxels` (or `NO_VOXELS`) */
+    struct Brick {
+        float min, max, step;
+        uint32_t voxels;
+
+        bool operator== (const Brick&) const = default;
+    };
+
+    /* `n` = The number of voxels along each axis; `num_bricks` = The number of bricks along each
+    axis (the last bricks along each axis may extend past the grid) */
+    std::array<size_t, 3> n{0, 0, 0}, num_bricks{0, 0, 0};
+    /* `top` = The index in `bricks` of every brick (x varies fastest, then y, then z), or
+    `EMPTY` */
+    std::vector<uint32_t> top;
+    std::vector<Brick> bricks;
+    /* `voxels` = The quantized voxels of the bricks that have any, 512 per brick, each brick's
+    x varying fastest, then y, then z */
+    std::vector<uint8_t> voxels;
+    /* `majorants` = The majorant of every brick (see the class comment), laid out like `top` */
+    std::vector<float> majorants;
+
+    /* Returns the index in `top` of the brick at brick coordinates (`bx`, `by`, `bz`). */
+    size_t brick_index(size_t bx, size_t by, size_t bz) const {
+        return (bz * num_bricks[1] + by) * num_bricks[0] + bx;
+    }
+
+    /* Returns the value of the voxel at (`lx`, `ly`, `lz`) within the brick record `brick`. */
+    float brick_value(const Brick &brick, size_t lx, size_t ly, size_t lz) const {
+        if (brick.voxels == NO_VOXELS) {return brick.min;}
+        auto q = voxels[brick.voxels + (lz * BRICK_SIZE + ly) * BRICK_SIZE + lx];
+        return brick.min + brick.step * static_cast<float>(q);
+    }
+
+    /* Computes `majorants`. A point in a brick interpolates between the voxels of that brick and
+    those of its neighbors (at most half a voxel away), so each brick's majorant is the maximum over
+    itself and its 26 neighbors. */
+    void build_majorants() {
+        std::vector<float> maxes(top.size(), 0.f);
+        for (size_t i = 0; i < top.size(); ++i) {
+            if (top[i] != EMPTY) {maxes[i] = bricks[top[i]].max;}
+        }
+        majorants.assign(top.size(), 0.f);
+        auto lo = [](size_t b) {return (b > 0 ? b - 1 : 0);};
+        auto hi = [&](size_t b, size_t axis) {return std::min(b + 1, num_bricks[axis] - 1);};
+
+        #pragma omp parallel for
+        for (size_t bz = 0; bz < num_bricks[2]; ++bz) {
+            for (size_t by = 0; by < num_bricks[1]; ++by) {
+                for (size_t bx = 0; bx < num_bricks[0]; ++bx) {
+                    float m = 0;
+                    for (size_t z = lo(bz); z <= hi(bz, 2); ++z) {
+                        for (size_t y = lo(by); y <= hi(by, 1); ++y) {
+                            for (size_t x = lo(bx); x <= hi(bx, 0); ++x) {
+                                m = std::max(m, maxes[brick_index(x, y, z)]);
+                            }
+                        }
+                    }
+                    majorants[brick_index(bx, by, bz)] = m;
+                }
+            }
+        }
+    }
+
+    /* Sets the dimensions of this `SparseVolume` to `nx` x `ny` x `nz` voxels. */
+    void set_dimensions(size_t nx, size_t ny, size_t nz) {
+        if (nx == 0 || ny == 0 || nz == 0) {
+            std::cout << "Error: A SparseVolume cannot be " << nx << " x " << ny << " x " << nz
+                      << " voxels" << std::endl;
+            std::exit(-1);
+        }
+        n = {nx, ny, nz};
+        for (size_t axis = 0; axis < 3; ++axis) {
+            num_bricks[axis] = (n[axis] + BRICK_SIZE - 1) / BRICK_SIZE;
+        }
+        /* Every brick must have an index in `bricks` below `EMPTY`; this also keeps the number
+        of bricks from overflowing */
+        if (num_bricks[0] >= EMPTY / num_bricks[1] / num_bricks[2]) {
+            std::cout << "Error: A SparseVolume of " << nx << " x " << ny << " x " << nz
+                      << " voxels has too many bricks to index with 32 bits" << std::endl;
+            std::exit(-1);
+        }
+    }
+
+    SparseVolume() = default;
+
+public:
+
+    auto width() const {return n[0];}
+    auto height() const {return n[1];}
+    auto depth() const {return n[2];}
+    /* Returns the number of bricks along each axis. */
+    const auto& brick_counts() const {return num_bricks;}
+    /* Returns the number of non-empty bricks, and how many of those store their voxels. */
+    auto num_occupied_bricks() const {return bricks.size();}
+    auto num_voxel_bricks() const {return voxels.size() / VOXELS_PER_BRICK;}
+
+    /* Returns the number of bytes this `SparseVolume` uses (not counting the fixed-size members),
+    to compare against the 4 bytes per voxel of a dense grid of `float`s. */
+    size_t memory_bytes() const {
+        return top.size() * sizeof(uint32_t) + bricks.size() * sizeof(Brick)
+             + voxels.size() * sizeof(uint8_t) + majorants.size() * sizeof(float);
+    }
+
+    /* Returns whether this `SparseVolume` stores exactly the same bricks and voxels as `other`
+    (such as after a round trip through `save()` and `from_file()`). */
+    bool operator== (const SparseVolume &other) const = default;
+
+    /* Returns the majorant of the brick at brick coordinates (`bx`, `by`, `bz`): an upper bound on
+    `trilinear()` at any point within the brick. */
+    float majorant(size_t bx, size_t by, size_t bz) const {
+        return majorants[brick_index(bx, by, bz)];
+    }
+
+    /* Returns the value of the voxel at (`x`, `y`, `z`). */
+    float value(size_t x, size_t y, size_t z) const {
+        auto b = top[brick_index(x / BRICK_SIZE, y / BRICK_SIZE, z / BRICK_SIZE)];
+        if (b == EMPTY) {return 0;}
+        return brick_value(bricks[b], x % BRICK_SIZE, y % BRICK_SIZE, z % BRICK_SIZE);
+    }
+
+    /* Returns the value at the continuous voxel coordinates (`gx`, `gy`, `gz`), where voxel
+    (x, y, z) spans [x, x + 1) x [y, y + 1) x [z, z + 1), interpolated trilinearly between the
+    centers of the 8 nearest voxels (and clamped to the outermost voxels at the edges of the grid).
+    When all 8 voxels are in the same brick, which is the case for most lookups, that brick is only
+    looked up once, and empty bricks and tiles are not interpolated at all. */
+    double trilinear(double gx, double gy, double gz) const {
+        std::array<size_t, 3> i0, i1;
+        std::array<double, 3> t;
+        std::array<double, 3> g{gx - 0.5, gy - 0.5, gz - 0.5};
+        auto same_brick = true;
+        for (size_t axis = 0; axis < 3; ++axis) {
+            auto fg = std::floor(g[axis]);
+            t[axis] = g[axis] - fg;
+            auto max_index = static_cast<double>(n[axis] - 1);
+            i0[axis] = static_cast<size_t>(std::clamp(fg, 0., max_index));
+            i1[axis] = static_cast<size_t>(std::clamp(fg + 1, 0., max_index));
+            same_brick = same_brick && i0[axis] / BRICK_SIZE == i1[axis] / BRICK_SIZE;
+        }
+        auto lerp = [](double a, double b, double s) {return a + s * (b - a);};
+
+        if (same_brick) {
+            auto b = top[brick_index(i0[0] / BRICK_SIZE, i0[1] / BRICK_SIZE, i0[2] / BRICK_SIZE)];
+            if (b == EMPTY) {return 0;}
+            const auto &brick = bricks[b];
+            if (brick.voxels == NO_VOXELS) {return brick.min;}
+            std::array<size_t, 3> l0, l1;
+            for (size_t axis = 0; axis < 3; ++axis) {
+                l0[axis] = i0[axis] % BRICK_SIZE;
+                l1[axis] = i1[axis] % BRICK_SIZE;
+            }
+            auto plane = [&](size_t lz) {
+                return lerp(lerp(brick_value(brick, l0[0], l0[1], lz),
+                                 brick_value(brick, l1[0], l0[1], lz), t[0]),
+                            lerp(brick_value(brick, l0[0], l1[1], lz),
+                                 brick_value(brick, l1[0], l1[1], lz), t[0]), t[1]);
+            };
+            return lerp(plane(l0[2]), plane(l1[2]), t[2]);
+        }
+
+        auto plane = [&](size_t z) {
+            return lerp(lerp(value(i0[0], i0[1], z), value(i1[0], i0[1], z), t[0]),
+                        lerp(value(i0[0], i1[1], z), value(i1[0], i1[1], z), t[0]), t[1]);
+        };
+        return lerp(plane(i0[2]), plane(i1[2]), t[2]);
+    }
+
+    /* Saves this `SparseVolume` to the binary file with name `file_name`. The file holds, in the
+    byte order of this machine: the 4 bytes "SVOL"; the version (`uint32_t`); the dimensions, the
+    number of non-empty bricks, and the number of quantized voxels (5 `uint64_t`s); the top-level
+    table (`uint32_t`s); the brick records (`float` min, max, and step, and `uint32_t` voxel
+    offset); and the quantized voxels (`uint8_t`s). */
+    void save(const std::string &file_name) const {
+        std::ofstream fout(file_name, std::ios::binary);
+        if (!fout) {
+            std::cout << "Error: Could not open \"" << file_name << "\" to save a SparseVolume"
+                      << std::endl;
+            std::exit(-1);
+        }
+        auto write = [&](const void *data, size_t bytes) {
+            fout.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+        };
+        write(FILE_MAGIC, sizeof(FILE_MAGIC));
+        write(&FILE_VERSION, sizeof(FILE_VERSION));
+        std::array<uint64_t, 5> header{n[0], n[1], n[2], bricks.size(), voxels.size()};
+        write(header.data(), sizeof(header));
+        write(top.data(), top.size() * sizeof(uint32_t));
+        for (const auto &brick : bricks) {
+            write(&brick.min, sizeof(float));
+            write(&brick.max, sizeof(float));
+            write(&brick.step, sizeof(float));
+            write(&brick.voxels, sizeof(uint32_t));
+        }
+        write(voxels.data(), voxels.size());
+        if (!fout) {
+            std::cout << "Error: Could not write the SparseVolume to \"" << file_name << "\""
+                      << std::endl;
+            std::exit(-1);
+        }
+    }
+
+    /* Loads the `SparseVolume` saved (by `save()`) in the binary file with name `file_name`. */
+    static auto from_file(const std::string &file_name) {
+        std::ifstream fin(file_name, std::ios::binary);
+        auto fail = [&](const std::string &reason) {
+            std::cout << "Error: Could not load a SparseVolume from \"" << file_name << "\": "
+                      << reason << std::endl;
+            std::exit(-1);
+        };
+        if (!fin) {fail("could not open the file");}
+        auto read = [&](void *data, size_t bytes) {
+            fin.read(static_cast<char*>(data), static_cast<std::streamsize>(bytes));
+            if (!fin) {fail("the file is truncated");}
+        };
+
+        char magic[4];
+        uint32_t version;
+        read(magic, sizeof(magic));
+        read(&version, sizeof(version));
+        if (std::memcmp(magic, FILE_MAGIC, sizeof(magic)) != 0 || version != FILE_VERSION) {
+            fail("not a version " + std::to_string(FILE_VERSION) + " SparseVolume file");
+        }
+        std::array<uint64_t, 5> header;
+        read(header.data(), sizeof(header));
+
+        SparseVolume ret;
+        ret.set_dimensions(header[0], header[1], header[2]);
+        ret.top.resize(ret.num_bricks[0] * ret.num_bricks[1] * ret.num_bricks[2]);
+        if (header[3] > ret.top.size() || header[4] % VOXELS_PER_BRICK != 0
+            || header[4] / VOXELS_PER_BRICK > header[3]) {
+            fail("inconsistent brick counts");
+        }
+        ret.bricks.resize(header[3]);
+        ret.voxels.resize(header[4]);
+        read(ret.top.data(), ret.top.size() * sizeof(uint32_t));
+        for (auto &brick : ret.bricks) {
+            read(&brick.min, sizeof(float));
+            read(&brick.max, sizeof(float));
+            read(&brick.step, sizeof(float));
+            read(&brick.voxels, sizeof(uint32_t));
+            if (brick.voxels != NO_VOXELS && brick.voxels + VOXELS_PER_BRICK > ret.voxels.size()) {
+                fail("a brick's voxels are out of range");
+            }
+        }
+        read(ret.voxels.data(), ret.voxels.size());
+        for (auto b : ret.top) {
+            if (b != EMPTY && b >= ret.bricks.size()) {fail("a brick index is out of range");}
+        }
+
+        ret.build_majorants();
+        return ret;
+    }
+
+    /* Creates the `SparseVolume` of `nx` x `ny` x `nz` voxels whose value at the voxel (x, y, z)
+    is `value_function(x, y, z)`, clamped to be non-negative. The bricks are built in parallel (so
+    `value_function` must be thread-safe), and only one brick's worth of values is ever held as
+    `float`s per thread, so the dense grid is never stored. */
+    template <typename ValueFunction>
+    static auto from_function(size_t nx, size_t ny, size_t nz, ValueFunction value_function) {
+        SparseVolume ret;
+        ret.set_dimensions(nx, ny, nz);
+        auto total_bricks = ret.num_bricks[0] * ret.num_bricks[1] * ret.num_bricks[2];
+
+        /* First, evaluate and quantize every brick separately (in parallel) */
+        std::vector<Brick> all_bricks(total_bricks);
+        std::vector<std::vector<uint8_t>> all_voxels(total_bricks);
+        #pragma omp parallel for schedule(dynamic)
+        for (size_t b = 0; b < total_bricks; ++b) {
+            auto bx = b % ret.num_bricks[0], by = (b / ret.num_bricks[0]) % ret.num_bricks[1],
+                 bz = b / (ret.num_bricks[0] * ret.num_bricks[1]);
+            std::array<float, VOXELS_PER_BRICK> values;
+            values.fill(0);
+            float min = std::numeric_limits<float>::max(), max = 0;
+            for (size_t lz = 0; lz < BRICK_SIZE; ++lz) {
+                for (size_t ly = 0; ly < BRICK_SIZE; ++ly) {
+                    for (size_t lx = 0; lx < BRICK_SIZE; ++lx) {
+                        auto x = bx * BRICK_SIZE + lx, y = by * BRICK_SIZE + ly,
+                             z = bz * BRICK_SIZE + lz;
+                        if (x >= nx || y >= ny || z >= nz) {continue;}  /* Past the grid */
+                        auto v = static_cast<float>(std::max(
+                            0., static_cast<double>(value_function(x, y, z))
+                        ));
+                        values[(lz * BRICK_SIZE + ly) * BRICK_SIZE + lx] = v;
+                        min = std::min(min, v);
+                        max = std::max(max, v);
+                    }
+                }
+            }
+
+            all_bricks[b] = Brick{min, max, (max - min) / 255, NO_VOXELS};
+            if (max > min) {
+                auto &q = all_voxels[b];
+                q.resize(VOXELS_PER_BRICK);
+                for (size_t i = 0; i < VOXELS_PER_BRICK; ++i) {
+                    auto level = std::round((std::max(values[i], min) - min) / all_bricks[b].step);
+                    q[i] = static_cast<uint8_t>(std::clamp(level, 0.f, 255.f));
+                }
+            }
+        }
+
+        /* Then, gather the non-empty bricks, in order */
+        ret.top.assign(total_bricks, EMPTY);
+        for (size_t b = 0; b < total_bricks; ++b) {
+            if (all_bricks[b].max <= 0) {continue;}
+            ret.top[b] = static_cast<uint32_t>(ret.bricks.size());
+            if (!all_voxels[b].empty()) {
+                /* The voxels of the last brick must end before `NO_VOXELS` (4 GiB) */
+                if (ret.voxels.size() + VOXELS_PER_BRICK > NO_VOXELS) {
+                    std::cout << "Error: In SparseVolume::from_function(), the quantized voxels of "
+                              << nx << " x " << ny << " x " << nz << " voxels do not fit in the "
+                              << "32-bit offsets of the bricks" << std::endl;
+                    std::exit(-1);
+                }
+                all_bricks[b].voxels = static_cast<uint32_t>(ret.voxels.size());
+                ret.voxels.insert(ret.voxels.end(), all_voxels[b].begin(), all_voxels[b].end());
+            }
+            ret.bricks.push_back(all_bricks[b]);
+        }
+
+        ret.build_majorants();
+        return ret;
+    }
+
+    /* Creates the `SparseVolume` of the dense grid of `nx` x `ny` x `nz` values `values` (x varies
+    fastest, then y, then z). */
+    static auto from_dense(size_t nx, size_t ny, size_t nz, const std::vector<float> &values) {
+        if (values.size() != nx * ny * nz) {
+            std::cout << "Error: In SparseVolume::from_dense(), " << values.size() << " values "
+                      << "were given for " << nx << " x " << ny << " x " << nz << " voxels"
+                      << std::endl;
+            std::exit(-1);
+        }
+        return from_function(nx, ny, nz, [&](size_t x, size_t y, size_t z) {
+            return values[(z * ny + y) * nx + x];
+        });
+    }
+};
+
+#endif
@@ -1,8 +1,20 @@
+#include <iomanip>  /* For `std::setprecision` and `std::setw` */
 #include "util/rand_util.h"
+#include "util/peak_rss.h"
 #include "base/scene.h"
 #include "base/material.h"
 #include "base/camera.h"
+#include "base/sequence.h"
+#include "server/render_server.h"
+#include "server/render_client.h"
+#include "server/distributed_render.h"
+#include "postprocessing/denoiser.h"
 #include "shapes/shapes.h"
+#include "textures/perlin.h"
+#include "textures/image_texture.h"
+#include "volumes/constant_medium.h"
+#include "volumes/grid_medium.h"
+#include "lights/environment_light.h"
 
 /* Instead of `std::make_shared<T>`, I just need to type `ms<T>` now. */
 template<typename T, typename... Args>
@@ -161,34 +173,37 @@ void millions_of_spheres() {
     auto ground_material = std::make_shared<Lambertian>(RGB::from_mag(0.5, 0.5, 0.5));
     world.add(std::make_shared<Sphere>(Point3D(0,-1000000,0), 1000000, ground_material));
 
-    /* Generate small spheres */
-    for (int a = -1001; a < 1001; a++) {
-        for (int b = -1001; b < 51; b++) {
-            auto choose_mat = rand_double();
-            Point3D center(a + 0.9*rand_double(), 0.2, b + 0.9*rand_double());
-
-            if ((center - Point3D(4, 0.2, 0)).mag() > 0.9) {
-                std::shared_ptr<Material> sphere_material;
-
-                if (choose_mat < 0.8) {
-                    // diffuse
-                    auto albedo = RGB::random() * RGB::random();
-                    sphere_material = std::make_shared<Lambertian>(albedo);
-                    world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
-                } else if (choose_mat < 0.95) {
-                    // Metal
-                    auto albedo = RGB::random(0.5, 1);
-                    auto fuzz = rand_double(0, 0.5);
-                    sphere_material = std::make_shared<Metal>(albedo, fuzz);
-                    world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
-                } else {
-                    // glass
-                    sphere_material = std::make_shared<Dielectric>(1.5);
-                    world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
-                }
+    /* Generate small spheres, one per cell (a, b) of the grid [-1001, 1001) x [-1001, 51). These
+    are generated in parallel; every cell draws from its own counter-based random stream, so the
+    scene is the same regardless of the number of threads (and, with the fixed seed, from run to
+    run). */
+    constexpr int A_MIN = -1001, A_MAX = 1001, B_MIN = -1001, B_MAX = 51;
+    world.add_generated(
+        static_cast<size_t>(A_MAX - A_MIN) * static_cast<size_t>(B_MAX - B_MIN), 3141592653,
+        [&](size_t index, CounterRNG &rng) -> std::shared_ptr<Hittable> {
+            auto a = A_MIN + static_cast<int>(index / (B_MAX - B_MIN));
+            auto b = B_MIN + static_cast<int>(index % (B_MAX - B_MIN));
+
+            auto choose_mat = rng.rand_double();
+            Point3D center{a + 0.9*rng.rand_double(), 0.2, b + 0.9*rng.rand_double()};
+            if ((center - Point3D(4, 0.2, 0)).mag() <= 0.9) {return nullptr;}
+
+            if (choose_mat < 0.8) {
+                // diffuse
+                auto albedo = RGB::random(rng);
+                albedo = albedo * RGB::random(rng);
+                return world.make<Sphere>(center, 0.2, world.make<Lambertian>(albedo));
+            } else if (choose_mat < 0.95) {
+                // Metal
+                auto albedo = RGB::random(rng, 0.5, 1);
+                auto fuzz = rng.rand_double(0, 0.5);
+                return world.make<Sphere>(center, 0.2, world.make<Metal>(albedo, fuzz));
+            } else {
+                // glass
+                return world.make<Sphere>(center, 0.2, world.make<Dielectric>(1.5));
             }
         }
-    }
+    );
 
     /* Three big spheres */
     auto material1 = std::make_shared<Dielectric>(1.5);
@@ -211,7 +226,7 @@ void millions_of_spheres() {
         .set_focus_distance(51)
         .set_samples_per_pixel(500)  /* For a high-quality image */
         .set_max_depth(50)  /* More light bounces for higher quality */
-        .render(world)
+        .render(std::move(world))
         .send_as_ppm("millions_of_spheres.ppm");
 }
 
@@ -224,41 +239,44 @@ void millions_of_spheres_with_lights() {
     auto ground_material = std::make_shared<Lambertian>(RGB::from_mag(0.5, 0.5, 0.5));
     world.add(std::make_shared<Sphere>(Point3D(0,-1000000,0), 1000000, ground_material));
 
-    /* Generate small spheres */
-    for (int a = -1001; a < 1001; a++) {
-        for (int b = -1501; b < 51; b++) {
-            auto choose_mat = rand_double();
-            Point3D center(a + 0.9*rand_double(), 0.2, b + 0.9*rand_double());
-
-            if ((center - Point3D(4, 0.2, 0)).mag() > 0.9) {
-                std::shared_ptr<Material> sphere_material;
-
-                if (choose_mat < 0.035) {
-                    auto albedo = RGB::random();
-                    sphere_material = std::make_shared<DiffuseLight>(albedo, rand_double(5, 15));
-                    world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
-                } else if (choose_mat < 0.8) {
-                    // diffuse
-                    auto albedo = RGB::random() * RGB::random();
-                    sphere_material = std::make_shared<Lambertian>(albedo);
-                    world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
-                } else if (choose_mat < 0.9) {
-                    // Metal
-                    auto albedo = RGB::random(0.5, 1);
-                    auto fuzz = rand_double(0, 0.5);
-                    sphere_material = std::make_shared<Metal>(albedo, fuzz);
-                    world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
-                } else {
-                    // glass
-                    sphere_material = std::make_shared<Dielectric>(1.5);
-                    world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
-                }
+    /* Generate small spheres, one per cell (a, b) of the grid [-1001, 1001) x [-1501, 51), in
+    parallel (see `millions_of_spheres()`). */
+    constexpr int A_MIN = -1001, A_MAX = 1001, B_MIN = -1501, B_MAX = 51;
+    world.add_generated(
+        static_cast<size_t>(A_MAX - A_MIN) * static_cast<size_t>(B_MAX - B_MIN),
+        473654968,
+        [&](size_t index, CounterRNG &rng) -> std::shared_ptr<Hittable> {
+            auto a = A_MIN + static_cast<int>(index / (B_MAX - B_MIN));
+            auto b = B_MIN + static_cast<int>(index % (B_MAX - B_MIN));
+
+            auto choose_mat = rng.rand_double();
+            Point3D center{a + 0.9*rng.rand_double(), 0.2, b + 0.9*rng.rand_double()};
+            if ((center - Point3D(4, 0.2, 0)).mag() <= 0.9) {return nullptr;}
+
+            std::shared_ptr<Material> sphere_material;
+            if (choose_mat < 0.035) {
+                auto albedo = RGB::random(rng);
+                sphere_material = world.make<DiffuseLight>(albedo, rng.rand_double(5, 15));
+            } else if (choose_mat < 0.8) {
+                // diffuse
+                auto albedo = RGB::random(rng);
+                albedo = albedo * RGB::random(rng);
+                sphere_material = world.make<Lambertian>(albedo);
+            } else if (choose_mat < 0.9) {
+                // Metal
+                auto albedo = RGB::random(rng, 0.5, 1);
+                auto fuzz = rng.rand_double(0, 0.5);
+                sphere_material = world.make<Metal>(albedo, fuzz);
+            } else {
+                // glass
+                sphere_material = world.make<Dielectric>(1.5);
             }
+            return world.make<Sphere>(center, 0.2, std::move(sphere_material));
         }
-    }
+    );
 
     /* Three big spheres */
-    auto material1 = std::make_shared<Dielectric>(1.5);
+    auto material1 = world.make<Dielectric>(1.5);
     world.add(std::make_shared<Sphere>(Point3D(0, 1, 0), 1.0, material1));
 
     auto material2 = std::make_shared<Lambertian>(RGB::from_mag(0.4, 0.2, 0.1));
@@ -285,7 +303,7 @@ void millions_of_spheres_with_lights() {
         .set_samples_per_pixel(1000)  /* For a high-quality image */
         .set_max_depth(20)  /* More light bounces for higher quality */
         .set_background(RGB::zero())
-        .render(world)
+        .render(std::move(world))
         .send_as_ppm("millions_of_spheres_with_lights.ppm");
 }
 
@@ -321,9 +339,9 @@ void parallelogram_test() {
         .send_as_ppm("parallelograms_test.ppm");
 }
 
-/* Renders a Cornell Box. If `empty` is true, then no boxes will be present inside
+/* Returns a Cornell Box scene. If `empty` is true, then no boxes will be present inside
 the Cornell Box. */
-void cornell_box_test(bool empty = false) {
+Scene cornell_box_scene(bool empty = false) {
     Scene world;
 
     auto red   = ms<Lambertian>(RGB::from_mag(.65, .05, .05));
@@ -339,26 +357,110 @@ void cornell_box_test(bool empty = false) {
     world.add(ms<Parallelogram>(Point3D(555,555,555), Vec3D(-555,0,0), Vec3D(0,0,-555), white));
     world.add(ms<Parallelogram>(Point3D(0,0,555), Vec3D(555,0,0), Vec3D(0,555,0), white));
 
-    /* If `empty` is false, add the two `Box`es to the standard Cornell Box. The boxes are
-    unrotated for now.*/
+    /* If `empty` is false, add the two rotated `Box`es of the standard Cornell Box. */
     if (!empty) {
-        world.add(ms<Box>(Point3D(130, 0, 65), Point3D(295, 165, 230), white));
-        world.add(ms<Box>(Point3D(265, 0, 295), Point3D(430, 330, 460), white));
+        world.add(ms<Box>(Point3D(0, 0, 0), Point3D(165, 330, 165),
+                          Transform::translation_by(Vec3D{265, 0, 295})
+                          * Transform::rotation(Vec3D{0, 1, 0}, 15), white));
+        world.add(ms<Box>(Point3D(0, 0, 0), Point3D(165, 165, 165),
+                          Transform::translation_by(Vec3D{130, 0, 65})
+                          * Transform::rotation(Vec3D{0, 1, 0}, -18), white));
     }
-    Camera()
+    return world;
+}
+
+/* Returns the camera that `cornell_box_test()` renders the Cornell Box with. */
+Camera cornell_box_camera() {
+    return Camera()
         .set_image_by_width_and_aspect_ratio(1000, 1.)
         .set_samples_per_pixel(10)
         .set_max_depth(1000)
         .set_vertical_fov(40)
         .set_camera_center(Point3D{278, 278, -800})
-        .set_camera_direction_towards(Point3D{278, 278, 0})
+        .set_camera_lookat(Point3D{278, 278, 0})
         .set_camera_up_direction(Point3D{0, 1, 0})
         .turn_blur_off()
-        .set_background(RGB::from_mag(0))  /* Black background */
-        .render(world)
+        .set_background(RGB::from_mag(0));  /* Black background */
+}
+
+/* Renders a Cornell Box. If `empty` is true, then no boxes will be present inside
+the Cornell Box. */
+void cornell_box_test(bool empty = false) {
+    cornell_box_camera()
+        .render(cornell_box_scene(empty))
         .send_as_ppm((empty ? "empty_cornell_box.ppm" : "cornell_box_1.ppm"));
 }
 
+/* Renders a quick preview of the Cornell Box, then re-renders just the noisy region around the
+tall box with 20 times as many samples, and pastes that region into the preview. The crop window
+keeps the projection of the full image, so the region lines up with the rest of the preview. */
+void cornell_box_region_rerender_test() {
+    BVH world(cornell_box_scene());
+    auto camera = cornell_box_camera();
+    auto preview = camera.render(world);
+    preview.send_as_ppm("cornell_box_preview.ppm");
+
+    constexpr size_t COL = 180, ROW = 250, WIDTH = 330, HEIGHT = 560;
+    auto region = camera.set_samples_per_pixel(200)
+                        .set_crop_window(COL, ROW, WIDTH, HEIGHT)
+                        .render(world);
+    preview.paste(region, COL, ROW).send_as_ppm("cornell_box_region_rerendered.ppm");
+}
+
+/* Renders the Cornell Box together with its AOVs (albedo, normal, depth, material id, sample count,
+and variance; see `AOVBuffers`), and saves the image and each AOV as PFM files, for denoising and
+debugging with external tools. */
+void cornell_box_aov_test() {
+    AOVBuffers aovs(AOV::ALL);
+    auto img = cornell_box_camera().render(cornell_box_scene(), aovs);
+    img.send_as_ppm("cornell_box_beauty.ppm");
+    img.send_as_pfm("cornell_box_beauty.pfm");
+    aovs.save_as_pfm("cornell_box");
+}
+
+/* Compares denoised renders of the Cornell Box at a few low sample counts against a reference
+render with 1024 samples per pixel, printing the time taken and the PSNR (peak signal-to-noise
+ratio, relative to the reference; higher is better) of each render before and after denoising. */
+void cornell_box_denoise_test() {
+    BVH world(cornell_box_scene());
+    auto camera = cornell_box_camera();
+    camera.set_image_dimensions(600, 600);
+
+    auto start = std::chrono::steady_clock::now();
+    auto reference = camera.set_samples_per_pixel(1024).render(world);
+    auto reference_ms = ms_diff(start, std::chrono::steady_clock::now());
+    reference.send_as_ppm("cornell_box_reference.ppm");
+
+    struct Row {
+        size_t spp;
+        long long render_ms, denoise_ms;
+        double noisy_psnr, denoised_psnr;
+    };
+    std::vector<Row> rows;
+    for (size_t spp : {16, 32, 64}) {
+        AOVBuffers aovs;
+        auto render_start = std::chrono::steady_clock::now();
+        auto noisy = camera.set_samples_per_pixel(spp).render(world, aovs);
+        auto denoise_start = std::chrono::steady_clock::now();
+        auto denoised = Denoiser().denoise(noisy, aovs);
+        auto end = std::chrono::steady_clock::now();
+        denoised.send_as_ppm("cornell_box_denoised_" + std::to_string(spp) + "spp.ppm");
+        rows.push_back(Row{spp, ms_diff(render_start, denoise_start), ms_diff(denoise_start, end),
+                           peak_signal_to_noise_ratio(noisy, reference),
+                           peak_signal_to_noise_ratio(denoised, reference)});
+    }
+
+    std::cout << "\n  spp | render (ms) | denoise (ms) | PSNR noisy (dB) | PSNR denoised (dB)\n"
+              << std::fixed << std::setprecision(2);
+    for (const auto &row : rows) {
+        std::cout << std::setw(5) << row.spp << " | " << std::setw(11) << row.render_ms << " | "
+                  << std::setw(12) << row.denoise_ms << " | " << std::setw(15) << row.noisy_psnr
+                  << " | " << std::setw(18) << row.denoised_psnr << '\n';
+    }
+    std::cout << " 1024 | " << std::setw(11) << reference_ms << " |            - |       reference"
+              << " |                  -" << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
 /* Renders an image of a scene consisting of a bunch of colored parallelogram lights stretching
 away into the distance, above which are suspended numerous glass (and a few metal) "raindrops"
 (spheres). */
@@ -367,26 +469,39 @@ void raining_on_the_dance_floor() {
 
     Scene world;
 
-    /* Add the dance floor */
-    for (int x = -1000; x <= 1000; ++x) {
-        for (int z = -1000; z <= 100; ++z) {
-            world.add(ms<Parallelogram>(
-                Point3D{x + 0.1, 0, z + 0.1}, Point3D{0.8, 0, 0}, Point3D{0, 0, 0.8},
-                ms<DiffuseLight>(RGB::random(), rand_double(0.5, 2))
-            ));
-        }
+    /* Add the dance floor: one tile for each (x, z) in [-1000, 1000] x [-1000, 100], as a single
+    `TiledPlane`. The tiles are diffuse lights, whose colors and intensities are drawn from a
+    palette of `NUM_COLORS` random ones; each tile's palette entry is drawn from its own
+    counter-based random stream, in parallel. */
+    constexpr int X_MIN = -1000, X_MAX = 1000, Z_MIN = -1000, Z_MAX = 100;
+    constexpr size_t NUM_X = X_MAX - X_MIN + 1, NUM_Z = Z_MAX - Z_MIN + 1, NUM_COLORS = 4096;
+    std::vector<std::shared_ptr<Material>> palette;
+    CounterRNG palette_rng(5987634, NUM_X * NUM_Z);  /* A stream not used by any tile */
+    for (size_t i = 0; i < NUM_COLORS; ++i) {
+        auto color = RGB::random(palette_rng);
+        palette.push_back(ms<DiffuseLight>(color, palette_rng.rand_double(0.5, 2)));
     }
-
-    /* Add raindrops (and the occasional metal ball for some reason) */
-    for (size_t i = 0; i < 25000; ++i) {
-        auto choose_material = rand_double();
-        std::shared_ptr<Material> material = ms<Dielectric>(rand_double(1.25, 2.5));
-        if (choose_material < 0.05) {material = ms<Metal>(RGB::random(), 0);}
-        world.add(ms<Sphere>(Point3D{
-            rand_double(-1000, 1000), rand_double(2, 40), rand_double(-1000, 50)},
-            rand_double(0.25, 0.8),
-        material));
+    std::vector<uint16_t> tile_colors(NUM_X * NUM_Z);
+    #pragma omp parallel for
+    for (size_t i = 0; i < tile_colors.size(); ++i) {
+        CounterRNG rng(5987634, i);
+        tile_colors[i] = static_cast<uint16_t>(rng.rand_int(0, NUM_COLORS - 1));
     }
+    world.add(ms<TiledPlane>(
+        Point3D{X_MIN, 0, Z_MIN}, Vec3D{1, 0, 0}, Vec3D{0, 0, 1}, NUM_X, NUM_Z, 0.1,
+        std::move(palette), std::move(tile_colors)
+    ));
+
+    /* Add raindrops (and the occasional metal ball for some reason). These use a different seed
+    than the dance floor, so that their random streams do not coincide with those of the tiles. */
+    world.add_generated(25000, 5987635, [&](size_t, CounterRNG &rng) -> std::shared_ptr<Hittable> {
+        auto choose_material = rng.rand_double();
+        std::shared_ptr<Material> material = ms<Dielectric>(rng.rand_double(1.25, 2.5));
+        if (choose_material < 0.05) {material = ms<Metal>(RGB::random(rng), 0);}
+        Point3D center{rng.rand_double(-1000, 1000), rng.rand_double(2, 40),
+                       rng.rand_double(-1000, 50)};
+        return ms<Sphere>(center, rng.rand_double(0.25, 0.8), material);
+    });
 
     /* Add some raindrops closer to the camera center */
     for (size_t i = 0; i < 50; ++i) {
@@ -649,8 +764,897 @@ void bvh_pathological_test() {
     */
 }
 
-int main()
+/* Returns the scene of `motion_blur_test()` and `camera_path_sequence_test()`: the final scene of
+Ray Tracing in One Weekend, except that the small diffuse spheres bounce upwards and a box spins and
+slides over the scene times [0, 1]. */
+Scene bouncing_spheres_scene() {
+    Scene world;
+    world.add(ms<Sphere>(Point3D(0, -1000, 0), 1000, ms<Lambertian>(RGB::from_mag(0.5))));
+
+    world.add_generated(22 * 22, 20241017, [&](size_t index, CounterRNG &rng) {
+        auto a = static_cast<int>(index / 22) - 11, b = static_cast<int>(index % 22) - 11;
+        auto choose_material = rng.rand_double();
+        auto x = a + 0.9 * rng.rand_double();
+        Point3D center{x, 0.2, b + 0.9 * rng.rand_double()};
+        std::shared_ptr<Hittable> ret;
+        if ((center - Point3D(4, 0.2, 0)).mag() <= 0.9) {
+            return ret;
+        }
+        if (choose_material < 0.8) {
+            /* Diffuse spheres bounce upwards over the scene times [0, 1] */
+            auto albedo = RGB::random(rng);
+            albedo = albedo * RGB::random(rng);
+            auto center1 = center + Vec3D{0, rng.rand_double(0, 0.5), 0};
+            ret = ms<Sphere>(center, center1, 0.2, ms<Lambertian>(albedo));
+        } else if (choose_material < 0.95) {
+            auto albedo = RGB::random(rng, 0.5, 1);
+            ret = ms<Sphere>(center, 0.2, ms<Metal>(albedo, rng.rand_double(0, 0.5)));
+        } else {
+            ret = ms<Sphere>(center, 0.2, ms<Dielectric>(1.5));
+        }
+        return ret;
+    });
+
+    world.add(ms<Sphere>(Point3D(0, 1, 0), 1.0, ms<Dielectric>(1.5)));
+    world.add(ms<Sphere>(Point3D(-4, 1, 0), 1.0, ms<Lambertian>(RGB::from_rgb(102, 51, 25))));
+    world.add(ms<Sphere>(Point3D(4, 1, 0), 1.0, ms<Metal>(RGB::from_rgb(178, 153, 127), 0)));
+
+    /* A unit box centered at the origin, which spins by 30 degrees about the y-axis and slides
+    from z = 1.5 to z = 2.5 (in front of the metal sphere) over the scene times [0, 1] */
+    auto box = ms<Box>(Point3D(-0.5, -0.5, -0.5), Point3D(0.5, 0.5, 0.5),
+                       ms<Lambertian>(RGB::from_mag(0.2, 0.3, 0.8)));
+    auto up = Vec3D{0, 1, 0};
+    world.add(ms<Instance>(box,
+        Transform::translation_by(Vec3D{6, 0.5, 1.5}) * Transform::rotation(up, 0),
+        Transform::translation_by(Vec3D{6, 0.5, 2.5}) * Transform::rotation(up, 30)
+    ));
+
+    return world;
+}
+
+/* Renders a variation of the final scene of "Ray Tracing in One Weekend" with motion blur: the
+small diffuse spheres bounce upwards while the shutter is open, and a box spins and slides across
+the scene behind them. */
+void motion_blur_test() {
+    SeedSeqGenerator::get_instance().set_seed(20241017);
+
+    auto world = bouncing_spheres_scene();
+
+    Camera()
+        .set_image_by_width_and_aspect_ratio(1200, 16. / 9.)
+        .set_samples_per_pixel(100)
+        .set_max_depth(50)
+        .set_vertical_fov(20)
+        .set_camera_center(Point3D{13, 2, 3})
+        .set_camera_direction_towards(Point3D{0, 0, 0})
+        .set_camera_up_direction(Point3D{0, 1, 0})
+        .set_defocus_angle(0.6)
+        .set_focus_distance(10)
+        .set_shutter_interval(0, 1)
+        .render(world)
+        .send_as_ppm("motion_blur.ppm");
+}
+
+/* Renders the three kinds of textures: a marble (Perlin noise) sphere, a checkered sphere, and a
+floor covered by a fine image texture repeated many times. Without mipmapping, the distant part of
+the floor would be a mess of moire patterns; with it, the tiles fade smoothly to their average
+color. */
+void textures_test() {
+    Scene world;
+
+    /* The floor texture: 8 x 8 white tiles with dark grout, 256 x 256 texels */
+    constexpr size_t TEXELS = 256, TILES = 8;
+    auto tiles = Image::with_dimensions(TEXELS, TEXELS);
+    for (size_t row = 0; row < TEXELS; ++row) {
+        for (size_t col = 0; col < TEXELS; ++col) {
+            auto in_grout = row % (TEXELS / TILES) < 3 || col % (TEXELS / TILES) < 3;
+            auto shade = ((row / (TEXELS / TILES) + col / (TEXELS / TILES)) % 2 ? 0.8 : 0.65);
+            tiles[row][col] = (in_grout ? RGB::from_mag(0.1)
+                                        : RGB::from_mag(shade, shade, 0.9 * shade));
+        }
+    }
+    auto floor_texture = std::make_shared<ImageTexture>(std::make_shared<MipmappedImage>(tiles),
+                                                        40);
+    world.add(std::make_shared<Parallelogram>(Point3D{-200, 0, -200}, Vec3D{400, 0, 0},
+                                              Vec3D{0, 0, 400},
+                                              std::make_shared<Lambertian>(floor_texture)));
+
+    world.add(std::make_shared<Sphere>(Point3D{-1.1, 1, 0}, 1, std::make_shared<Lambertian>(
+        std::make_shared<NoiseTexture>(4, RGB::from_mag(0.9, 0.85, 0.8), 20241017)
+    )));
+    world.add(std::make_shared<Sphere>(Point3D{1.1, 1, 0}, 1, std::make_shared<Lambertian>(
+        std::make_shared<CheckerTexture>(0.25, RGB::from_mag(0.2, 0.3, 0.1), RGB::from_mag(0.9))
+    )));
+
+    Camera()
+        .set_image_by_width_and_aspect_ratio(1200, 16. / 9.)
+        .set_samples_per_pixel(64)
+        .set_max_depth(20)
+        .set_vertical_fov(30)
+        .set_camera_center(Point3D{0, 2, 7})
+        .set_camera_lookat(Point3D{0, 0.8, 0})
+        .set_camera_up_direction(Vec3D{0, 1, 0})
+        .set_background(RGB::from_mag(0.7, 0.8, 1))
+        .render(world)
+        .send_as_ppm("textures.ppm");
+}
+
+/* Renders the Cornell Box with its two boxes made of smoke (dark in the tall box, light in the
+short one) instead of solid, and a cloud of Perlin noise floating under the light. The cloud is a
+`GridMedium` that fills only part of its voxel grid, so most of its bricks are empty; they take
+no memory (see `SparseVolume`), and they are skipped without any sampling. */
+void cornell_smoke_test() {
+    Scene world;
+
+    auto red   = ms<Lambertian>(RGB::from_mag(.65, .05, .05));
+    auto white = ms<Lambertian>(RGB::from_mag(.73, .73, .73));
+    auto green = ms<Lambertian>(RGB::from_mag(.12, .45, .15));
+    auto light = ms<DiffuseLight>(RGB::from_mag(1, 1, 1), 7);
+
+    /* Walls of the Cornell Box, with a larger light to make up for the light lost in the smoke */
+    world.add(ms<Parallelogram>(Point3D(555,0,0), Vec3D(0,555,0), Vec3D(0,0,555), green));
+    world.add(ms<Parallelogram>(Point3D(0,0,0), Vec3D(0,555,0), Vec3D(0,0,555), red));
+    world.add(ms<Parallelogram>(Point3D(113,554,127), Vec3D(330,0,0), Vec3D(0,0,305), light));
+    world.add(ms<Parallelogram>(Point3D(0,0,0), Vec3D(555,0,0), Vec3D(0,0,555), white));
+    world.add(ms<Parallelogram>(Point3D(555,555,555), Vec3D(-555,0,0), Vec3D(0,0,-555), white));
+    world.add(ms<Parallelogram>(Point3D(0,0,555), Vec3D(555,0,0), Vec3D(0,555,0), white));
+
+    /* The two boxes, as constant-density smoke */
+    world.add(ms<ConstantMedium>(ms<Box>(Point3D(0, 0, 0), Point3D(165, 330, 165),
+                                         Transform::translation_by(Vec3D{265, 0, 295})
+                                         * Transform::rotation(Vec3D{0, 1, 0}, 15), white),
+                                 0.01, RGB::from_mag(0)));
+    world.add(ms<ConstantMedium>(ms<Box>(Point3D(0, 0, 0), Point3D(165, 165, 165),
+                                         Transform::translation_by(Vec3D{130, 0, 65})
+                                         * Transform::rotation(Vec3D{0, 1, 0}, -18), white),
+                                 0.01, RGB::from_mag(1)));
+
+    /* The cloud: turbulence, faded out towards the edges of an ellipsoid, and thresholded so
+    that it has clear gaps */
+    PerlinNoise noise(20241017);
+    auto cloud_bounds = AABB::from_points({Point3D{60, 360, 120}, Point3D{500, 500, 440}});
+    auto center = cloud_bounds.centroid();
+    auto cloud_density = [&](const Point3D &p) {
+        auto offset = p - center;
+        auto falloff = 1 - (offset.x * offset.x / (220. * 220.) + offset.y * offset.y / (70. * 70.)
+                            + offset.z * offset.z / (160. * 160.));
+        return std::max(0., noise.turbulence(p / 60, 5) * falloff - 0.1);
+    };
+    auto cloud = GridMedium::from_function(cloud_bounds, 176, 56, 128, cloud_density, 0.25,
+                                           RGB::from_mag(0.9));
+
+    /* Save the cloud's densities, and render the copy loaded back from the file, which must be
+    exactly the same */
+    cloud.get_volume()->save("cornell_smoke_cloud.svol");
+    auto loaded = std::make_shared<const SparseVolume>(
+        SparseVolume::from_file("cornell_smoke_cloud.svol")
+    );
+    if (!(*loaded == *cloud.get_volume())) {
+        std::cout << "Error: The cloud loaded from \"cornell_smoke_cloud.svol\" differs from the "
+                  << "one saved" << std::endl;
+        std::exit(-1);
+    }
+    world.add(ms<GridMedium>(cloud_bounds, loaded, 0.25, RGB::from_mag(0.9)));
+
+    cornell_box_camera()
+        .set_image_by_width_and_aspect_ratio(600, 1.)
+        .set_samples_per_pixel(200)
+        .set_max_depth(50)
+        .render(world)
+        .send_as_ppm("cornell_smoke.ppm");
+}
+
+/* Returns a `width` x `height` equirectangular HDR image of a clear sky: a blue gradient from the
+horizon to the zenith, dim brown ground below the horizon, and a small sun 35 degrees above the
+horizon, which is thousands of times brighter than the sky and gives most of the light. */
+Image procedural_sky_image(size_t width, size_t height) {
+    auto img = Image::with_dimensions(width, height);
+    auto sun_elevation = 35 * std::numbers::pi / 180, sun_azimuth = 0.3 * std::numbers::pi;
+    auto sun = Vec3D{std::cos(sun_elevation) * std::cos(sun_azimuth), std::sin(sun_elevation),
+                     -std::cos(sun_elevation) * std::sin(sun_azimuth)};
+    auto cos_sun_radius = std::cos(1.5 * std::numbers::pi / 180);
+
+    for (size_t row = 0; row < height; ++row) {
+        auto theta = std::numbers::pi * (static_cast<double>(row) + 0.5)
+                   / static_cast<double>(height);
+        for (size_t col = 0; col < width; ++col) {
+            /* The same mapping as `EnvironmentLight` (columns start at -x) */
+            auto phi = 2 * std::numbers::pi * ((static_cast<double>(col) + 0.5)
+                                               / static_cast<double>(width) - 0.5);
+            auto dir = Vec3D{std::sin(theta) * std::cos(phi), std::cos(theta),
+                             -std::sin(theta) * std::sin(phi)};
+            if (dot(dir, sun) > cos_sun_radius) {
+                img[row][col] = RGB::from_mag(3000, 2800, 2500);
+            } else if (dir.y >= 0) {
+                img[row][col] = lerp(RGB::from_mag(1, 0.95, 0.9), RGB::from_mag(0.25, 0.45, 0.9),
+                                     std::sqrt(dir.y));
+            } else {
+                img[row][col] = RGB::from_mag(0.12, 0.1, 0.08);
+            }
+        }
+    }
+    return img;
+}
+
+/* Renders a few spheres on a floor, lit only by `procedural_sky_image()` (saved to and loaded
+back from a PFM file, as an HDR environment map would be), with and without importance sampling
+the environment, and prints the time taken and the PSNR of each render (relative to a reference
+render with 1024 samples per pixel). Nearly all of the light comes from the sun, which rays
+scattered off the floor and spheres almost never hit by chance. */
+void environment_light_test() {
+    procedural_sky_image(1024, 512).send_as_pfm("sky.pfm");
+    auto sky = std::make_shared<const EnvironmentLight>(EnvironmentLight::from_pfm_file("sky.pfm"));
+
+    Scene scene;
+    scene.add(ms<Parallelogram>(Point3D{-50, 0, -50}, Vec3D{100, 0, 0}, Vec3D{0, 0, 100},
+                                ms<Lambertian>(RGB::from_mag(0.5))));
+    scene.add(ms<Sphere>(Point3D{-2.2, 1, 0}, 1, ms<Lambertian>(RGB::from_mag(0.7, 0.2, 0.15))));
+    scene.add(ms<Sphere>(Point3D{0, 1, 0}, 1, ms<Dielectric>(1.5)));
+    scene.add(ms<Sphere>(Point3D{2.2, 1, 0}, 1, ms<Metal>(RGB::from_mag(0.8, 0.8, 0.7), 0.2)));
+    BVH world(scene);
+
+    auto camera = Camera()
+        .set_image_by_width_and_aspect_ratio(600, 16. / 9.)
+        .set_max_depth(20)
+        .set_vertical_fov(35)
+        .set_camera_center(Point3D{0, 2.5, 9})
+        .set_camera_lookat(Point3D{0, 0.8, 0})
+        .set_camera_up_direction(Vec3D{0, 1, 0})
+        .turn_blur_off();
+
+    auto start = std::chrono::steady_clock::now();
+    auto reference = camera.set_environment(sky).set_samples_per_pixel(1024).render(world);
+    auto reference_ms = ms_diff(start, std::chrono::steady_clock::now());
+    reference.send_as_ppm("environment_reference.ppm");
+
+    std::cout << "\n  spp | importance sampling | render (ms) | PSNR (dB)\n" << std::fixed
+              << std::setprecision(2);
+    for (size_t spp : {16, 64}) {
+        for (auto importance_sample : {false, true}) {
+            auto render_start = std::chrono::steady_clock::now();
+            auto img = camera.set_environment(sky, importance_sample)
+                             .set_samples_per_pixel(spp)
+                             .render(world);
+            auto render_ms = ms_diff(render_start, std::chrono::steady_clock::now());
+            img.send_as_ppm("environment_" + std::to_string(spp) + "spp"
+                            + (importance_sample ? "_importance_sampled.ppm" : ".ppm"));
+            std::cout << std::setw(5) << spp << " | " << std::setw(19)
+                      << (importance_sample ? "yes" : "no") << " | " << std::setw(11) << render_ms
+                      << " | " << std::setw(9) << peak_signal_to_noise_ratio(img, reference)
+                      << '\n';
+        }
+    }
+    std::cout << " 1024 | " << std::setw(19) << "yes" << " | " << std::setw(11) << reference_ms
+              << " | reference" << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
+/* Renders small, bright lights far behind a sphere in focus, through a circular aperture and
+through a hexagonal one. The out-of-focus lights blur into discs with the first, and into hexagons
+with the second (the "bokeh" of a lens with six aperture blades). */
+void aperture_shape_test() {
+    Scene scene;
+    scene.add(ms<Sphere>(Point3D{0, 0, 0}, 0.5, ms<Lambertian>(RGB::from_mag(0.7, 0.2, 0.15))));
+    scene.add(ms<Sphere>(Point3D{0, 3, 0}, 1.5, ms<DiffuseLight>(RGB::from_mag(1), 1)));
+    for (int i = -2; i <= 2; ++i) {
+        for (int j = -1; j <= 1; ++j) {
+            scene.add(ms<Sphere>(Point3D{4. * i, 4. * j, -40}, 0.3,
+                                 ms<DiffuseLight>(RGB::from_mag(1, 0.75, 0.4), 40)));
+        }
+    }
+    BVH world(scene);
+
+    auto camera = Camera()
+        .set_image_by_width_and_aspect_ratio(800, 16. / 9.)
+        .set_samples_per_pixel(64)
+        .set_max_depth(10)
+        .set_vertical_fov(30)
+        .set_camera_center(Point3D{0, 0, 5})
+        .set_camera_lookat(Point3D{0, 0, 0})
+        .set_camera_up_direction(Vec3D{0, 1, 0})
+        .set_defocus_angle(3)
+        .set_background(RGB::from_mag(0));
+    camera.render(world).send_as_ppm("aperture_circular.ppm");
+    camera.set_aperture_blades(6, 90).render(world).send_as_ppm("aperture_hexagonal.ppm");
+}
+
+/* Renders four viewpoints around `bouncing_spheres_scene()`, like the several shots of a product,
+first one at a time (each `render()` builds its own `BVH`) and then all in one pass with
+`Camera::render_views()` (one `BVH`, and the rows of all views scheduled together), and prints how
+long both took. With a sample seed, both give exactly the same images. */
+void multi_view_test() {
+    SeedSeqGenerator::get_instance().set_seed(20241017);
+    auto world = bouncing_spheres_scene();
+
+    std::vector<Camera> cameras;
+    for (size_t view = 0; view < 4; ++view) {
+        auto angle = std::numbers::pi / 2 * static_cast<double>(view) + 0.3;
+        cameras.push_back(Camera()
+            .set_image_by_width_and_aspect_ratio(600, 16. / 9.)
+            .set_samples_per_pixel(32)
+            .set_max_depth(20)
+            .set_vertical_fov(25)
+            .set_camera_center(Point3D{13 * std::cos(angle), 3, 13 * std::sin(angle)})
+            .set_camera_lookat(Point3D{0, 0.5, 0})
+            .set_camera_up_direction(Vec3D{0, 1, 0})
+            .set_sample_seed(view));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Image> separate;
+    for (auto &camera : cameras) {
+        separate.push_back(camera.render(world));
+    }
+    auto separate_ms = ms_diff(start, std::chrono::steady_clock::now());
+
+    start = std::chrono::steady_clock::now();
+    auto views = Camera::render_views(cameras, world);
+    auto one_pass_ms = ms_diff(start, std::chrono::steady_clock::now());
+
+    for (size_t view = 0; view < views.size(); ++view) {
+        views[view].send_as_ppm("view_" + std::to_string(view) + ".ppm");
+    }
+    std::cout << "\nOne view at a time: " << separate_ms << " ms\nAll views in one pass: "
+              << one_pass_ms << " ms" << std::endl;
+}
+
+/* Renders panoramas from the middle of `bouncing_spheres_scene()`, all in one render job (see
+`Camera::render_views()`): an equirectangular environment capture (saved as a PFM image, which
+`EnvironmentLight::from_pfm_file()` can load back), a cube map, and an over-under stereo
+equirectangular VR frame. */
+void panorama_test() {
+    SeedSeqGenerator::get_instance().set_seed(20241017);
+    auto world = bouncing_spheres_scene();
+
+    auto panorama_camera = [] {
+        return Camera()
+            .set_samples_per_pixel(32)
+            .set_max_depth(20)
+            .set_camera_center(Point3D{0, 1.5, 2.5})
+            .set_camera_direction(Vec3D{0, 0, -1})
+            .set_camera_up_direction(Vec3D{0, 1, 0});
+    };
+    std::vector<Camera> cameras{
+        panorama_camera().set_image_dimensions(1024, 512)
+                         .set_projection(Projection::EQUIRECTANGULAR),
+        panorama_camera().set_image_dimensions(6 * 256, 256).set_projection(Projection::CUBEMAP),
+        panorama_camera().set_image_dimensions(1024, 1024)
+                         .set_projection(Projection::EQUIRECTANGULAR)
+                         .set_stereo(0.064)
+    };
+    auto views = Camera::render_views(cameras, world);
+    views[0].send_as_pfm("panorama_capture.pfm");
+    views[0].send_as_ppm("panorama_capture.ppm");
+    views[1].send_as_ppm("panorama_cubemap.ppm");
+    views[2].send_as_ppm("panorama_stereo.ppm");
+}
+
+/* Reports the memory used by a scene of about a million spheres after building it, after building
+its `BVH`, and after rendering an image of it (see `MemoryReport`), to show where the memory of a
+large scene goes. Most spheres share one of a few `Lambertian` materials, and the rest have their
+own `Metal` material, so both shared and unique materials are counted. */
+void memory_report_test() {
+    SeedSeqGenerator::get_instance().set_seed(20241017);
+    std::cout << "Peak RSS before building the scene: "
+              << peak_rss_bytes() / (1 << 20) << " MiB" << std::endl;
+
+    std::vector<std::shared_ptr<Material>> palette;
+    for (size_t i = 0; i < 8; ++i) {
+        palette.push_back(std::make_shared<Lambertian>(RGB::random() * RGB::random()));
+    }
+
+    Scene world;
+    world.add(std::make_shared<Sphere>(Point3D(0, -1000000, 0), 1000000, palette[0]));
+    constexpr size_t GRID_SIZE = 1000;
+    world.add_generated(
+        GRID_SIZE * GRID_SIZE, SeedSeqGenerator::get_instance().next_seed(),
+        [&](size_t index, CounterRNG &rng) -> std::shared_ptr<Hittable> {
+            Point3D center{static_cast<double>(index / GRID_SIZE) + 0.9 * rng.rand_double(), 0.2,
+                           -static_cast<double>(index % GRID_SIZE) - 0.9 * rng.rand_double()};
+            if (rng.rand_double() < 0.9) {
+                return std::make_shared<Sphere>(center, 0.2, palette[rng.rand_int(0, 7)]);
+            }
+            auto metal = std::make_shared<Metal>(RGB::random(rng, 0.5, 1), rng.rand_double(0, 0.5));
+            return std::make_shared<Sphere>(center, 0.2, metal);
+        }
+    );
+
+    /* The counts, followed by the memory the process has actually held so far */
+    MemoryReport report;
+    auto print_report = [&](const std::string &title) {
+        report.print_to(std::cout, title);
+        std::cout << "  Peak RSS of the process: " << peak_rss_bytes() / (1 << 20) << " MiB"
+                  << std::endl;
+    };
+    world.report_memory(report);
+    print_report("\nAfter building the scene");
+
+    BVH bvh(world);
+    bvh.report_memory(report);
+    print_report("\nAfter building the BVH");
+
+    auto image = Camera()
+        .set_image_by_width_and_aspect_ratio(400, 16. / 9.)
+        .set_samples_per_pixel(4)
+        .set_max_depth(10)
+        .set_vertical_fov(30)
+        .set_camera_center(Point3D{-20, 12, 20})
+        .set_camera_lookat(Point3D{20, 0, -20})
+        .set_camera_up_direction(Vec3D{0, 1, 0})
+        .render(bvh);
+    report.add(MemoryCategory::IMAGES, image.memory_bytes());
+    print_report("\nAfter rendering");
+    image.send_as_ppm("memory_report_test.ppm");
+
+    std::cout << "\nBytes per primitive (scene and BVH): "
+              << static_cast<double>(report.total_bytes() - report.bytes_in(MemoryCategory::IMAGES))
+                 / static_cast<double>(world.size()) << std::endl;
+}
+
+/* Builds the same scene of about a million spheres twice, once with every sphere and material
+made by `std::make_shared`, and once made in the scene's arena (see `Scene::make()`), and compares
+how long building the scene, building its `BVH`, and rendering it take. Both must render exactly
+the same image. */
+void scene_arena_benchmark() {
+    auto build_scene = [](bool use_arena) {
+        Scene world;
+        auto make_sphere = [&](const Point3D &center, std::shared_ptr<Material> material) {
+            return (use_arena ? world.make<Sphere>(center, 0.2, std::move(material))
+                              : std::make_shared<Sphere>(center, 0.2, std::move(material)));
+        };
+        constexpr size_t GRID_SIZE = 1000;
+        world.add(std::make_shared<Sphere>(Point3D(0, -1000000, 0), 1000000,
+                                           std::make_shared<Lambertian>(RGB::from_mag(0.5))));
+        world.add_generated(
+            GRID_SIZE * GRID_SIZE, 20241017,
+            [&](size_t index, CounterRNG &rng) -> std::shared_ptr<Hittable> {
+                Point3D center{static_cast<double>(index / GRID_SIZE) + 0.9 * rng.rand_double(),
+                               0.2,
+                               -static_cast<double>(index % GRID_SIZE) - 0.9 * rng.rand_double()};
+                auto albedo = RGB::random(rng) * RGB::random(rng);
+                return make_sphere(center, (use_arena ? world.make<Lambertian>(albedo)
+                                                      : std::make_shared<Lambertian>(albedo)));
+            }
+        );
+        return world;
+    };
+
+    std::vector<Image> images;
+    for (bool use_arena : {false, true}) {
+        auto start = std::chrono::steady_clock::now();
+        auto world = build_scene(use_arena);
+        auto build_ms = ms_diff(start, std::chrono::steady_clock::now());
+        auto arena_bytes = world.arena_bytes();
+
+        start = std::chrono::steady_clock::now();
+        BVH bvh(std::move(world));
+        auto bvh_ms = ms_diff(start, std::chrono::steady_clock::now());
+
+        start = std::chrono::steady_clock::now();
+        images.push_back(Camera()
+            .set_image_by_width_and_aspect_ratio(400, 16. / 9.)
+            .set_samples_per_pixel(16)
+            .set_max_depth(10)
+            .set_vertical_fov(30)
+            .set_camera_center(Point3D{-20, 12, 20})
+            .set_camera_lookat(Point3D{20, 0, -20})
+            .set_camera_up_direction(Vec3D{0, 1, 0})
+            .set_sample_seed(1)
+            .render(bvh));
+        auto render_ms = ms_diff(start, std::chrono::steady_clock::now());
+
+        std::cout << (use_arena ? "Scene arena" : "std::make_shared") << ": built the scene in "
+                  << build_ms << " ms (" << arena_bytes / (1 << 20) << " MiB in the arena), the "
+                  << "BVH in " << bvh_ms << " ms, and rendered in " << render_ms << " ms\n"
+                  << std::endl;
+    }
+
+    for (size_t row = 0; row < images[0].height(); ++row) {
+        for (size_t col = 0; col < images[0].width(); ++col) {
+            const auto &a = images[0][row][col], &b = images[1][row][col];
+            if (a.r != b.r || a.g != b.g || a.b != b.b) {
+                std::cout << "Error: The images differ at (row " << row << ", column " << col
+                          << ")" << std::endl;
+                std::exit(-1);
+            }
+        }
+    }
+    std::cout << "Both images are identical" << std::endl;
+}
+
+/* Measures how rendering a scene of about a million spheres scales from 1 thread to as many
+threads as OpenMP uses by default (doubling each time), with the threads unpinned, and with them
+pinned round-robin across the NUMA nodes and the `BVH` copied onto every node (see
+`Camera::set_thread_placement()`). On a machine with one NUMA node, only the pinning differs. */
+void numa_scaling_benchmark() {
+    Scene world;
+    constexpr size_t GRID_SIZE = 1000;
+    world.add_generated(
+        GRID_SIZE * GRID_SIZE, 20241017,
+        [&](size_t index, CounterRNG &rng) -> std::shared_ptr<Hittable> {
+            Point3D center{static_cast<double>(index / GRID_SIZE) + 0.9 * rng.rand_double(), 0.2,
+                           -static_cast<double>(index % GRID_SIZE) - 0.9 * rng.rand_double()};
+            return world.make<Sphere>(center, 0.2, world.make<Lambertian>(RGB::random(rng)));
+        }
+    );
+    world.add(world.make<Sphere>(Point3D(0, -1000000, 0), 1000000,
+                                 world.make<Lambertian>(RGB::from_mag(0.5))));
+    BVH bvh(std::move(world));
+
+    const auto &topology = NumaTopology::get();
+    std::cout << "NUMA nodes: " << topology.num_nodes() << ", default threads: "
+              << NumaTopology::max_threads() << '\n' << std::endl;
+    /* Copy the `BVH` onto every node before timing anything; every pinned render reuses the
+    copies (see `BVH::numa_replicas()`) */
+    if (topology.num_nodes() > 1) {
+        bvh.numa_replicas();
+    }
+
+    std::vector<size_t> thread_counts;
+    for (size_t threads = 1; threads < NumaTopology::max_threads(); threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(NumaTopology::max_threads());
+
+    std::vector<std::string> lines;
+    for (auto placement : {ThreadPlacement::UNPINNED, ThreadPlacement::SPREAD}) {
+        long long single_thread_ms = 0;
+        for (auto threads : thread_counts) {
+            auto start = std::chrono::steady_clock::now();
+            Camera()
+                .set_image_by_width_and_aspect_ratio(640, 16. / 9.)
+                .set_samples_per_pixel(8)
+                .set_max_depth(10)
+                .set_vertical_fov(30)
+                .set_camera_center(Point3D{-20, 12, 20})
+                .set_camera_lookat(Point3D{20, 0, -20})
+                .set_camera_up_direction(Vec3D{0, 1, 0})
+                .set_num_threads(threads)
+                .set_thread_placement(placement, true)
+                .render(bvh);
+            auto ms = ms_diff(start, std::chrono::steady_clock::now());
+            if (threads == 1) {
+                single_thread_ms = ms;
+            }
+
+            std::ostringstream line;
+            line << (placement == ThreadPlacement::UNPINNED ? "Unpinned" : "Pinned, spread")
+                 << ", " << threads << " threads: " << ms << " ms (speedup "
+                 << std::fixed << std::setprecision(2)
+                 << static_cast<double>(single_thread_ms)
+                    / static_cast<double>(std::max<long long>(ms, 1))
+                 << "x)";
+            lines.push_back(line.str());
+        }
+    }
+    std::cout << '\n';
+    for (const auto &line : lines) {
+        std::cout << line << '\n';
+    }
+    std::cout << std::flush;
+}
+
+/* Benchmarks traversals of a large `BVH` (over two million spheres, with at most two spheres per
+leaf, so that its nodes alone take over a hundred megabytes) with random rays, with the nodes and
+the spheres on ordinary pages, and then on huge pages (see `HugePages`). Both must find exactly the
+same hits. */
+void bvh_traversal_benchmark() {
+    constexpr size_t GRID_SIZE = 1500, NUM_RAYS = 1'000'000;
+    /* `hit_times[j][i]` = The hit time of the `i`th ray in the `j`th traversal, or -1 if it
+    missed. The hits are compared ray by ray, since a sum of the hit times would depend on the
+    order in which the threads added them up. */
+    std::vector<std::vector<double>> hit_times;
+
+    for (bool huge : {false, true}) {
+        HugePages::set_enabled(huge);
+        auto huge_bytes_before = HugePages::resident_bytes();
+
+        Scene world;
+        world.add_generated(
+            GRID_SIZE * GRID_SIZE, 20241017,
+            [&](size_t index, CounterRNG &rng) -> std::shared_ptr<Hittable> {
+                Point3D center{static_cast<double>(index / GRID_SIZE) + 0.9 * rng.rand_double(),
+                               0.2 + rng.rand_double(),
+                               static_cast<double>(index % GRID_SIZE) + 0.9 * rng.rand_double()};
+                return world.make<Sphere>(center, 0.2, world.make<Lambertian>(RGB::random(rng)));
+            }
+        );
+        BVH bvh(std::move(world), 32, 2);
+        auto huge_bytes = HugePages::resident_bytes() - std::min(HugePages::resident_bytes(),
+                                                                 huge_bytes_before);
+
+        /* Rays from random points above the spheres to random points below them, so that every
+        ray descends deep into the `BVH`, at a random place */
+        auto &times = hit_times.emplace_back(NUM_RAYS, -1);
+        auto start = std::chrono::steady_clock::now();
+        size_t num_hits = 0;
+        #pragma omp parallel for reduction(+:num_hits)
+        for (size_t i = 0; i < NUM_RAYS; ++i) {
+            CounterRNG rng(1234, i);
+            auto size = static_cast<double>(GRID_SIZE);
+            Point3D origin{rng.rand_double(0, size), 5, rng.rand_double(0, size)};
+            Point3D target{rng.rand_double(0, size), 0, rng.rand_double(0, size)};
+            if (auto hit = bvh.hit_by(Ray3D{.origin = origin, .dir = target - origin},
+                                      Interval(0.001, 1))) {
+                ++num_hits;
+                times[i] = hit->hit_time;
+            }
+        }
+        auto ms = ms_diff(start, std::chrono::steady_clock::now());
+
+        std::cout << (huge ? "Huge pages" : "Ordinary pages") << ": " << NUM_RAYS << " rays in "
+                  << ms << " ms (" << num_hits << " hits); " << huge_bytes / (1 << 20)
+                  << " MiB of the scene and BVH on huge pages\n" << std::endl;
+    }
+    HugePages::set_enabled(false);
+
+    for (size_t i = 0; i < NUM_RAYS; ++i) {
+        if (hit_times[0][i] != hit_times[1][i]) {
+            std::cout << "Error: The traversals found different hits for ray " << i << std::endl;
+            std::exit(-1);
+        }
+    }
+    std::cout << "Both traversals found the same hits" << std::endl;
+}
+
+/* Renders a 48-frame animation of `bouncing_spheres_scene()`, with the camera swinging around the
+scene along a spline and the shutter open for half of each frame. The `BVH` is built only once for
+all frames, and is refit to each frame's shutter interval. */
+void camera_path_sequence_test() {
+    SeedSeqGenerator::get_instance().set_seed(20241017);
+
+    auto world = bouncing_spheres_scene();
+
+    auto camera = Camera()
+        .set_image_by_width_and_aspect_ratio(640, 16. / 9.)
+        .set_samples_per_pixel(32)
+        .set_max_depth(20)
+        .set_vertical_fov(20)
+        .set_camera_up_direction(Point3D{0, 1, 0})
+        .set_defocus_angle(0.6)
+        .set_focus_distance(10);
+
+    Sequence(camera, CameraPath::orbit(Point3D{0, 0, 0}, 13.3, 2, -13, 60))
+        .set_num_frames(48)
+        .set_shutter_fraction(0.5)
+        .set_file_prefix("sequence_")
+        .render(world);
+}
+
+/* Benchmarks ray-parallelogram intersection kernels on leaf-sized groups of floor tiles, like the
+BVH leaves of `raining_on_the_dance_floor()`: the previous kernel (a plane hit followed by two cross
+products and two dot products, reproduced in `legacy_hit_time` below), the current
+`Parallelogram::hit_by()` (two dot products against the precomputed dual basis), and
+`ParallelogramBatch::hit_by()` (the same test on all tiles of a leaf at once, in SoA layout).
+Every kernel must find exactly the same hits. */
+void parallelogram_kernel_benchmark() {
+    /* Few enough leaves that all tiles stay in cache, so that this measures the kernels rather
+    than memory latency */
+    constexpr size_t NUM_LEAVES = 64, TILES_PER_LEAF = 12, NUM_RAYS = 4'000'000;
+    CounterRNG rng(4082025, 0);
+
+    /* Each leaf is a row of `TILES_PER_LEAF` tiles at random heights. The previous kernel needs
+    the sides of each tile, which `Parallelogram` does not store anymore, so it gets its own copy
+    of every tile as a `LegacyTile`. */
+    struct LegacyTile {Point3D vertex; Vec3D side1, side2, unit_normal, scaled_normal;};
+    auto material = ms<Lambertian>(RGB::from_mag(0.5));
+    std::vector<Parallelogram> tiles;
+    std::vector<LegacyTile> legacy_tiles;
+    ParallelogramBatch batch;
+    tiles.reserve(NUM_LEAVES * TILES_PER_LEAF);
+    for (size_t leaf = 0; leaf < NUM_LEAVES; ++leaf) {
+        for (size_t i = 0; i < TILES_PER_LEAF; ++i) {
+            auto vertex = Point3D{static_cast<double>(i), rng.rand_double(-0.5, 0.5),
+                                  static_cast<double>(leaf)};
+            auto side1 = Vec3D{0.95, 0, 0}, side2 = Vec3D{0, 0, 0.95};
+            tiles.emplace_back(vertex, side1, side2, material);
+            auto n = cross(side1, side2);
+            legacy_tiles.push_back({vertex, side1, side2, n.unit_vector(), n / n.mag_squared()});
+        }
+    }
+    for (const auto &tile : tiles) {
+        batch.add(tile);
+    }
+
+    auto legacy_hit_time = [](const LegacyTile &tile, const Ray3D &ray,
+                              const Interval &ray_times) -> std::optional<double> {
+        auto denominator = dot(tile.unit_normal, ray.dir);
+        if (std::fabs(denominator) < 1e-9) {return {};}
+        auto t = dot(tile.unit_normal, tile.vertex - ray.origin) / denominator;
+        if (!ray_times.contains_exclusive(t)) {return {};}
+        auto p = ray(t) - tile.vertex;
+        auto alpha = dot(tile.scaled_normal, cross(p, tile.side2));
+        auto beta = dot(tile.scaled_normal, cross(tile.side1, p));
+        if (alpha < 0 || alpha > 1 || beta < 0 || beta > 1) {return {};}
+        return t;
+    };
+
+    /* Random downward rays aimed at a random leaf each */
+    std::vector<Ray3D> rays;
+    std::vector<size_t> ray_leaves;
+    rays.reserve(NUM_RAYS);
+    for (size_t i = 0; i < NUM_RAYS; ++i) {
+        auto leaf = static_cast<size_t>(rng.rand_int(0, NUM_LEAVES - 1));
+        auto origin = Point3D{rng.rand_double(-1, TILES_PER_LEAF + 1.), 5,
+                              static_cast<double>(leaf) + rng.rand_double(-1, 2)};
+        auto dir = Vec3D{rng.rand_double(-0.3, 0.3), -1., rng.rand_double(-0.3, 0.3)};
+        rays.push_back(Ray3D{origin, dir});
+        ray_leaves.push_back(leaf);
+    }
+
+    /* Runs `kernel(ray, leaf)` (returning the earliest hit time, if any) on every ray, and
+    prints its best timing out of `NUM_TRIALS` along with the number of hits and the sum of the
+    hit times (which must be identical for all kernels). */
+    constexpr int NUM_TRIALS = 3;
+    auto run = [&](const std::string &name, auto &&kernel) {
+        auto elapsed_ms = std::numeric_limits<long long>::max();
+        size_t num_hits = 0;
+        double hit_time_sum = 0;
+        for (int trial = 0; trial < NUM_TRIALS; ++trial) {
+            auto start = std::chrono::steady_clock::now();
+            num_hits = 0;
+            hit_time_sum = 0;
+            for (size_t i = 0; i < NUM_RAYS; ++i) {
+                if (auto t = kernel(rays[i], ray_leaves[i]); t) {
+                    ++num_hits;
+                    hit_time_sum += *t;
+                }
+            }
+            elapsed_ms = std::min<long long>(elapsed_ms,
+                                             ms_diff(start, std::chrono::steady_clock::now()));
+        }
+        std::cout << name << ": " << elapsed_ms << "ms ("
+                  << 1e6 * static_cast<double>(elapsed_ms) / (NUM_RAYS * TILES_PER_LEAF)
+                  << "ns per ray-parallelogram test), " << num_hits << " hits, hit time sum "
+                  << std::setprecision(17) << hit_time_sum << std::setprecision(6) << std::endl;
+    };
+
+    run("Legacy cross-product kernel  ", [&](const Ray3D &ray, size_t leaf) {
+        std::optional<double> result;
+        auto ray_times = Interval(1e-3, Interval::DOUBLE_INF);
+        for (size_t i = leaf * TILES_PER_LEAF; i < (leaf + 1) * TILES_PER_LEAF; ++i) {
+            if (auto t = legacy_hit_time(legacy_tiles[i], ray, ray_times); t) {
+                result = t;
+                ray_times.max = *t;
+            }
+        }
+        return result;
+    });
+    run("Parallelogram::hit_by()      ", [&](const Ray3D &ray, size_t leaf) {
+        std::optional<double> result;
+        auto ray_times = Interval(1e-3, Interval::DOUBLE_INF);
+        for (size_t i = leaf * TILES_PER_LEAF; i < (leaf + 1) * TILES_PER_LEAF; ++i) {
+            if (auto hit = tiles[i].hit_by(ray, ray_times); hit) {
+                result = hit->hit_time;
+                ray_times.max = hit->hit_time;
+            }
+        }
+        return result;
+    });
+    run("ParallelogramBatch::hit_by() ", [&](const Ray3D &ray, size_t leaf) {
+        auto hit = batch.hit_by(leaf * TILES_PER_LEAF, TILES_PER_LEAF, ray,
+                                Interval(1e-3, Interval::DOUBLE_INF));
+        return (hit ? std::optional<double>(hit->hit_time) : std::nullopt);
+    });
+}
+
+/* Returns the scenes that a `RenderServer` or a `DistributedRender` can render: the Cornell Box
+and `bouncing_spheres_scene()` (with a fixed seed, so that every process generates the same
+spheres). */
+SceneRegistry scene_registry() {
+    SceneRegistry registry;
+    registry["cornell_box"] = RegisteredScene{[] {return cornell_box_scene();},
+                                              cornell_box_camera()};
+    registry["bouncing_spheres"] = RegisteredScene{[] {
+        SeedSeqGenerator::get_instance().set_seed(20241017);
+        return bouncing_spheres_scene();
+    }, Camera()
+        .set_image_by_width_and_aspect_ratio(1200, 16. / 9.)
+        .set_samples_per_pixel(100)
+        .set_max_depth(50)
+        .set_vertical_fov(20)
+        .set_camera_center(Point3D{13, 2, 3})
+        .set_camera_lookat(Point3D{0, 0, 0})
+        .set_camera_up_direction(Point3D{0, 1, 0})
+        .set_defocus_angle(0.6)
+        .set_focus_distance(10)
+        .set_shutter_interval(0, 1)};
+    return registry;
+}
+
+/* Runs a `RenderServer` on the UNIX domain socket `socket_path`, with the scenes of
+`scene_registry()` resident. If `preload` is true, they are all loaded before the server starts
+accepting commands. */
+void run_render_server(const std::string &socket_path, bool preload) {
+    RenderServer().add_scenes(scene_registry()).run(socket_path, preload);
+}
+
+/* Renders the registered scene `scene_name` with a `DistributedRender` of `num_workers` worker
+processes, and saves it to `file_name`. The image is split into 32 by 32 tiles, or, if `by_samples`
+is true, into 4 sample ranges per worker (so that faster workers can take more of them). */
+void distributed_render(const std::string &scene_name, size_t num_workers, bool by_samples,
+                        const std::string &file_name) {
+    auto registry = scene_registry();
+    if (!registry.contains(scene_name)) {
+        std::cout << "Error: Unknown scene \"" << scene_name << "\"" << std::endl;
+        std::exit(-1);
+    }
+    const auto &camera = registry.at(scene_name).camera;
+    DistributedRender render(scene_name, camera.image_width(), camera.image_height(),
+                             camera.get_samples_per_pixel(), 20241017);
+    render.set_num_workers(num_workers);
+    if (by_samples) {
+        render.split_into_sample_ranges(4 * num_workers);
+    } else {
+        render.split_into_tiles(32);
+    }
+    render.render().send_as_ppm(file_name);
+}
+
+/* Usage:
+- `cpp_raytracer`: Runs the demo selected in the `switch` below.
+- `cpp_raytracer --serve <socket path> [--preload]`: Runs a render server (see `RenderServer`).
+- `cpp_raytracer --distribute <scene> <workers> [tiles | samples] [<output file>]`: Renders a
+  registered scene (see `scene_registry()`) with several worker processes (see
+  `DistributedRender`).
+- `cpp_raytracer --worker <file descriptor>`: Runs a worker of a `DistributedRender`; only started
+  by `DistributedRender` itself.
+- `cpp_raytracer --send <socket path> <command>...`: Sends the command (the remaining arguments,
+  joined by spaces) to a render server, and prints its reply. For example,
+  `cpp_raytracer --send /tmp/rt.sock RENDER scene=cornell_box out=preview.ppm width=250 height=250`.
+*/
+int main(int argc, char *argv[])
 {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    auto print_usage = [&] {
+        std::cout << "Usage: " << argv[0] << " [--serve <socket path> [--preload] | --send "
+                  << "<socket path> <command>... | --distribute <scene> <workers> "
+                  << "[tiles | samples] [<output file>]]" << std::endl;
+    };
+    if (args.size() >= 2 && args[0] == "--serve") {
+        run_render_server(args[1], args.size() >= 3 && args[2] == "--preload");
+        return 0;
+    }
+    if (args.size() >= 2 && args[0] == "--worker") {
+        auto fd = RenderRequest::parse_integer(args[1], 0, std::numeric_limits<int>::max());
+        if (!fd) {
+            std::cout << "Error: \"" << args[1] << "\" is not a file descriptor" << std::endl;
+            return 1;
+        }
+        run_render_worker(static_cast<int>(*fd), scene_registry());
+        return 0;
+    }
+    if (args.size() >= 3 && args[0] == "--distribute") {
+        /* Each worker is a process of its own, so there are at most `MAX_WORKERS` of them */
+        constexpr double MAX_WORKERS = 1024;
+        auto num_workers = RenderRequest::parse_integer(args[2], 1, MAX_WORKERS);
+        if (!num_workers) {
+            std::cout << "Error: The number of workers must be an integer in [1, "
+                      << MAX_WORKERS << "], not \"" << args[2] << "\"" << std::endl;
+            print_usage();
+            return 1;
+        }
+        distributed_render(args[1], static_cast<size_t>(*num_workers),
+                           args.size() >= 4 && args[3] == "samples",
+                           args.size() >= 5 ? args[4] : "distributed_" + args[1] + ".ppm");
+        return 0;
+    }
+    if (args.size() >= 3 && args[0] == "--send") {
+        std::string command;
+        for (size_t i = 2; i < args.size(); ++i) {
+            command += (i > 2 ? " " : "") + args[i];
+        }
+        auto reply = send_render_command(args[1], command);
+        if (!reply) {
+            return 1;
+        }
+        std::cout << *reply << std::endl;
+        return reply->starts_with("OK") ? 0 : 1;
+    }
+    if (!args.empty()) {
+        print_usage();
+        return 1;
+    }
+
     switch(4) {
         case -10: bvh_pathological_test(); break;
         case -4: rtow_final_image(); break;
@@ -662,6 +1666,22 @@ int main()
         case 2: cornell_box_test(false); break;
         case 3: raining_on_the_dance_floor(); break;
         case 4: christmas_tree_made_of_spheres(); break;
+        case 5: parallelogram_kernel_benchmark(); break;
+        case 6: motion_blur_test(); break;
+        case 7: camera_path_sequence_test(); break;
+        case 8: cornell_box_region_rerender_test(); break;
+        case 9: cornell_box_aov_test(); break;
+        case 10: cornell_box_denoise_test(); break;
+        case 11: textures_test(); break;
+        case 12: cornell_smoke_test(); break;
+        case 13: environment_light_test(); break;
+        case 14: aperture_shape_test(); break;
+        case 15: multi_view_test(); break;
+        case 16: panorama_test(); break;
+        case 17: memory_report_test(); break;
+        case 18: scene_arena_benchmark(); break;
+        case 19: numa_scaling_benchmark(); break;
+        case 20: bvh_traversal_benchmark(); break;
         default: std::cout << "Nothing to do" << std::endl; break;
     }
 